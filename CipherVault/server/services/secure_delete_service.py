@@ -21,6 +21,14 @@ from kernel buffer cache to the physical disk, then deleted.
 
 import os
 
+# Each pass is written through one buffer of this size, so memory use does
+# not grow with the file (the C tool's `encrypt_tool --wipe` does the same
+# natively, with a keyed CSPRNG instead of os.urandom).
+WIPE_CHUNK = 1024 * 1024
+
+# bytes.translate() table mapping every byte to its bitwise complement
+_COMPLEMENT = bytes(~b & 0xFF for b in range(256))
+
 
 def secure_delete_file(filepath: str, passes: int = 3) -> bool:
     """
@@ -46,20 +54,16 @@ def secure_delete_file(filepath: str, passes: int = 3) -> bool:
             # Seek to beginning of file before each pass
             f.seek(0)
 
-            if pass_num == 0:
-                # Pass 1: Write random bytes
-                # Overwrites original data with unpredictable content
-                f.write(os.urandom(file_size))
-            elif pass_num == 1:
-                # Pass 2: Write complement pattern
-                # Ensures all bit positions are flipped from pass 1
-                random_data = os.urandom(file_size)
-                complement = bytes(~b & 0xFF for b in random_data)
-                f.write(complement)
-            else:
-                # Pass 3+: Write fresh random bytes
-                # Final pass with new random data
-                f.write(os.urandom(file_size))
+            remaining = file_size
+            while remaining > 0:
+                chunk = os.urandom(min(WIPE_CHUNK, remaining))
+                if pass_num == 1:
+                    # Pass 2: Write complement pattern
+                    # translate() flips every byte in C, not one at a time
+                    chunk = chunk.translate(_COMPLEMENT)
+                # Pass 1 and 3+: random bytes over the original data
+                f.write(chunk)
+                remaining -= len(chunk)
 
             # Flush Python's internal buffer to the OS
             f.flush()
@@ -67,6 +71,7 @@ def secure_delete_file(filepath: str, passes: int = 3) -> bool:
             # Force OS to flush its kernel buffer cache to physical disk.
             # This is critical: without fsync(), data might remain in
             # the OS page cache and never actually reach the disk sectors.
+            # One fsync per pass, not per chunk.
             os.fsync(f.fileno())
 
     # Finally, remove the file from the filesystem
@@ -0,0 +1,79 @@
+/*
+ * batch.h - Many files per process (encrypt_tool --manifest)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * A manifest lists input/output pairs: one "INPUT<TAB>OUTPUT" per line
+ * ('#' starts a comment), or, if the data contains a NUL byte, NUL-
+ * separated fields alternating input and output (find -print0 style).
+ * "-" reads the manifest from stdin. Files run in parallel, one per
+ * worker, and share one keyring, so a batch under one passphrase costs a
+ * single KDF instead of one per file plus a process start.
+ *
+ * A manifest file (not stdin) is resumable: progress is journalled to
+ * MANIFEST.journal, which is removed once every file has succeeded. After
+ * a crash or failure, --resume skips finished files and continues large
+ * ones from their last checkpoint instead of starting them over.
+ *
+ * Durability follows opts->durability (FIO_SYNC_*). NONE and FILE act
+ * per file. GROUP leaves files unsynced and makes them durable in
+ * groups: one syncfs() per filesystem once group_files files have
+ * finished or group_ms has passed, checked as files finish, and at the
+ * end of the batch. A file is journalled done only once it is durable,
+ * so a resumed batch never trusts an output a power loss could have
+ * lost; under NONE nothing is, and --resume redoes every file not
+ * covered by a checkpoint.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stream.h"
+
+/* Group sync defaults */
+#define BATCH_GROUP_FILES 64
+#define BATCH_GROUP_MS 1000
+
+typedef struct {
+    int resume;                /* Continue from MANIFEST.journal */
+    uint32_t group_files;      /* FIO_SYNC_GROUP: files per sync (0 = default) */
+    uint32_t group_ms;         /* ... or milliseconds per sync (0 = default) */
+} batch_opts_t;
+
+typedef struct {
+    uint64_t files;            /* Pairs in the manifest */
+    uint64_t succeeded;
+    uint64_t failed;
+    uint64_t skipped;          /* Finished by an earlier run (resume) */
+    uint64_t resumed;          /* Continued from a checkpoint (resume) */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t kdf_calls;        /* PBKDF2 runs for the passphrase */
+    uint64_t syncs;            /* syncfs() calls made by FIO_SYNC_GROUP */
+    uint64_t wall_ns;          /* First file start to last file end */
+    uint64_t bad_line;         /* Malformed manifest line (ENC_ERR_INVALID_FORMAT) */
+} batch_result_t;
+
+/* Fill opts with defaults (no resume, default group size and interval) */
+void batch_opts_init(batch_opts_t *opts);
+
+/*
+ * Encrypt (decrypt = 0) or decrypt every pair in manifest. opts->threads
+ * is the number of files in flight (0 = one per CPU); each file runs on a
+ * single thread. One result line per file goes to log as it finishes.
+ * Per-file failures are counted, not fatal; failed outputs are removed.
+ * An existing journal is refused unless bopts->resume is set.
+ *
+ * @return: ENC_SUCCESS if every file succeeded; if some failed
+ *          (result->failed > 0), the ENC_* error of the first to fail;
+ *          otherwise the ENC_* code that kept the batch from starting
+ */
+int batch_run(const char *manifest, const char *passphrase, int decrypt,
+              const batch_opts_t *bopts, const stream_opts_t *opts, batch_result_t *result,
+              FILE *log);
+
+#endif /* BATCH_H */
@@ -0,0 +1,82 @@
+/*
+ * bench.h - Built-in benchmark suite (encrypt_tool --bench)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Output formats */
+#define BENCH_FORMAT_TEXT 0
+#define BENCH_FORMAT_JSON 1
+#define BENCH_FORMAT_CSV  2
+
+/* Default sweep limits */
+#define BENCH_DEFAULT_MAX_SIZE (1024ULL * 1024 * 1024)
+#define BENCH_DEFAULT_SEED 1
+
+typedef struct {
+    int format;                /* Format written to stdout */
+    uint64_t max_size;         /* Largest payload in the size sweep */
+    int threads;               /* Threads outside the thread sweep, 0 = all CPUs */
+    int quick;                 /* Shorter timing windows, fewer cases */
+    double min_seconds;        /* Timing window per case, 0 = default */
+    unsigned int seed;         /* PRNG seed for payload contents */
+    const char *dir;           /* Scratch directory for file-backed cases */
+    const char *report_path;   /* Optional extra .json / .csv report */
+} bench_opts_t;
+
+/* One measured case */
+typedef struct {
+    char section[16];          /* "algorithm", "threads", "kdf", "io", "pages" */
+    char backend[16];          /* "memory", "file", "kdf"; page mode for "pages" */
+    int algorithm;
+    uint64_t size;
+    int threads;
+    uint32_t kdf_iterations;
+    int reps;
+    double mb_per_s;           /* Throughput at the median latency */
+    double p50_ms;
+    double p99_ms;
+    long peak_rss_kb;          /* Peak RSS of the process that ran the case */
+    int pages;                 /* SECMEM_PAGES_* requested ("pages" section) */
+    uint64_t huge_bytes;       /* Buffer bytes that actually got huge pages */
+    int rc;                    /* ENC_* result of the case */
+} bench_row_t;
+
+void bench_opts_init(bench_opts_t *opts);
+
+/* Parse "text" / "json" / "csv"; returns -1 if unknown */
+int bench_format_from_name(const char *name);
+
+/*
+ * Run the full sweep, printing rows to out as they complete.
+ * @return: 0 if every case succeeded, -1 otherwise
+ */
+int bench_run(const bench_opts_t *opts, FILE *out);
+
+/*
+ * Regression gate: run the fixed, seeded regression set several times
+ * and write the median metrics as a baseline file with default per-metric tolerances,
+ * keyed to this host (architecture, CPU model, CPU count).
+ * @return: 0 on success, -1 otherwise
+ */
+int bench_save_baseline(const bench_opts_t *opts, const char *path, FILE *out);
+
+/*
+ * Run the regression set and compare the median of each metric over
+ * several runs against a baseline file.
+ * Baseline lines are "<case> <metric> <value> <tolerance>", plus one
+ * "host <key>"; '#' starts a comment. A missing baseline, or one recorded
+ * on another host, is reported as skipped without running anything:
+ * absolute numbers from another machine say nothing about this one.
+ * @return: 0 if no metric regressed beyond its tolerance (or skipped), -1 otherwise
+ */
+int bench_check(const bench_opts_t *opts, const char *path, FILE *out);
+
+#endif /* BENCH_H */
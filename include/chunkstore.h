@@ -0,0 +1,69 @@
+/*
+ * chunkstore.h - Deduplicating encrypted version store (--store)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Files are cut into variable-size chunks at content-defined boundaries
+ * (a keyed Gear rolling hash), so an edit only changes the chunks around
+ * it. Each chunk is sealed on its own and stored once under its keyed ID;
+ * a version is an encrypted manifest listing chunk IDs. Storing another
+ * version costs the changed chunks plus the manifest.
+ *
+ * Layout:
+ *   DIR/store.hdr              FENC v3 header wrapping the store key
+ *   DIR/chunks/ab/<id hex>     nonce || AES-256-GCM(chunk) || tag, AAD = id
+ *   DIR/versions/NAME/<n>      sealed manifest, AAD = NAME || n
+ */
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <stdint.h>
+
+/* Chunk size bounds; boundaries average CHUNK_AVG_SIZE */
+#define CHUNK_MIN_SIZE (16 * 1024)
+#define CHUNK_AVG_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (256 * 1024)
+
+/* Input chunked, then sealed in parallel, per round */
+#define CHUNK_WINDOW (8 * 1024 * 1024)
+
+typedef struct {
+    int threads;               /* 0 = one per CPU */
+    uint32_t kdf_iterations;   /* New stores only, 0 = default */
+} chunk_opts_t;
+
+typedef struct {
+    uint32_t version;          /* Version stored or restored */
+    uint64_t bytes;            /* Plaintext bytes */
+    uint64_t chunks;           /* Chunks in the version */
+    uint64_t new_chunks;       /* Chunks not already in the store (put) */
+    uint64_t new_bytes;        /* Sealed bytes written for them */
+    int io_error;              /* FIO_* code when ENC_ERR_IO is returned */
+    const char *io_path;
+} chunk_result_t;
+
+void chunk_opts_init(chunk_opts_t *opts);
+
+/*
+ * Store input as the next version of name, creating the store with
+ * passphrase if it does not exist. name may not contain '/' or start
+ * with '.'.
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code
+ */
+int chunk_put(const char *store, const char *name, const char *input, const char *passphrase,
+              const chunk_opts_t *opts, chunk_result_t *result);
+
+/*
+ * Rebuild version `version` of name (0 = latest) into output, through a
+ * temporary file renamed over it on success, so a failed or wrong-key
+ * restore leaves an existing output untouched.
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code
+ */
+int chunk_get(const char *store, const char *name, uint32_t version, const char *output,
+              const char *passphrase, const chunk_opts_t *opts, chunk_result_t *result);
+
+#endif /* CHUNKSTORE_H */
@@ -1,11 +1,15 @@
 /*
- * encryption.h - AES-256-GCM file encryption declarations
+ * encryption.h - Authenticated file encryption declarations
+ *
+ * Supported algorithms (selected by an ID stored in the FENC header):
+ *   AES-256-GCM, ChaCha20-Poly1305, AES-256-CBC + HMAC-SHA256
  */
 
 #ifndef ENCRYPTION_H
 #define ENCRYPTION_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define ENC_SUCCESS 0
 #define ENC_ERR_INVALID_ARG -1
@@ -15,10 +19,347 @@
 #define ENC_ERR_ENCRYPT -5
 #define ENC_ERR_DECRYPT -6
 #define ENC_ERR_INVALID_FORMAT -7
+#define ENC_ERR_IO -8
+#define ENC_ERR_BUDGET -9
+#define ENC_ERR_NO_SLOT -10
+#define ENC_ERR_LAST_SLOT -11
+#define ENC_ERR_CANCELLED -12
+
+/* Algorithm IDs (stored in byte 5 of a v2/v3 header) */
+#define ENC_ALG_AES_256_GCM 1
+#define ENC_ALG_CHACHA20_POLY1305 2
+#define ENC_ALG_AES_256_CBC_HMAC 3
+
+#define ENC_KEY_LEN 32
+#define ENC_SALT_LEN 16
+#define ENC_NONCE_LEN 12
+#define ENC_MAX_TAG_LEN 32
+#define ENC_DEFAULT_ITERATIONS 250000
+#define ENC_MIN_ITERATIONS 10000
+
+/* Plaintext bytes per segment */
+#define ENC_DEFAULT_SEGMENT_SIZE (1024 * 1024)
+#define ENC_MIN_SEGMENT_SIZE 4096
+#define ENC_MAX_SEGMENT_SIZE (64 * 1024 * 1024)
 
 /*
- * Encrypts plaintext bytes into a binary payload:
- * [magic(4)][version(1)][iterations(4)][salt(16)][iv(12)][tag(16)][ciphertext]
+ * v2 header (52 bytes, all integers big-endian):
+ * [magic(4)][version(1)][alg(1)][reserved(2)][iterations(4)][salt(16)]
+ * [segment_size(4)][plaintext_len(8)][nonce(12)]
+ *
+ * Followed by ceil(plaintext_len / segment_size) sealed segments (at least
+ * one). Each segment is sealed independently with nonce = nonce XOR index
+ * and AAD = header || index, so segments can be processed in parallel while
+ * reordering, truncation and header tampering are still detected.
+ */
+#define ENC_HEADER_LEN 52
+
+/*
+ * v3 header (envelope encryption): a random data key seals the segments
+ * and the passphrase only wraps that key, so changing the passphrase
+ * rewrites the header and nothing else.
+ *
+ * [magic(4)][version=3(1)][alg(1)][slot_count(1)][reserved(1)]
+ * [segment_size(4)][plaintext_len(8)][nonce(12)][reserved(8)]   = 40 bytes
+ * slot_count key slots of 80 bytes each:
+ * [iterations(4)][salt(16)][wrap_nonce(12)][wrapped_key(32)][tag(16)]
+ *
+ * A slot is AES-256-GCM(PBKDF2(passphrase, salt, iterations), wrap_nonce,
+ * data_key, AAD = the 40 fixed bytes); iterations == 0 marks it empty.
+ * Segments use AAD = fixed bytes || index, so slots can be rewritten
+ * without touching the payload.
+ */
+#define ENC_V3_FIXED_LEN 40
+#define ENC_SLOT_LEN 80
+#define ENC_MAX_SLOTS 16
+#define ENC_MAX_HEADER_LEN (ENC_V3_FIXED_LEN + ENC_MAX_SLOTS * ENC_SLOT_LEN)
+
+/* Bytes needed to tell the version and header length of a payload */
+#define ENC_HEADER_PREFIX_LEN 8
+
+typedef struct {
+    uint32_t iterations;                 /* 0 = empty slot */
+    unsigned char salt[ENC_SALT_LEN];
+    unsigned char nonce[ENC_NONCE_LEN];
+    unsigned char wrapped[ENC_KEY_LEN + 16];
+} enc_slot_t;
+
+typedef struct {
+    int version;
+    int algorithm;
+    uint32_t iterations;                 /* v2 only */
+    uint32_t segment_size;
+    uint64_t plaintext_len;
+    unsigned char salt[ENC_SALT_LEN];    /* v2 only */
+    unsigned char nonce[ENC_NONCE_LEN];
+    int slot_count;                      /* v3 only */
+    enc_slot_t slots[ENC_MAX_SLOTS];
+    size_t header_len;                   /* Bytes before the first segment */
+    size_t aad_len;                      /* Leading bytes of raw bound to segments */
+    unsigned char raw[ENC_MAX_HEADER_LEN];  /* encoded form */
+} enc_header_t;
+
+/* Key material for one file */
+typedef struct {
+    int algorithm;
+    unsigned char key[ENC_KEY_LEN];
+    unsigned char mac_key[ENC_KEY_LEN];  /* CBC-HMAC only */
+} enc_key_t;
+
+/* Passphrase-derived key-encryption key for one salt/iteration pair.
+ * Deriving it once lets many headers be wrapped or unwrapped per KDF. */
+typedef struct {
+    uint32_t iterations;
+    unsigned char salt[ENC_SALT_LEN];
+    unsigned char key[ENC_KEY_LEN];
+} enc_kek_t;
+
+/* Returns algorithm ID for a name (case-insensitive), or ENC_ERR_INVALID_ARG.
+ * Accepts both native names ("chacha20-poly1305") and CipherVault names
+ * ("ChaCha20", "AES-GCM", "AES-CBC"). */
+int enc_alg_from_name(const char *name);
+
+/* Canonical display name, e.g. "AES-256-GCM" */
+const char *enc_alg_name(int algorithm);
+
+/*
+ * Fill a v3 header with a fresh nonce and slot_count empty key slots
+ * (0 = one). segment_size == 0 selects the default. The header is
+ * encoded once enc_generate_key() fills a slot.
+ */
+int enc_header_init(
+    enc_header_t *header,
+    int algorithm,
+    uint32_t segment_size,
+    uint64_t plaintext_len,
+    int slot_count
+);
+
+/* Parse a v2 or v3 header. Returns ENC_ERR_INVALID_FORMAT if buf is not one. */
+int enc_header_decode(const unsigned char *buf, size_t len, enc_header_t *header);
+
+/* Header length of a v2/v3 payload from its first ENC_HEADER_PREFIX_LEN bytes */
+int enc_header_size(const unsigned char *buf, size_t len, size_t *header_len);
+
+/* Returns the format version of buf (1, 2 or 3), or ENC_ERR_INVALID_FORMAT */
+int enc_payload_version(const unsigned char *buf, size_t len);
+
+/* Number of segments and total encrypted size described by a header */
+uint64_t enc_segment_count(const enc_header_t *header);
+uint64_t enc_payload_size(const enc_header_t *header);
+
+/* Bytes added to a segment of plaintext_len bytes when sealed */
+size_t enc_sealed_len(int algorithm, size_t plaintext_len);
+
+/*
+ * Derive a KEK. salt == NULL picks a fresh random salt; iterations == 0
+ * selects the default.
+ */
+int enc_kek_derive(const char *passphrase, const unsigned char *salt, uint32_t iterations,
+                   enc_kek_t *kek);
+void enc_kek_wipe(enc_kek_t *kek);
+
+/* Create a random data key for a new v3 header, wrap it into slot 0 with
+ * kek and encode the header. */
+int enc_generate_key(enc_header_t *header, const enc_kek_t *kek, enc_key_t *key);
+
+/*
+ * Unwrap the data key with kek, trying every slot sharing its salt and
+ * iterations. slot (optional) receives the slot that opened.
+ * @return: ENC_SUCCESS, or ENC_ERR_DECRYPT if no slot opens
+ */
+int enc_unwrap_key(const enc_header_t *header, const enc_kek_t *kek, enc_key_t *key, int *slot);
+
+/*
+ * Unwrap slot `slot` with old_kek and wrap the same data key into it with
+ * new_kek (fresh wrap nonce), then re-encode. Segments are unaffected.
+ */
+int enc_rewrap_slot(enc_header_t *header, int slot, const enc_kek_t *old_kek,
+                    const enc_kek_t *new_kek);
+
+/*
+ * Unwrap the data key with kek and wrap a copy for new_kek into the first
+ * empty slot, then re-encode. slot (optional) receives that slot.
+ * @return: ENC_ERR_NO_SLOT if every slot is taken
+ */
+int enc_add_slot(enc_header_t *header, const enc_kek_t *kek, const enc_kek_t *new_kek,
+                 int *slot);
+
+/*
+ * Empty slot `slot` and re-encode. The header length, and so the payload
+ * offset, stays the same.
+ * @return: ENC_ERR_LAST_SLOT rather than leave no way to open the file
+ */
+int enc_remove_slot(enc_header_t *header, int slot);
+
+/* Passphrase convenience: v2 runs PBKDF2 directly, v3 derives a KEK per
+ * distinct slot and unwraps */
+int enc_derive_key(const char *passphrase, const enc_header_t *header, enc_key_t *key);
+void enc_key_wipe(enc_key_t *key);
+
+/*
+ * Re-wrap the slot old_passphrase opens for new_passphrase (v3 only).
+ * @return: ENC_ERR_DECRYPT if old_passphrase opens no slot,
+ *          ENC_ERR_INVALID_FORMAT for v2 headers, which have no key slots
+ */
+int enc_rekey_header(enc_header_t *header, const char *old_passphrase,
+                     const char *new_passphrase, uint32_t iterations);
+
+/*
+ * Recipients (v3 only): passphrase must open an existing slot. Adding
+ * wraps the same data key for new_passphrase into an empty slot; removing
+ * empties the slot passphrase opens. slot (optional) receives the slot.
+ */
+int enc_add_recipient(enc_header_t *header, const char *passphrase,
+                      const char *new_passphrase, uint32_t iterations, int *slot);
+int enc_remove_recipient(enc_header_t *header, const char *passphrase, int *slot);
+
+/*
+ * Content-addressed blobs (chunk store). A store master key yields two
+ * keys: key->key seals blobs with AES-256-GCM, key->mac_key names them
+ * with HMAC-SHA256, so equal plaintexts get equal IDs without exposing a
+ * plain hash of the content. A sealed blob is nonce || ciphertext || tag
+ * (ENC_BLOB_OVERHEAD extra bytes) with caller-chosen AAD.
+ */
+#define ENC_BLOB_ID_LEN 32
+#define ENC_BLOB_OVERHEAD (ENC_NONCE_LEN + 16)
+
+int enc_blob_keys(const enc_key_t *master, enc_key_t *keys);
+int enc_blob_id(const enc_key_t *keys, const unsigned char *data, size_t len, unsigned char *id);
+int enc_seal_blob(const enc_key_t *keys, const unsigned char *aad, size_t aad_len,
+                  const unsigned char *in, size_t in_len, unsigned char *out);
+int enc_open_blob(const enc_key_t *keys, const unsigned char *aad, size_t aad_len,
+                  const unsigned char *in, size_t in_len, unsigned char *out, size_t *out_len);
+
+/*
+ * Fill out with the AES-256-CTR keystream of key from 16-byte block
+ * `block` on: a fast CSPRNG for overwrite patterns. The same key and
+ * block reproduce the same bytes, so a pass can be regenerated instead of
+ * stored.
+ */
+int enc_keystream(const unsigned char *key, uint64_t block, unsigned char *out, size_t len);
+
+/*
+ * Seal / open one segment. out must hold enc_sealed_len(alg, in_len) bytes
+ * (seal) or in_len bytes (open).
+ *
+ * The _gen variants take the segment's generation (see Segment index
+ * below; NULL is generation 0); the plain ones use generation 0.
+ */
+int enc_seal_segment(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+);
+
+int enc_open_segment(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+);
+
+/*
+ * Segment index (v2/v3 files updated in place). Resealing a segment with
+ * new plaintext bumps its generation g > 0, which is appended to the AAD,
+ * and seals it under a fresh random nonce kept beside g. A counter alone
+ * is not enough: restoring an older copy of the file and updating it
+ * again would count the same generations a second time. Generations live
+ * in a trailer after the last segment:
+ *
+ * [sealed table: generation(4) nonce(12) per segment]
+ * [index nonce(12)][epoch(4)]["FIDX"]
+ *
+ * The table is sealed as segment ENC_INDEX_SEGMENT at generation epoch,
+ * which grows with every update. It authenticates the file as a whole:
+ * an old segment no longer matches the table, and an old table no longer
+ * matches the segments. A file without a trailer is all generation 0,
+ * whose nonce is header nonce XOR index.
+ *
+ * Generation ENC_GEN_HOLE marks a segment that was a hole in a sparse
+ * input: it is never sealed and its bytes in the file are never read (the
+ * encryptor leaves a hole there too). Opening it yields zeros.
+ */
+#define ENC_GEN_HOLE UINT32_MAX
+#define ENC_INDEX_MAGIC "FIDX"
+#define ENC_INDEX_ENTRY_LEN (4 + ENC_NONCE_LEN)
+#define ENC_INDEX_FOOTER_LEN (ENC_NONCE_LEN + 8)
+#define ENC_INDEX_SEGMENT UINT64_MAX
+
+typedef struct {
+    uint32_t generation;
+    unsigned char nonce[ENC_NONCE_LEN];  /* Used when generation > 0 */
+} enc_gen_t;
+
+int enc_seal_segment_gen(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const enc_gen_t *gen,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+);
+
+int enc_open_segment_gen(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const enc_gen_t *gen,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+);
+
+/* Fill next with the generation after current and a fresh nonce */
+int enc_next_gen(const enc_gen_t *current, enc_gen_t *next);
+
+/* Trailer length for the file described by header */
+uint64_t enc_index_size(const enc_header_t *header);
+
+/* Seal one generation per segment into out (enc_index_size() bytes);
+ * epoch must be > 0 */
+int enc_seal_index(const enc_header_t *header, const enc_key_t *key, uint32_t epoch,
+                   const enc_gen_t *generations, unsigned char *out);
+
+/* Authenticate a trailer and fill one generation per segment */
+int enc_open_index(const enc_header_t *header, const enc_key_t *key, const unsigned char *in,
+                   size_t in_len, enc_gen_t *generations, uint32_t *epoch);
+
+/*
+ * Encrypts plaintext bytes into an in-memory v3 payload.
+ */
+int enc_encrypt_payload(
+    int algorithm,
+    const unsigned char *plaintext,
+    size_t plaintext_len,
+    const char *passphrase,
+    unsigned char **out_payload,
+    size_t *out_payload_len
+);
+
+/*
+ * Decrypts a v1, v2 or v3 payload back into plaintext bytes.
+ */
+int enc_decrypt_payload(
+    const unsigned char *payload,
+    size_t payload_len,
+    const char *passphrase,
+    unsigned char **out_plaintext,
+    size_t *out_plaintext_len
+);
+
+/*
+ * Encrypts plaintext bytes with AES-256-GCM (v3 payload).
  */
 int aes_encrypt_payload(
     const unsigned char *plaintext,
@@ -29,7 +370,8 @@ int aes_encrypt_payload(
 );
 
 /*
- * Decrypts payload produced by aes_encrypt_payload back into plaintext bytes.
+ * Decrypts payload produced by aes_encrypt_payload, or a legacy v1 payload:
+ * [magic(4)][version(1)][iterations(4)][salt(16)][iv(12)][tag(16)][ciphertext]
  */
 int aes_decrypt_payload(
     const unsigned char *payload,
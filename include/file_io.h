@@ -9,6 +9,7 @@
 #define FILE_IO_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* Buffer size for file operations (8KB for efficient I/O) */
 #define BUFFER_SIZE 8192
@@ -26,7 +27,7 @@
  * Uses system calls: open(), read(), close(), lseek()
  * 
  * @param filename:  Path to file to read
- * @param buffer:    Pointer to store allocated buffer (caller must free)
+ * @param buffer:    Pointer to store allocated buffer (caller must mem_free)
  * @param size:      Pointer to store file size
  * 
  * @return: FIO_SUCCESS on success, error code on failure
@@ -34,8 +35,9 @@
 int read_file(const char *filename, unsigned char **buffer, size_t *size);
 
 /*
- * Write buffer to file
- * Uses system calls: open(), write(), close()
+ * Write buffer to file atomically: to a temporary file, then rename()
+ * over filename, so a crash never leaves it truncated (no fsync)
+ * Uses system calls: open(), write(), close(), rename()
  * 
  * @param filename:  Path to output file (created if not exists)
  * @param buffer:    Data buffer to write
@@ -45,6 +47,202 @@ int read_file(const char *filename, unsigned char **buffer, size_t *size);
  */
 int write_file(const char *filename, const unsigned char *buffer, size_t size);
 
+/*
+ * Open a file for streaming reads and report its size
+ * Uses system calls: open(), fstat()
+ *
+ * @param filename:  Path to file to read
+ * @param fd:        Pointer to store the file descriptor
+ * @param size:      Pointer to store file size
+ *
+ * @return: FIO_SUCCESS on success, error code on failure
+ */
+int fio_open_input(const char *filename, int *fd, uint64_t *size);
+
+/*
+ * Create/truncate a file for streaming writes
+ * Uses system calls: open()
+ *
+ * @return: FIO_SUCCESS on success, error code on failure
+ */
+int fio_open_output(const char *filename, int *fd);
+
+/*
+ * Open/create a file for appending (journals); mode 0600
+ * Uses system calls: open() with O_APPEND
+ *
+ * @return: FIO_SUCCESS on success, error code on failure
+ */
+int fio_open_append(const char *filename, int *fd);
+
+/*
+ * Open an existing file read-write for in-place updates (no truncation)
+ * Uses system calls: open(), fstat()
+ *
+ * @return: FIO_SUCCESS on success, error code on failure
+ */
+int fio_open_update(const char *filename, int *fd, uint64_t *size);
+
+/* Outputs are written to PATH FIO_TEMP_SUFFIX ID and renamed over PATH;
+ * ID is FIO_TEMP_ID_LEN random characters */
+#define FIO_TEMP_SUFFIX ".fenc-tmp."
+#define FIO_TEMP_ID_LEN 12
+
+/* Durability of a committed output */
+#define FIO_SYNC_NONE   0   /* Atomic rename only: survives the process, not the machine */
+#define FIO_SYNC_FILE   1   /* fsync() the data before the rename, the directory after */
+#define FIO_SYNC_GROUP  2   /* Like NONE here; the caller covers many files with one
+                               fio_syncfs() */
+
+/*
+ * Fresh random temporary-file ID: FIO_TEMP_ID_LEN characters from
+ * [0-9a-z] and a NUL
+ *
+ * @return: FIO_SUCCESS, or FIO_ERR_OPEN if no randomness is available
+ */
+int fio_temp_id(char *id);
+
+/*
+ * Temporary name for an atomic write of path (path FIO_TEMP_SUFFIX id)
+ *
+ * @return: FIO_SUCCESS, or FIO_ERR_OPEN if it does not fit in len
+ */
+int fio_temp_path(const char *path, const char *id, char *tmp, size_t len);
+
+/*
+ * Create the temporary file for path with O_EXCL | O_NOFOLLOW and return
+ * its name in tmp. id NULL draws a fresh random ID (and draws again if
+ * that name is taken); a caller that must find the file again after a
+ * crash passes its own from fio_temp_id().
+ *
+ * @return: FIO_SUCCESS, or FIO_ERR_OPEN if the name exists or cannot be
+ *          created
+ */
+int fio_open_temp(const char *path, const char *id, char *tmp, size_t len, int *fd);
+
+/*
+ * Reopen an existing temporary file read-write (O_NOFOLLOW) to continue
+ * it; refuses anything but a regular file with a single link
+ *
+ * @return: FIO_SUCCESS, FIO_ERR_OPEN
+ */
+int fio_reopen_temp(const char *tmp, int *fd, uint64_t *size);
+
+/*
+ * Publish a finished temporary file: fsync() it if sync is FIO_SYNC_FILE,
+ * close fd, rename() tmp over path, then fsync() path's directory. A
+ * reader sees the old file or the whole new one, never a partial one.
+ * fd is closed in every case; tmp is left for the caller on failure.
+ *
+ * An existing path's mode and (with privilege) owner carry over to the
+ * new file. Its other hard links do not: they keep naming the old inode
+ * and its old contents.
+ *
+ * @return: FIO_SUCCESS, FIO_ERR_WRITE or FIO_ERR_CLOSE
+ */
+int fio_commit(int fd, const char *tmp, const char *path, int sync);
+
+/*
+ * Close a descriptor from fio_open_input/fio_open_output
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_CLOSE on failure
+ */
+int fio_close(int fd);
+
+/*
+ * Read exactly len bytes, retrying short reads and EINTR
+ *
+ * @param got:  Bytes actually read (less than len only at end of file)
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_READ on failure
+ */
+int fio_read_full(int fd, unsigned char *buffer, size_t len, size_t *got);
+
+/*
+ * Write exactly len bytes, retrying short writes and EINTR
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_WRITE on failure
+ */
+int fio_write_full(int fd, const unsigned char *buffer, size_t len);
+
+/*
+ * Positional read/write at offset via pread()/pwrite(); the file offset
+ * is not moved. Same retry and return rules as above.
+ */
+int fio_pread_full(int fd, unsigned char *buffer, size_t len, uint64_t offset, size_t *got);
+int fio_pwrite_full(int fd, const unsigned char *buffer, size_t len, uint64_t offset);
+
+/*
+ * Positional I/O backend: 1 if many threads may pread()/pwrite() disjoint
+ * ranges of fd at once (a regular file or block device, not O_APPEND),
+ * with its current offset in *offset; 0 for pipes, sockets and terminals,
+ * which only work front to back
+ */
+int fio_positional(int fd, uint64_t *offset);
+
+/*
+ * Find the next allocated data at or after offset with lseek(SEEK_DATA /
+ * SEEK_HOLE): [*data, *end), clamped to size. *data == size means only a
+ * hole is left. Where holes cannot be seen, everything up to size counts
+ * as data. Moves the file offset.
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_READ on failure
+ */
+int fio_next_data(int fd, uint64_t offset, uint64_t size, uint64_t *data, uint64_t *end);
+
+/*
+ * Reserve len bytes at offset for a file about to be written, without
+ * changing its size (fallocate() with FALLOC_FL_KEEP_SIZE on Linux), so
+ * the filesystem can place it in a few large extents up front instead of
+ * growing it write by write. Does nothing where that is unsupported.
+ *
+ * @return: FIO_SUCCESS, or FIO_ERR_WRITE if the space is not available
+ */
+int fio_preallocate(int fd, uint64_t offset, uint64_t len);
+
+/*
+ * Flush a file to stable storage with fsync()
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_WRITE on failure
+ */
+int fio_sync(int fd);
+
+/*
+ * Flush the whole filesystem holding fd (syncfs() on Linux, else sync())
+ *
+ * @return: FIO_SUCCESS on success, FIO_ERR_WRITE on failure
+ */
+int fio_syncfs(int fd);
+
+/*
+ * fsync() a directory so new or renamed entries in it survive a crash
+ *
+ * @return: FIO_SUCCESS, FIO_ERR_OPEN or FIO_ERR_WRITE
+ */
+int fio_sync_dir(const char *path);
+
+/* fio_sync_dir() on the directory that holds path */
+int fio_sync_parent(const char *path);
+
+/* How fio_snapshot() copied the data */
+#define FIO_SNAP_REFLINK     1   /* ioctl(FICLONE): shared copy-on-write extents */
+#define FIO_SNAP_COPY_RANGE  2   /* copy_file_range(): in-kernel copy */
+#define FIO_SNAP_STREAM      3   /* read()/write() through a fixed buffer */
+
+/*
+ * Copy src to dst, by reflink when the filesystem supports it, else
+ * copy_file_range(), else a streamed copy. The copy is written to a
+ * temporary file and published with fio_commit(FIO_SYNC_FILE), so an
+ * existing dst is replaced whole or left as it was.
+ *
+ * @param method:  Receives FIO_SNAP_*
+ * @param bytes:   Receives the bytes copied
+ *
+ * @return: FIO_SUCCESS, FIO_ERR_OPEN if dst is src itself, FIO_ERR_WRITE
+ *          if src changed size during the copy, or another FIO_ERR_* code
+ */
+int fio_snapshot(const char *src, const char *dst, int *method, uint64_t *bytes);
+
 /*
  * Get string description of error code
  * 
@@ -0,0 +1,85 @@
+/*
+ * job.h - One encrypt/decrypt run on its own thread
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * The menu UI starts a job and keeps drawing while it runs: the worker
+ * publishes its byte progress with atomic stores, the UI thread samples
+ * it, and job_cancel() stops the stream at the next batch boundary.
+ * A cancelled or failed job leaves no output file behind. The job queue
+ * screen prepares jobs with job_init() and starts them as slots free up.
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "stream.h"
+
+#define JOB_PATH_LEN 4096
+
+/* Job states */
+#define JOB_IDLE 0
+#define JOB_QUEUED 1       /* Prepared by job_init(), not started */
+#define JOB_RUNNING 2
+#define JOB_DONE 3         /* Finished; job_wait() returns its status */
+
+typedef struct {
+    int decrypt;
+    char input[JOB_PATH_LEN];
+    char output[JOB_PATH_LEN];
+    char *passphrase;          /* Locked copy, wiped by job_wait() */
+    stream_opts_t opts;
+    stream_result_t result;    /* Valid after job_wait() */
+    int rc;                    /* Valid after job_wait() */
+
+    /* Shared with the worker; read and written with __atomic builtins */
+    uint64_t done;
+    uint64_t total;
+    int cancel;
+    int state;
+
+    uint64_t start_ns;         /* CLOCK_MONOTONIC; set by job_run() */
+    uint64_t end_ns;           /* Set by the worker before JOB_DONE */
+    pthread_t thread;
+} job_t;
+
+/*
+ * Copy the arguments into job (JOB_QUEUED). opts->progress and
+ * opts->cancel are replaced by the job's own.
+ *
+ * @return: ENC_SUCCESS, ENC_ERR_INVALID_ARG or ENC_ERR_MEMORY
+ */
+int job_init(job_t *job, int decrypt, const char *input, const char *output,
+             const char *passphrase, const stream_opts_t *opts);
+
+/* Start a queued job on a new thread; ENC_ERR_MEMORY if none can be made */
+int job_run(job_t *job);
+
+/* job_init() + job_run() */
+int job_start(job_t *job, int decrypt, const char *input, const char *output,
+              const char *passphrase, const stream_opts_t *opts);
+
+/* Current state (JOB_*) and byte progress; safe from any thread */
+int job_state(const job_t *job);
+void job_progress(const job_t *job, uint64_t *done, uint64_t *total);
+
+/* Seconds since job_run(), frozen when the job finishes */
+double job_elapsed(const job_t *job);
+
+/* Ask the worker to stop; it returns ENC_ERR_CANCELLED. A queued job
+ * will not start. */
+void job_cancel(job_t *job);
+
+/*
+ * Join the worker and release the passphrase copy. A job that never
+ * ran returns ENC_ERR_CANCELLED.
+ *
+ * @return: the stream's ENC_* status
+ */
+int job_wait(job_t *job);
+
+#endif /* JOB_H */
@@ -0,0 +1,42 @@
+/*
+ * mem.h - Tracking allocator with peak accounting and an optional budget
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * All engine buffers go through mem_alloc()/mem_free() so the process can
+ * report its peak buffer footprint and refuse allocations that would
+ * exceed --max-memory instead of being killed by the OOM killer.
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Allocate size bytes (16-byte aligned). Returns NULL on failure or when
+ * the allocation would exceed the configured limit. */
+void *mem_alloc(size_t size);
+
+/* Allocate zeroed memory for count * size bytes */
+void *mem_calloc(size_t count, size_t size);
+
+/* Release memory from mem_alloc/mem_calloc. NULL is ignored. */
+void mem_free(void *ptr);
+
+/* Charge / refund bytes obtained outside mem_alloc (e.g. mmap) against
+ * the same counters and limit. mem_reserve returns 0 if it would not fit. */
+int mem_reserve(uint64_t size);
+void mem_release(uint64_t size);
+
+/* Bytes currently allocated / highest value since start or last reset */
+uint64_t mem_current(void);
+uint64_t mem_peak(void);
+void mem_reset_peak(void);
+
+/* Budget for tracked allocations, 0 = unlimited */
+void mem_set_limit(uint64_t limit);
+uint64_t mem_limit(void);
+
+#endif /* MEM_H */
@@ -0,0 +1,55 @@
+/*
+ * secmem.h - Pooled, locked buffers for segment data and key material
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Blocks come from mmap()ed regions that are pre-faulted and mlock()ed
+ * (best effort, subject to RLIMIT_MEMLOCK), so secrets are never swapped
+ * out. Freed blocks are wiped and kept on a per-thread free list, then a
+ * shared one, so repeated runs with the same shapes do not touch the
+ * system allocator at all.
+ */
+
+#ifndef SECMEM_H
+#define SECMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Page backing for blocks of 2 MiB and up */
+#define SECMEM_PAGES_DEFAULT 0    /* Regular 4 KiB pages */
+#define SECMEM_PAGES_THP     1    /* Transparent huge pages, madvise(MADV_HUGEPAGE) */
+#define SECMEM_PAGES_HUGETLB 2    /* MAP_HUGETLB, falling back to THP, then 4 KiB */
+
+typedef struct {
+    uint64_t mapped_bytes;    /* Bytes currently obtained from mmap() */
+    uint64_t locked_bytes;    /* Of those, bytes mlock() succeeded for */
+    uint64_t cached_bytes;    /* Free blocks held for reuse */
+    uint64_t maps;            /* Blocks created from fresh mappings */
+    uint64_t reuses;          /* Allocations served from a free list */
+    uint64_t huge_bytes;      /* Mapped bytes backed (or advised) as huge pages */
+    uint64_t peak_mapped_bytes;  /* High-water mark of mapped_bytes */
+} secmem_stats_t;
+
+/* Allocate size bytes (64-byte aligned). Counts against mem_limit().
+ * Returns NULL on failure. */
+void *secmem_alloc(size_t size);
+
+/* Wipe a block and return it to the calling thread's free list */
+void secmem_free(void *ptr);
+
+/* Unmap every cached block in the shared list and the caller's list */
+void secmem_trim(void);
+
+/* Page backing for new mappings; cached blocks keep theirs */
+void secmem_set_pages(int mode);
+
+/* Parse "4k"/"off", "thp", "hugetlb"; returns -1 if unknown */
+int secmem_pages_from_name(const char *name);
+const char *secmem_pages_name(int mode);
+
+/* Snapshot of the pool counters */
+void secmem_get_stats(secmem_stats_t *stats);
+
+#endif /* SECMEM_H */
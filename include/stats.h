@@ -0,0 +1,123 @@
+/*
+ * stats.h - Per-phase timing instrumentation (--stats)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Phase counters are process-wide and updated atomically, so worker
+ * threads can record into them concurrently. When stats are disabled a
+ * timer costs one predictable branch.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Phases */
+#define STATS_OPEN    0   /* open(), fstat(), close() */
+#define STATS_READ    1   /* read() */
+#define STATS_KDF     2   /* PBKDF2 */
+#define STATS_CRYPTO  3   /* Cipher + MAC over segments */
+#define STATS_WRITE   4   /* write() */
+#define STATS_TOTAL   5   /* Whole operation */
+#define STATS_PHASE_COUNT 6
+
+/* Output formats */
+#define STATS_FORMAT_TEXT 0
+#define STATS_FORMAT_JSON 1
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;     /* Summed over threads, may exceed wall time */
+    uint64_t bytes;
+    uint64_t calls;      /* System calls (I/O phases) or invocations */
+} stats_phase_t;
+
+/* Start timestamps for one measured region */
+typedef struct {
+    uint64_t wall;
+    uint64_t cpu;
+} stats_timer_t;
+
+/* Non-zero when --stats is active; checked on the hot path */
+extern int stats_enabled;
+
+void stats_enable(void);
+void stats_reset(void);
+
+void stats_begin(stats_timer_t *timer);
+void stats_end(const stats_timer_t *timer, int phase, uint64_t bytes, uint64_t calls);
+
+/* Count calls without timing (e.g. a failed open()) */
+void stats_count(int phase, uint64_t calls);
+
+/* Snapshot of one phase */
+void stats_get(int phase, stats_phase_t *out);
+
+/* Print the per-phase table */
+void stats_print(FILE *out, int format);
+
+/*
+ * Live engine counters for the performance dashboard. Off by default;
+ * while off every hook is one predictable branch. While on, the stream
+ * pays a few relaxed atomic adds and two clock reads per segment.
+ * Workers of concurrent streams share slots by pool index.
+ */
+#define STATS_MAX_WORKERS 64
+
+/* Pipeline stages a segment passes through */
+#define STATS_STAGE_READ   0   /* Read, waiting for a worker */
+#define STATS_STAGE_CRYPTO 1   /* Being sealed/opened */
+#define STATS_STAGE_WRITE  2   /* Done, waiting to be written */
+#define STATS_STAGE_COUNT  3
+
+typedef struct {
+    uint64_t bytes;          /* Segment bytes sealed/opened */
+    uint64_t segments;
+    uint64_t busy_ns;        /* Wall time inside the cipher */
+} stats_worker_t;
+
+typedef struct {
+    int64_t stage[STATS_STAGE_COUNT];   /* Segments in each stage right now */
+    uint64_t read_ns;        /* Time blocked in the read stage (summed over
+                                workers under positional I/O) */
+    uint64_t write_ns;       /* Time blocked in the write stage */
+    int workers;             /* Highest pool size seen */
+    stats_worker_t worker[STATS_MAX_WORKERS];
+} stats_live_t;
+
+/* Non-zero while the dashboard wants counters; checked on the hot path */
+extern int stats_live_enabled;
+
+/* Call before any stream starts, so stage counts stay balanced */
+void stats_live_enable(void);
+
+/* Hooks for the stream engine */
+uint64_t stats_live_clock(void);              /* 0 when disabled */
+void stats_live_workers(int workers);
+void stats_live_stage(int from, int to, int64_t segments);   /* -1 = outside */
+void stats_live_segment(int worker, uint64_t bytes, uint64_t start);
+void stats_live_io(int write, uint64_t start);
+
+/* Relaxed snapshot; fields may be a few updates apart */
+void stats_live_get(stats_live_t *out);
+
+/* Point-in-time load reading for live displays (independent of --stats) */
+typedef struct {
+    uint64_t wall_ns;        /* CLOCK_MONOTONIC */
+    uint64_t cpu_ns;         /* This process, all threads */
+    uint64_t host_ticks;     /* /proc/stat: all CPU time, 0 if unavailable */
+    uint64_t iowait_ticks;   /* /proc/stat: idle waiting on I/O */
+} stats_load_t;
+
+void stats_load_sample(stats_load_t *sample);
+
+/* Between two samples: this process's CPU use as a percentage of all
+ * cores, and the share of host CPU time spent in I/O wait (-1 if the
+ * host counters are unavailable) */
+void stats_load_delta(const stats_load_t *before, const stats_load_t *after, int cpus,
+                      double *cpu_pct, double *iowait_pct);
+
+#endif /* STATS_H */
@@ -0,0 +1,233 @@
+/*
+ * stream.h - Segmented streaming encryption engine
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Files are processed in fixed-size segments (see encryption.h for the
+ * format), so memory use is bounded by the batch size instead of the file
+ * size, and independent segments are sealed in parallel on a thread pool.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+/* Segments queued per worker in each read/crypto/write batch */
+#define STREAM_DEFAULT_DEPTH 4
+
+/*
+ * Progress hook: plaintext bytes done out of total. Called on the thread
+ * running the stream, once before the first batch and after each batch
+ * is written, so it costs nothing per segment.
+ */
+typedef void (*stream_progress_fn)(void *arg, uint64_t done, uint64_t total);
+
+/* Ciphertext bytes a checkpoint fingerprints: the end of a sealed
+ * segment, which is its authentication tag */
+#define STREAM_TAG_LEN 16
+
+/*
+ * Checkpoint hook for resumable runs: segments [0, segments) are written
+ * and fsync'd at the output, and tag holds the last STREAM_TAG_LEN bytes
+ * of the last of them as sealed. Called between batches, and only before
+ * the final one, so a finished file never reports a checkpoint.
+ */
+typedef void (*stream_checkpoint_fn)(void *arg, uint64_t segments, const unsigned char *tag);
+
+/*
+ * Passphrase KEKs shared by many streams (batch mode), so the KDF runs
+ * once per distinct salt instead of once per file. Encrypting derives one
+ * KEK under a fresh salt on first use and wraps every file's data key
+ * with it; decrypting caches a KEK for each slot salt it meets. Safe to
+ * share across threads.
+ */
+typedef struct stream_keyring stream_keyring_t;
+
+typedef struct {
+    int algorithm;            /* ENC_ALG_* (encrypt only; decrypt reads the header) */
+    uint32_t segment_size;    /* 0 = ENC_DEFAULT_SEGMENT_SIZE */
+    uint32_t kdf_iterations;  /* 0 = ENC_DEFAULT_ITERATIONS */
+    int threads;              /* 0 = one per online CPU */
+    int depth;                /* 0 = STREAM_DEFAULT_DEPTH */
+    uint64_t max_memory;      /* Buffer budget in bytes, 0 = unlimited */
+    int key_slots;            /* Header key slots, 0 = one per passphrase */
+    const char *const *recipients;  /* Extra passphrases that also open the file */
+    int recipient_count;
+    stream_progress_fn progress;    /* NULL = no reports */
+    void *progress_arg;
+    const int *cancel;        /* Nonzero stops before the next batch
+                                 (ENC_ERR_CANCELLED); read atomically */
+    stream_keyring_t *keyring;  /* Cached KEKs for the passphrase, NULL = derive
+                                   per file (recipients always derive) */
+    stream_checkpoint_fn checkpoint;  /* NULL = none */
+    void *checkpoint_arg;
+    uint64_t checkpoint_bytes;  /* Plaintext between checkpoints, 0 = every batch */
+    int durability;           /* FIO_SYNC_* for the file wrappers' output */
+    int sequential_io;        /* Nonzero = one reader and one writer even when both
+                                 files allow positional I/O */
+    int dense;                /* Nonzero = encrypt holes as zeros instead of
+                                 recording them (hides where they are) */
+    const char *temp_id;      /* fio_temp_id() for the file wrappers' temporary
+                                 file, NULL = a fresh one; a caller that may
+                                 resume must pick and keep it */
+} stream_opts_t;
+
+/* Batch shape actually used for one run */
+typedef struct {
+    uint32_t segment_size;
+    int threads;
+    int depth;
+    uint64_t buffer_bytes;    /* Tracked bytes the batch buffers will take */
+} stream_plan_t;
+
+typedef struct {
+    int algorithm;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t segments_updated;  /* stream_update_file only */
+    int io_error;             /* FIO_* code when ENC_ERR_IO is returned */
+    const char *io_path;      /* File that caused io_error */
+} stream_result_t;
+
+/* Fill opts with defaults (AES-256-GCM, 1 MiB segments, all CPUs) */
+void stream_opts_init(stream_opts_t *opts);
+
+/* Keyring for passphrase; iterations (0 = default) apply to new KEKs.
+ * Returns NULL on allocation failure. */
+stream_keyring_t *stream_keyring_create(const char *passphrase, uint32_t iterations);
+
+/*
+ * Salt and iterations of the KEK new files are wrapped with, deriving it
+ * now if it does not exist yet. A resumable batch journals them and hands
+ * them to stream_keyring_use_salt() on resume, so files from both runs
+ * still share one KEK.
+ */
+int stream_keyring_salt(stream_keyring_t *ring, unsigned char *salt, uint32_t *iterations);
+int stream_keyring_use_salt(stream_keyring_t *ring, const unsigned char *salt,
+                            uint32_t iterations);
+
+/* KDF runs so far */
+uint64_t stream_keyring_kdf_calls(stream_keyring_t *ring);
+
+/* Wipe and free; accepts NULL */
+void stream_keyring_destroy(stream_keyring_t *ring);
+
+/*
+ * Fit the batch to opts->max_memory. Without a budget this just resolves
+ * the defaults. With one, depth is reduced first, then the segment size
+ * (down to 64 KiB), then the thread count, then the segment size again
+ * (down to ENC_MIN_SEGMENT_SIZE). An explicit opts->segment_size is kept.
+ * segment_size != 0 pins it (decrypt reads it from the header).
+ *
+ * @return: ENC_SUCCESS, or ENC_ERR_BUDGET if even the smallest batch
+ *          does not fit
+ */
+int stream_plan(const stream_opts_t *opts, int decrypt, int algorithm, uint32_t segment_size,
+                uint64_t plaintext_len, stream_plan_t *plan);
+
+/*
+ * Encrypt/decrypt between two open descriptors.
+ * in_size is the number of input bytes to consume.
+ *
+ * When both descriptors allow positional I/O (fio_positional()), every
+ * worker pread()s its own input segment and pwrite()s its own output
+ * segment at the fixed offsets the format gives it, so a batch keeps as
+ * many requests in flight as there are workers. Otherwise one thread
+ * read()s the batch in order and one write()s it. The descriptors'
+ * offsets are not advanced past the segments in positional mode.
+ *
+ * Sparse input: when both descriptors allow positional I/O and
+ * opts->dense is 0, segments lying wholly in holes of in_fd (SEEK_DATA /
+ * SEEK_HOLE) are neither read nor sealed. They are marked ENC_GEN_HOLE in
+ * a segment index and left as holes in the output. Decrypting skips them
+ * and leaves holes in turn. Both outputs should be empty past their
+ * offsets, since skipped ranges are never written.
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code
+ */
+int stream_encrypt_fd(int in_fd, uint64_t in_size, int out_fd, const char *passphrase,
+                      const stream_opts_t *opts, stream_result_t *result);
+int stream_decrypt_fd(int in_fd, uint64_t in_size, int out_fd, const char *passphrase,
+                      const stream_opts_t *opts, stream_result_t *result);
+
+/*
+ * File-path wrappers. The output is written to a new OUTPUT FIO_TEMP_SUFFIX
+ * ID (created exclusively, see opts->temp_id) and renamed over OUTPUT
+ * only on success (fsync'd per opts->durability),
+ * so a failed, cancelled or wrong-key run removes the temporary file and
+ * leaves an existing OUTPUT as it was.
+ */
+int stream_encrypt_file(const char *input, const char *output, const char *passphrase,
+                        const stream_opts_t *opts, stream_result_t *result);
+int stream_decrypt_file(const char *input, const char *output, const char *passphrase,
+                        const stream_opts_t *opts, stream_result_t *result);
+
+/*
+ * Continue an interrupted stream_*_file() from its last checkpoint: the
+ * temporary file next to output named by opts->temp_id (required) holds
+ * `segments` finished segments and tag is what the checkpoint reported. The header and key come from the ciphertext (the
+ * output when encrypting, the input when decrypting) and the tag is
+ * checked against it; then the temporary file is cut back to the
+ * checkpoint, only the remaining segments are read, sealed or opened, and
+ * written, and it is committed like the wrappers above.
+ *
+ * Failures before the temporary file is cut leave it alone; later ones
+ * remove it.
+ *
+ * @return: ENC_SUCCESS, ENC_ERR_INVALID_FORMAT if the files no longer
+ *          match the checkpoint, or an ENC_* error code
+ */
+int stream_resume_file(const char *input, const char *output, const char *passphrase,
+                       int decrypt, uint64_t segments, const unsigned char *tag,
+                       const stream_opts_t *opts, stream_result_t *result);
+
+/*
+ * Replace the passphrase on an encrypted file in place. Only the key
+ * slot that old_passphrase opens is rewritten (new salt, iterations 0 =
+ * default); the data key and every segment stay as they are, so the cost
+ * is two KDFs and one small write. v1/v2 files return
+ * ENC_ERR_INVALID_FORMAT: their key comes straight from the passphrase.
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code
+ */
+int stream_rekey_file(const char *path, const char *old_passphrase, const char *new_passphrase,
+                      uint32_t iterations, stream_result_t *result);
+
+/*
+ * Add or remove a recipient in place. passphrase must open the file; add
+ * wraps the data key for new_passphrase into an empty slot (reserve them
+ * with key_slots at encrypt time), remove empties the slot passphrase
+ * opens. Like rekey, only the header is rewritten.
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code (ENC_ERR_NO_SLOT,
+ *          ENC_ERR_LAST_SLOT)
+ */
+int stream_add_key_file(const char *path, const char *passphrase, const char *new_passphrase,
+                        uint32_t iterations, stream_result_t *result);
+int stream_remove_key_file(const char *path, const char *passphrase, stream_result_t *result);
+
+/*
+ * Bring the encrypted file at path up to date with the plaintext in
+ * input, which must be the same length (plaintext_len is bound into every
+ * segment). Every segment is authenticated and compared first; only the
+ * changed ones are resealed at their next generation (fresh nonce) and
+ * written in place, then the segment index is rewritten and fsync'd. Cost
+ * is one KDF, a read of both files and a write of the changed segments.
+ *
+ * The old bytes of the changed segments and the old index are journalled
+ * to PATH STREAM_UPDATE_JOURNAL_SUFFIX and fsync'd before anything is
+ * overwritten. If the update fails or the machine crashes part way, the
+ * next update or decrypt of path puts them back first, so the file
+ * always opens as the old version or the new one.
+ *
+ * @return: ENC_SUCCESS, ENC_ERR_INVALID_ARG if the lengths differ, or an
+ *          ENC_* error code
+ */
+#define STREAM_UPDATE_JOURNAL_SUFFIX ".fenc-update"
+
+int stream_update_file(const char *path, const char *input, const char *passphrase,
+                       const stream_opts_t *opts, stream_result_t *result);
+
+#endif /* STREAM_H */
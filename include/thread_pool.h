@@ -0,0 +1,46 @@
+/*
+ * thread_pool.h - Fixed-size POSIX thread pool for data-parallel loops
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/* Task body: called once per index; worker is 0..tp_size()-1 */
+typedef void (*tp_task_fn)(void *arg, size_t index, int worker);
+
+typedef struct thread_pool thread_pool_t;
+
+/* Number of online CPUs (at least 1) */
+int tp_default_threads(void);
+
+/* Create a pool of `threads` workers; the calling thread counts as worker 0,
+ * so threads - 1 pthreads are started. threads <= 0 selects the CPU count.
+ * Returns NULL on failure. */
+thread_pool_t *tp_create(int threads);
+
+/* Like tp_create(), but take an idle pool of the same size that an earlier
+ * run handed back with tp_release(). Its threads, and what they keep per
+ * thread (the cipher contexts in encryption.c), then outlive a single run.
+ * Returns NULL on failure. */
+thread_pool_t *tp_acquire(int threads);
+
+/* Park a pool from tp_acquire() for the next run, or destroy it if enough
+ * are parked already. Accepts NULL. */
+void tp_release(thread_pool_t *pool);
+
+/* Number of workers, including the caller */
+int tp_size(const thread_pool_t *pool);
+
+/* Run fn(arg, i, worker) for every i in [0, count) and wait for completion.
+ * Indices are handed out dynamically, so uneven tasks balance themselves. */
+void tp_parallel_for(thread_pool_t *pool, size_t count, tp_task_fn fn, void *arg);
+
+/* Stop and join all workers */
+void tp_destroy(thread_pool_t *pool);
+
+#endif /* THREAD_POOL_H */
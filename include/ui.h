@@ -9,6 +9,9 @@
 #define UI_H
 
 #include <ncurses.h>
+#include <stdint.h>
+
+#include "stats.h"
 
 /* Color pairs */
 #define COLOR_HEADER    1   /* Cyan on black */
@@ -20,6 +23,9 @@
 #define COLOR_ACCENT    7   /* Magenta on black */
 #define COLOR_INPUT     8   /* White on blue */
 
+/* Live progress redraws per second, at most */
+#define UI_PROGRESS_HZ 15
+
 /* Menu item structure */
 typedef struct {
     const char *label;
@@ -49,6 +55,54 @@ int ui_get_int(const char *prompt);
  * progress: 0.0 to 1.0 */
 void ui_progress_bar(const char *label, float progress);
 
+/* Live byte progress for one operation */
+typedef struct {
+    const char *label;
+    uint64_t start_ns;       /* CLOCK_MONOTONIC at ui_progress_start() */
+    uint64_t last_draw_ns;   /* 0 = not drawn yet */
+} ui_progress_t;
+
+/* Start timing an operation and draw an empty bar */
+void ui_progress_start(ui_progress_t *progress, const char *label);
+
+/* Report done of total bytes. Redraws the bar with percentage, MB/s and
+ * ETA at most UI_PROGRESS_HZ times a second (always when done == total),
+ * so it is cheap to call as often as the engine likes. */
+void ui_progress_update(ui_progress_t *progress, uint64_t done, uint64_t total);
+
+/* One row of the job queue screen */
+typedef struct {
+    const char *operation;   /* "Encrypt" / "Decrypt" */
+    const char *input;
+    const char *status;      /* "queued", "running", "done", error text */
+    uint64_t done;
+    uint64_t total;
+    double rate;             /* Bytes per second */
+} ui_job_row_t;
+
+/* Aggregate line under the queue */
+typedef struct {
+    int running;
+    int queued;
+    int cpus;
+    double rate;             /* Bytes per second, all jobs */
+    double cpu_pct;          /* Process CPU as a share of all cores */
+    double iowait_pct;       /* Host I/O wait share, < 0 if unknown */
+} ui_job_totals_t;
+
+/* Redraw the whole job queue screen; selected < 0 highlights nothing */
+void ui_show_jobs(const ui_job_row_t *rows, int count, int selected,
+                  const ui_job_totals_t *totals, const char *note);
+
+/*
+ * Performance dashboard: per-worker throughput and busy time, segments
+ * in each pipeline stage, read/write wait, and memory high-water marks.
+ * Rates are the difference between two stats_live_get() snapshots taken
+ * interval_s apart; totals supplies the CPU and host I/O wait line.
+ */
+void ui_show_dashboard(const stats_live_t *before, const stats_live_t *after, double interval_s,
+                       const ui_job_totals_t *totals);
+
 /* Display a message with color */
 void ui_message(const char *msg, int color_pair);
 
@@ -61,6 +115,9 @@ void ui_error(const char *msg);
 /* Wait for key press */
 void ui_wait_key(const char *prompt);
 
+/* Wait up to timeout_ms for a key; returns it, or ERR if none came */
+int ui_poll_key(int timeout_ms);
+
 /* Clear screen and redraw header */
 void ui_clear_content(void);
 
@@ -0,0 +1,57 @@
+/*
+ * vault.h - Directory-wide passphrase rotation (encrypt_tool --rekey DIR)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Every .enc file under a directory has its key slot rewrapped in place,
+ * header only, on a thread pool. All rewrapped slots share one new salt,
+ * so the new passphrase costs a single KDF, and old KEKs are cached by
+ * salt: a vault rotated this way before needs one KDF for the old
+ * passphrase too. A journal in the directory makes the run crash-safe.
+ */
+
+#ifndef VAULT_H
+#define VAULT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Journal kept in the vault directory while a rotation is in progress */
+#define VAULT_JOURNAL_NAME ".fenc-rekey.journal"
+
+/* Files whose headers are read, journalled and written together */
+#define VAULT_BATCH 128
+
+typedef struct {
+    int threads;               /* Worker threads, 0 = one per CPU */
+    uint32_t iterations;       /* PBKDF2 iterations for the new slots, 0 = default */
+    int resume;                /* Continue an interrupted rotation from its journal */
+} vault_opts_t;
+
+typedef struct {
+    uint64_t files;            /* .enc files found */
+    uint64_t rewrapped;        /* Headers rewritten this run */
+    uint64_t current;          /* Already under the new passphrase (resume) */
+    uint64_t restored;         /* Torn headers put back from the journal */
+    uint64_t failed;           /* Unreadable, not FENC v3, or wrong passphrase */
+    uint64_t kdf_calls;        /* PBKDF2 runs, old and new passphrases together */
+    uint64_t bytes_written;    /* Header bytes written */
+} vault_result_t;
+
+void vault_opts_init(vault_opts_t *opts);
+
+/*
+ * Rotate every .enc file under dir from old_passphrase to new_passphrase.
+ * Per-file failures are reported on log and counted, not fatal.
+ *
+ * Refuses to start while a journal exists unless opts->resume is set.
+ * The journal is removed once every file is done.
+ *
+ * @return: ENC_SUCCESS if no file failed, ENC_ERR_DECRYPT if some did,
+ *          or another ENC_* code if the run could not start
+ */
+int vault_rekey(const char *dir, const char *old_passphrase, const char *new_passphrase,
+                const vault_opts_t *opts, vault_result_t *result, FILE *log);
+
+#endif /* VAULT_H */
@@ -0,0 +1,51 @@
+/*
+ * wipe.h - Multi-pass secure delete (encrypt_tool --wipe)
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Passes follow CipherVault's secure_delete_service: random, complement,
+ * random. Patterns come from an AES-256-CTR keystream under a fresh key
+ * per pass, written through one fixed buffer with one fsync() per pass,
+ * so memory does not grow with the file. The complement pass regenerates
+ * pass 1's keystream and flips every bit of it.
+ *
+ * On flash, overwrites may land on new cells, so the file's blocks are
+ * also discarded when the filesystem supports it.
+ */
+
+#ifndef WIPE_H
+#define WIPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WIPE_DEFAULT_PASSES 3
+#define WIPE_MAX_PASSES 35
+#define WIPE_BUFFER (1024 * 1024)
+
+typedef struct {
+    int passes;                /* 0 = WIPE_DEFAULT_PASSES */
+    int discard;               /* Discard blocks after the last pass */
+    int keep;                  /* Overwrite only; do not unlink */
+} wipe_opts_t;
+
+typedef struct {
+    uint64_t bytes;            /* File size */
+    uint64_t bytes_written;    /* Across all passes */
+    int passes;
+    int discarded;             /* 1 if the blocks were discarded */
+    int io_error;              /* FIO_* code when ENC_ERR_IO is returned */
+} wipe_result_t;
+
+void wipe_opts_init(wipe_opts_t *opts);
+
+/*
+ * Overwrite path in place opts->passes times, discard its blocks, then
+ * unlink it. Anything but a regular file is refused (FIO_ERR_OPEN).
+ *
+ * @return: ENC_SUCCESS or an ENC_* error code
+ */
+int wipe_file(const char *path, const wipe_opts_t *opts, wipe_result_t *result);
+
+#endif /* WIPE_H */
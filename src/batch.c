@@ -0,0 +1,716 @@
+/*
+ * batch.c - Many files per process
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * read manifest  ->  one keyring for the passphrase  ->  files on the pool,
+ * one stream per worker  ->  per-file lines and totals
+ *
+ * A manifest read from a file gets a journal beside it (MANIFEST.journal):
+ *   "S i size mtime id"  file i started from scratch into the temporary
+ *                        file with fio_temp_id() id
+ *   "C i segments tag"   its first segments are fsync'd at the output
+ *   "D i"                its output is complete and durable (never under
+ *                        FIO_SYNC_NONE, see batch.h)
+ * Records are appended without fsync: the data they describe is synced
+ * first, so a lost record only costs redoing that work. --resume skips
+ * "D" files and continues "C" files whose input is unchanged; a file it
+ * starts over loses the old run's temporary file first.
+ *
+ * FIO_SYNC_GROUP: finished files wait in a group until one syncfs() per
+ * filesystem makes them all durable, then their "D" records go out.
+ *
+ * Demonstrates OS concepts:
+ * - Amortizing process start-up and key derivation over many files
+ * - Task parallelism across files with POSIX threads
+ * - Crash recovery with an append-only journal and ordered fsync()
+ */
+
+#include "../include/batch.h"
+#include "../include/encryption.h"
+#include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/thread_pool.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Initial manifest buffer; doubled as needed */
+#define MANIFEST_CHUNK (64 * 1024)
+
+#define JOURNAL_MAGIC "FENC-BATCH 2"
+#define JOURNAL_SUFFIX ".journal"
+
+/* Plaintext a large file moves between checkpoints */
+#define BATCH_CHECKPOINT_BYTES (64ULL * 1024 * 1024)
+
+typedef struct {
+    const char *input;
+    const char *output;
+} pair_t;
+
+/* A finished file waiting for its group's sync */
+typedef struct {
+    size_t index;
+    dev_t dev;                 /* Filesystem holding the output */
+} member_t;
+
+/* What an interrupted run journalled about one file */
+typedef struct {
+    int started;               /* "S" seen: size, mtime and temp_id are valid */
+    int done;
+    uint64_t size;
+    uint64_t mtime_ns;
+    char temp_id[FIO_TEMP_ID_LEN + 1];
+    uint64_t segments;         /* Last checkpoint, 0 = none */
+    unsigned char tag[STREAM_TAG_LEN];
+} progress_t;
+
+typedef struct {
+    const pair_t *pairs;
+    const char *passphrase;
+    int decrypt;
+    stream_opts_t opts;        /* Shared keyring, one thread per file */
+    int journal_fd;            /* -1 = not resumable (stdin manifest) */
+    progress_t *progress;      /* Per file from the journal, NULL = fresh run */
+    batch_result_t *result;
+    int first_error;           /* ENC_* of the first file to fail, 0 = none yet */
+    FILE *log;
+
+    /* FIO_SYNC_GROUP */
+    pthread_mutex_t group_lock;  /* Held across a flush: members wait for it */
+    member_t *group;
+    size_t group_count;
+    uint32_t group_files;
+    uint64_t group_ns;
+    uint64_t group_start;      /* now_ns() of the last flush */
+} batch_t;
+
+/* Checkpoint hook argument for one file */
+typedef struct {
+    const batch_t *b;
+    size_t index;
+} checkpoint_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Whole manifest into a NUL-terminated tracked buffer */
+static int read_manifest(const char *path, char **text, size_t *len) {
+    const int fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    size_t cap = MANIFEST_CHUNK;
+    size_t used = 0;
+    char *buf;
+
+    if (fd == -1) {
+        return ENC_ERR_IO;
+    }
+    buf = (char *)mem_alloc(cap + 1);
+
+    while (buf) {
+        size_t got = 0;
+
+        if (used == cap) {
+            char *grown = (char *)mem_alloc(cap * 2 + 1);
+            if (grown) {
+                memcpy(grown, buf, used);
+            }
+            mem_free(buf);
+            buf = grown;
+            cap *= 2;
+            continue;
+        }
+        if (fio_read_full(fd, (unsigned char *)buf + used, cap - used, &got) != FIO_SUCCESS) {
+            mem_free(buf);
+            buf = NULL;
+            break;
+        }
+        used += got;
+        if (used < cap) {
+            break;   /* EOF */
+        }
+    }
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (!buf) {
+        return ENC_ERR_IO;
+    }
+    buf[used] = '\0';
+    *text = buf;
+    *len = used;
+    return ENC_SUCCESS;
+}
+
+/*
+ * Split text in place into pairs. Fields point into text.
+ * bad_line receives the 1-based line (or field pair) that failed.
+ */
+static int parse_manifest(char *text, size_t len, pair_t **pairs, size_t *count,
+                          uint64_t *bad_line) {
+    const int nul_separated = memchr(text, '\0', len) != NULL;
+    size_t cap = 64;
+    size_t n = 0;
+    uint64_t line = 0;
+    char *p = text;
+    char *end = text + len;
+    pair_t *list = (pair_t *)mem_alloc(cap * sizeof(*list));
+
+    if (!list) {
+        return ENC_ERR_MEMORY;
+    }
+
+    while (p < end) {
+        char *input;
+        char *output;
+
+        line++;
+        if (nul_separated) {
+            input = p;
+            p += strlen(p) + 1;
+            if (p >= end) {
+                output = NULL;   /* Odd field count */
+            } else {
+                output = p;
+                p += strlen(p) + 1;
+            }
+        } else {
+            char *eol = memchr(p, '\n', (size_t)(end - p));
+            char *tab;
+
+            if (!eol) {
+                eol = end;
+            }
+            *eol = '\0';
+            if (eol > p && eol[-1] == '\r') {
+                eol[-1] = '\0';
+            }
+            input = p;
+            p = eol + 1;
+            if (input[0] == '\0' || input[0] == '#') {
+                continue;
+            }
+            tab = strchr(input, '\t');
+            output = tab ? tab + 1 : NULL;
+            if (tab) {
+                *tab = '\0';
+            }
+        }
+
+        if (!output || input[0] == '\0' || output[0] == '\0') {
+            mem_free(list);
+            *bad_line = line;
+            return ENC_ERR_INVALID_FORMAT;
+        }
+        if (n == cap) {
+            pair_t *grown = (pair_t *)mem_alloc(cap * 2 * sizeof(*grown));
+            if (!grown) {
+                mem_free(list);
+                return ENC_ERR_MEMORY;
+            }
+            memcpy(grown, list, n * sizeof(*list));
+            mem_free(list);
+            list = grown;
+            cap *= 2;
+        }
+        list[n].input = input;
+        list[n].output = output;
+        n++;
+    }
+
+    *pairs = list;
+    *count = n;
+    return ENC_SUCCESS;
+}
+
+/* ── Journal ─────────────────────────────────────────────────────── */
+
+static void hex_encode(const unsigned char *in, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+    out[2 * len] = '\0';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* Decode exactly len bytes; returns 0 or -1 */
+static int hex_decode(const char *in, unsigned char *out, size_t len) {
+    if (strlen(in) != 2 * len) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        const int hi = hex_value(in[2 * i]);
+        const int lo = hex_value(in[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        out[i] = (unsigned char)(hi << 4 | lo);
+    }
+    return 0;
+}
+
+/* FNV-1a of the manifest: a journal only resumes the batch it was made for */
+static uint64_t manifest_hash(const char *text, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)text[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t mtime_ns(const struct stat *st) {
+#ifdef __APPLE__
+    return (uint64_t)st->st_mtimespec.tv_sec * 1000000000ULL + (uint64_t)st->st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + (uint64_t)st->st_mtim.tv_nsec;
+#endif
+}
+
+/* One record per write(): O_APPEND keeps concurrent lines whole */
+static int journal_append(int fd, const char *text, size_t len, int sync) {
+    if (fio_write_full(fd, (const unsigned char *)text, len) != FIO_SUCCESS ||
+        (sync && fio_sync(fd) != FIO_SUCCESS)) {
+        return ENC_ERR_IO;
+    }
+    return ENC_SUCCESS;
+}
+
+/*
+ * Parse a journal written for this manifest and mode: the encrypt KEK's
+ * salt and iterations from its first line, then the latest state of each
+ * file. A torn last record is ignored.
+ */
+static int journal_load(const char *path, int decrypt, uint64_t hash, size_t count,
+                        progress_t *progress, unsigned char *salt, uint32_t *iterations) {
+    unsigned char *buf = NULL;
+    size_t size = 0;
+    int rc = ENC_ERR_INVALID_FORMAT;
+
+    if (read_file(path, &buf, &size) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+
+    char *text = (char *)buf;
+    char *end = text + size;
+    int line_no = 0;
+
+    while (text < end) {
+        char *nl = memchr(text, '\n', (size_t)(end - text));
+        unsigned long long index = 0;
+        unsigned long long a = 0;
+        unsigned long long b = 0;
+        char hex[2 * STREAM_TAG_LEN + 2];
+        char id[32];
+        char mode = 0;
+
+        if (!nl) {
+            break;
+        }
+        *nl = '\0';
+
+        if (line_no++ == 0) {
+            if (strncmp(text, JOURNAL_MAGIC " ", sizeof(JOURNAL_MAGIC)) != 0 ||
+                sscanf(text + sizeof(JOURNAL_MAGIC), "%c %llx %llu %33s", &mode, &a, &b, hex) != 4 ||
+                mode != (decrypt ? 'd' : 'e') || a != hash ||
+                (!decrypt && hex_decode(hex, salt, ENC_SALT_LEN) != 0)) {
+                goto done;
+            }
+            *iterations = (uint32_t)b;
+        } else if (sscanf(text, "S %llu %llu %llu %31s", &index, &a, &b, id) == 4 &&
+                   index < count && strlen(id) == FIO_TEMP_ID_LEN &&
+                   strspn(id, "0123456789abcdefghijklmnopqrstuvwxyz") == FIO_TEMP_ID_LEN) {
+            memset(&progress[index], 0, sizeof(progress[index]));
+            progress[index].started = 1;
+            progress[index].size = a;
+            progress[index].mtime_ns = b;
+            memcpy(progress[index].temp_id, id, FIO_TEMP_ID_LEN + 1);
+        } else if (sscanf(text, "C %llu %llu %33s", &index, &a, hex) == 3 && index < count) {
+            if (progress[index].started && hex_decode(hex, progress[index].tag, STREAM_TAG_LEN) == 0) {
+                progress[index].segments = a;
+            }
+        } else if (sscanf(text, "D %llu", &index) == 1 && index < count) {
+            progress[index].done = 1;
+        } else {
+            goto done;
+        }
+        text = nl + 1;
+    }
+
+    rc = line_no > 0 ? ENC_SUCCESS : ENC_ERR_INVALID_FORMAT;
+
+done:
+    mem_free(buf);
+    return rc;
+}
+
+/* Runs on the worker after the stream has fsync'd the segments */
+static void checkpoint_hook(void *arg, uint64_t segments, const unsigned char *tag) {
+    const checkpoint_t *c = (const checkpoint_t *)arg;
+    char hex[2 * STREAM_TAG_LEN + 1];
+    char line[96];
+
+    hex_encode(tag, STREAM_TAG_LEN, hex);
+    const int len = snprintf(line, sizeof(line), "C %zu %llu %s\n", c->index,
+                             (unsigned long long)segments, hex);
+    journal_append(c->b->journal_fd, line, (size_t)len, 0);   /* Lost = redo from scratch */
+}
+
+static void journal_done(const batch_t *b, size_t i) {
+    char line[32];
+    const int len = snprintf(line, sizeof(line), "D %zu\n", i);
+
+    if (b->journal_fd >= 0) {
+        journal_append(b->journal_fd, line, (size_t)len, 0);   /* Lost = redo the file */
+    }
+}
+
+/* ── Group sync ──────────────────────────────────────────────────── */
+
+/*
+ * One syncfs() per filesystem the group's outputs live on makes every one
+ * of them durable, renames included. Called with group_lock held.
+ */
+static void group_flush(batch_t *b) {
+    int ok = 1;
+
+    for (size_t k = 0; k < b->group_count; k++) {
+        const member_t *m = &b->group[k];
+        uint64_t size = 0;
+        int seen = 0;
+        int fd = -1;
+
+        for (size_t j = 0; j < k && !seen; j++) {
+            seen = b->group[j].dev == m->dev;
+        }
+        if (seen) {
+            continue;
+        }
+        if (fio_open_input(b->pairs[m->index].output, &fd, &size) != FIO_SUCCESS ||
+            fio_syncfs(fd) != FIO_SUCCESS) {
+            ok = 0;
+        }
+        if (fd >= 0) fio_close(fd);
+        b->result->syncs++;
+    }
+
+    for (size_t k = 0; k < b->group_count; k++) {
+        const size_t i = b->group[k].index;
+
+        if (ok) {
+            journal_done(b, i);
+        } else {
+            __atomic_fetch_sub(&b->result->succeeded, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&b->result->failed, 1, __ATOMIC_RELAXED);
+            if (b->log) fprintf(b->log, "FAIL  %s: cannot sync output\n", b->pairs[i].output);
+        }
+    }
+    b->group_count = 0;
+    b->group_start = now_ns();
+}
+
+static void group_add(batch_t *b, size_t i) {
+    struct stat st;
+
+    pthread_mutex_lock(&b->group_lock);
+    b->group[b->group_count].index = i;
+    b->group[b->group_count].dev = stat(b->pairs[i].output, &st) == 0 ? st.st_dev : 0;
+    b->group_count++;
+    if (b->group_count >= b->group_files || now_ns() - b->group_start >= b->group_ns) {
+        group_flush(b);
+    }
+    pthread_mutex_unlock(&b->group_lock);
+}
+
+/* ── Per-file work ───────────────────────────────────────────────── */
+
+static void file_task(void *arg, size_t i, int worker) {
+    batch_t *b = (batch_t *)arg;
+    const pair_t *pair = &b->pairs[i];
+    const progress_t *p = b->progress ? &b->progress[i] : NULL;
+    checkpoint_t ckpt = {b, i};
+    stream_opts_t opts = b->opts;
+    stream_result_t res;
+    struct stat st;
+    const uint64_t start = now_ns();
+    const char *error = NULL;
+    int resumed = 0;
+    int rc = ENC_ERR_INVALID_FORMAT;
+    (void)worker;
+
+    if (p && p->done) {
+        __atomic_fetch_add(&b->result->succeeded, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->result->skipped, 1, __ATOMIC_RELAXED);
+        if (b->log) {
+            fprintf(b->log, "SKIP  %s -> %s (done by an earlier run)\n", pair->input,
+                    pair->output);
+        }
+        return;
+    }
+
+    const int have_stat = stat(pair->input, &st) == 0;
+    if (b->journal_fd >= 0) {
+        opts.checkpoint = checkpoint_hook;
+        opts.checkpoint_arg = &ckpt;
+        opts.checkpoint_bytes = BATCH_CHECKPOINT_BYTES;
+    }
+
+    /* Continue from the checkpoint if the input is the one it was made from;
+     * anything else starts the file over */
+    if (p && p->segments && have_stat && p->size == (uint64_t)st.st_size &&
+        p->mtime_ns == mtime_ns(&st)) {
+        opts.temp_id = p->temp_id;
+        rc = stream_resume_file(pair->input, pair->output, b->passphrase, b->decrypt,
+                                p->segments, p->tag, &opts, &res);
+        resumed = rc == ENC_SUCCESS;
+    }
+    if (!resumed) {
+        char id[FIO_TEMP_ID_LEN + 1];
+        char tmp[4096];
+
+        /* The old run's temporary file would otherwise be orphaned */
+        if (p && p->started &&
+            fio_temp_path(pair->output, p->temp_id, tmp, sizeof(tmp)) == FIO_SUCCESS) {
+            unlink(tmp);
+        }
+        opts.temp_id = NULL;
+        if (b->journal_fd >= 0 && have_stat) {
+            char line[96];
+
+            if (fio_temp_id(id) != FIO_SUCCESS) {
+                rc = ENC_ERR_IO;
+                error = "cannot pick a temporary file name";
+            } else {
+                const int len = snprintf(line, sizeof(line), "S %zu %llu %llu %s\n", i,
+                                         (unsigned long long)st.st_size,
+                                         (unsigned long long)mtime_ns(&st), id);
+                rc = journal_append(b->journal_fd, line, (size_t)len, 0);
+                if (rc != ENC_SUCCESS) {
+                    error = "cannot write journal";
+                }
+                opts.temp_id = id;
+            }
+        }
+        if (!error) {
+            rc = b->decrypt
+                ? stream_decrypt_file(pair->input, pair->output, b->passphrase, &opts, &res)
+                : stream_encrypt_file(pair->input, pair->output, b->passphrase, &opts, &res);
+        }
+    }
+
+    const double secs = (double)(now_ns() - start) / 1e9;
+
+    if (rc == ENC_SUCCESS) {
+        __atomic_fetch_add(&b->result->succeeded, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->result->resumed, (uint64_t)resumed, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->result->bytes_in, res.bytes_in, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->result->bytes_out, res.bytes_out, __ATOMIC_RELAXED);
+        /* One fprintf per line: stdio locks the stream, so lines never interleave */
+        if (b->log) {
+            fprintf(b->log, "OK    %s -> %s (%llu bytes, %.1f MB/s%s)\n", pair->input,
+                    pair->output, (unsigned long long)res.bytes_in,
+                    secs > 0.0 ? (double)res.bytes_in / 1e6 / secs : 0.0,
+                    resumed ? ", resumed" : "");
+        }
+        /* "D" only once the output would survive a crash; under NONE it
+         * never does, so a resumed batch redoes the file */
+        if (b->opts.durability == FIO_SYNC_GROUP) {
+            group_add(b, i);
+        } else if (b->opts.durability == FIO_SYNC_FILE) {
+            journal_done(b, i);   /* fio_commit() synced it */
+        }
+    } else {
+        int none = ENC_SUCCESS;
+        __atomic_compare_exchange_n(&b->first_error, &none, rc, 0, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->result->failed, 1, __ATOMIC_RELAXED);
+        if (b->log && error) {
+            fprintf(b->log, "FAIL  %s: %s\n", pair->input, error);
+        } else if (b->log) {
+            fprintf(b->log, "FAIL  %s: %s\n", (rc == ENC_ERR_IO && res.io_path) ? res.io_path
+                                                                                : pair->input,
+                    rc == ENC_ERR_IO ? fio_strerror(res.io_error) : enc_strerror(rc));
+        }
+    }
+}
+
+/* Open (resume) or create the journal beside manifest; fills b->journal_fd
+ * and b->progress and points the keyring at the journalled salt */
+static int journal_open(batch_t *b, const char *journal, int resume, uint64_t hash,
+                        size_t count, FILE *log) {
+    unsigned char salt[ENC_SALT_LEN];
+    uint32_t iterations = 0;
+    struct stat st;
+    int rc = ENC_SUCCESS;
+
+    /* An empty journal never got past its first write, so start over */
+    const int resuming = stat(journal, &st) == 0 && st.st_size > 0;
+
+    if (resuming) {
+        progress_t *progress;
+
+        if (!resume) {
+            if (log) fprintf(log, "Batch already in progress (%s); rerun with --resume\n",
+                             journal);
+            return ENC_ERR_INVALID_ARG;
+        }
+        progress = (progress_t *)mem_calloc(count ? count : 1, sizeof(*progress));
+        if (!progress) {
+            return ENC_ERR_MEMORY;
+        }
+        b->progress = progress;
+        rc = journal_load(journal, b->decrypt, hash, count, progress, salt, &iterations);
+        if (rc == ENC_ERR_INVALID_FORMAT) {
+            if (log) fprintf(log, "%s does not belong to this manifest and mode\n", journal);
+            return ENC_ERR_INVALID_ARG;
+        }
+        if (rc == ENC_SUCCESS && !b->decrypt) {
+            rc = stream_keyring_use_salt(b->opts.keyring, salt, iterations);
+        }
+    } else if (!b->decrypt) {
+        rc = stream_keyring_salt(b->opts.keyring, salt, &iterations);
+    }
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    if (fio_open_append(journal, &b->journal_fd) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+    if (!resuming) {
+        char line[sizeof(JOURNAL_MAGIC) + 48 + 2 * ENC_SALT_LEN];
+        char salt_hex[2 * ENC_SALT_LEN + 1];
+
+        if (b->decrypt) {
+            strcpy(salt_hex, "-");
+        } else {
+            hex_encode(salt, ENC_SALT_LEN, salt_hex);
+        }
+        const int len = snprintf(line, sizeof(line), "%s %c %016llx %u %s\n", JOURNAL_MAGIC,
+                                 b->decrypt ? 'd' : 'e', (unsigned long long)hash, iterations,
+                                 salt_hex);
+        rc = journal_append(b->journal_fd, line, (size_t)len, 1);
+    }
+    return rc;
+}
+
+void batch_opts_init(batch_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->group_files = BATCH_GROUP_FILES;
+    opts->group_ms = BATCH_GROUP_MS;
+}
+
+int batch_run(const char *manifest, const char *passphrase, int decrypt,
+              const batch_opts_t *bopts, const stream_opts_t *opts, batch_result_t *result,
+              FILE *log) {
+    batch_opts_t bdefaults;
+    batch_result_t local;
+    batch_t b;
+    char journal[4096];
+    char *text = NULL;
+    size_t len = 0;
+    pair_t *pairs = NULL;
+    size_t count = 0;
+    thread_pool_t *pool = NULL;
+    const int from_stdin = manifest && strcmp(manifest, "-") == 0;
+    int rc;
+
+    if (!manifest || !passphrase || !opts) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!bopts) {
+        batch_opts_init(&bdefaults);
+        bopts = &bdefaults;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    if (from_stdin && bopts->resume) {
+        if (log) fprintf(log, "--resume needs a manifest file, not stdin\n");
+        return ENC_ERR_INVALID_ARG;
+    }
+    if ((size_t)snprintf(journal, sizeof(journal), "%s%s", manifest, JOURNAL_SUFFIX) >=
+        sizeof(journal)) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    rc = read_manifest(manifest, &text, &len);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    const uint64_t hash = manifest_hash(text, len);   /* Before parsing splits it */
+    rc = parse_manifest(text, len, &pairs, &count, &result->bad_line);
+    if (rc != ENC_SUCCESS) {
+        mem_free(text);
+        return rc;
+    }
+    result->files = count;
+
+    memset(&b, 0, sizeof(b));
+    b.pairs = pairs;
+    b.passphrase = passphrase;
+    b.decrypt = decrypt;
+    b.opts = *opts;
+    b.opts.threads = 1;        /* Parallel across files, not within one */
+    b.opts.keyring = stream_keyring_create(passphrase, opts->kdf_iterations);
+    b.journal_fd = -1;
+    b.result = result;
+    b.log = log;
+    b.group_files = bopts->group_files ? bopts->group_files : BATCH_GROUP_FILES;
+    b.group_ns = (uint64_t)(bopts->group_ms ? bopts->group_ms : BATCH_GROUP_MS) * 1000000ULL;
+    b.group = (member_t *)mem_alloc(b.group_files * sizeof(*b.group));
+    pthread_mutex_init(&b.group_lock, NULL);
+
+    pool = tp_create(opts->threads);
+    if (!b.opts.keyring || !pool || !b.group) {
+        rc = ENC_ERR_MEMORY;
+    } else if (!from_stdin) {
+        rc = journal_open(&b, journal, bopts->resume, hash, count, log);
+    }
+
+    if (rc == ENC_SUCCESS) {
+        const uint64_t start = now_ns();
+        b.group_start = start;
+        tp_parallel_for(pool, count, file_task, &b);
+        if (b.group_count) {
+            group_flush(&b);   /* The last, partial group */
+        }
+        result->wall_ns = now_ns() - start;
+        result->kdf_calls = stream_keyring_kdf_calls(b.opts.keyring);
+        rc = result->failed ? b.first_error : ENC_SUCCESS;
+    }
+
+    if (b.journal_fd >= 0) {
+        fio_close(b.journal_fd);
+        if (rc == ENC_SUCCESS) {
+            unlink(journal);  /* Every file is done: nothing left to resume */
+        }
+    }
+    tp_destroy(pool);
+    pthread_mutex_destroy(&b.group_lock);
+    mem_free(b.group);
+    stream_keyring_destroy(b.opts.keyring);
+    mem_free(b.progress);
+    mem_free(pairs);
+    mem_free(text);
+    return rc;
+}
@@ -0,0 +1,940 @@
+/*
+ * bench.c - Built-in benchmark suite
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Sweeps payload size, algorithm, thread count, KDF cost and I/O backend,
+ * reporting throughput, p50/p99 latency and peak RSS per case.
+ *
+ * Demonstrates OS concepts:
+ * - Process isolation: every case runs in a fork()ed child so its peak
+ *   resident set size can be read from wait4()'s rusage
+ * - Inter-process communication through a pipe()
+ * - Monotonic clocks: clock_gettime(CLOCK_MONOTONIC)
+ */
+
+#include "../include/bench.h"
+#include "../include/encryption.h"
+#include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/stream.h"
+#include "../include/thread_pool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#define BENCH_PASSPHRASE "encrypt_tool-bench"
+#define BENCH_WINDOW (64ULL * 1024 * 1024)   /* Max plaintext held in memory */
+#define BENCH_MAX_REPS 2000
+#define BENCH_MAX_ROWS 128
+#define BENCH_LARGE_CASE (256ULL * 1024 * 1024)
+#define BENCH_CHECK_ROUNDS 7      /* Regression set runs; metrics are their medians */
+
+/* Summary a child sends back to the parent */
+typedef struct {
+    int rc;
+    int reps;
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t huge_bytes;
+} case_stats_t;
+
+typedef int (*bench_op_fn)(void *ctx);
+
+void bench_opts_init(bench_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->format = BENCH_FORMAT_TEXT;
+    opts->max_size = BENCH_DEFAULT_MAX_SIZE;
+    opts->seed = BENCH_DEFAULT_SEED;
+    opts->dir = "/tmp";
+}
+
+int bench_format_from_name(const char *name) {
+    if (!name || strcasecmp(name, "text") == 0) return BENCH_FORMAT_TEXT;
+    if (strcasecmp(name, "json") == 0) return BENCH_FORMAT_JSON;
+    if (strcasecmp(name, "csv") == 0) return BENCH_FORMAT_CSV;
+    return -1;
+}
+
+/* ── Helpers ─────────────────────────────────────────────────────── */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift64*: fast, reproducible payload contents for a given seed */
+static void fill_random(unsigned char *buf, size_t len, uint64_t *state) {
+    size_t i = 0;
+
+    while (i < len) {
+        uint64_t x = *state;
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        *state = x;
+        x *= 0x2545F4914F6CDD1DULL;
+
+        for (int b = 0; b < 8 && i < len; b++, i++) {
+            buf[i] = (unsigned char)(x >> (8 * b));
+        }
+    }
+}
+
+static void format_size(uint64_t size, char *buf, size_t len) {
+    static const char *units[] = {"B", "K", "M", "G", "T"};
+    int u = 0;
+
+    while (size >= 1024 && size % 1024 == 0 && u < 4) {
+        size /= 1024;
+        u++;
+    }
+    snprintf(buf, len, "%llu%s", (unsigned long long)size, units[u]);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Call op until both the minimum repetitions and minimum wall time are
+ * reached, then summarize the per-call latencies.
+ */
+static void measure(bench_op_fn op, void *ctx, double min_seconds, int min_reps,
+                    case_stats_t *stats) {
+    uint64_t *lat = (uint64_t *)mem_alloc(BENCH_MAX_REPS * sizeof(uint64_t));
+    const uint64_t budget = (uint64_t)(min_seconds * 1e9);
+    int reps = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!lat) {
+        stats->rc = ENC_ERR_MEMORY;
+        return;
+    }
+
+    while (reps < BENCH_MAX_REPS && (reps < min_reps || stats->total_ns < budget)) {
+        const uint64_t t0 = now_ns();
+        stats->rc = op(ctx);
+        lat[reps] = now_ns() - t0;
+        if (stats->rc != ENC_SUCCESS) {
+            break;
+        }
+        stats->total_ns += lat[reps];
+        reps++;
+    }
+
+    if (reps > 0) {
+        qsort(lat, (size_t)reps, sizeof(uint64_t), cmp_u64);
+        stats->p50_ns = lat[(reps - 1) / 2];
+        stats->p99_ns = lat[(size_t)((reps - 1) * 0.99 + 0.5)];
+    }
+    stats->reps = reps;
+    mem_free(lat);
+}
+
+/* Generate a data key for header, wrapped under BENCH_PASSPHRASE */
+static int bench_wrap_key(enc_header_t *header, uint32_t iterations, enc_key_t *key) {
+    enc_kek_t kek;
+    int rc = enc_kek_derive(BENCH_PASSPHRASE, NULL, iterations, &kek);
+
+    if (rc == ENC_SUCCESS) {
+        rc = enc_generate_key(header, &kek, key);
+    }
+    enc_kek_wipe(&kek);
+    return rc;
+}
+
+/* ── Memory backend: crypto only, key derived outside the timed loop ── */
+
+typedef struct {
+    enc_header_t header;
+    enc_key_t key;
+    thread_pool_t *pool;
+    unsigned char *window;
+    size_t window_len;
+    unsigned char *out;          /* One sealed segment per worker */
+    size_t out_stride;
+    int rc;
+} memory_ctx_t;
+
+static void memory_seal_task(void *arg, size_t i, int worker) {
+    memory_ctx_t *ctx = (memory_ctx_t *)arg;
+    const uint64_t start = (uint64_t)i * ctx->header.segment_size;
+    const uint64_t left = ctx->header.plaintext_len - start;
+    const size_t len = left < ctx->header.segment_size ? (size_t)left : ctx->header.segment_size;
+    size_t sealed = 0;
+
+    /* Payloads larger than the window reuse it; window is segment-aligned */
+    int rc = enc_seal_segment(&ctx->header, &ctx->key, i,
+                              ctx->window + (size_t)(start % ctx->window_len), len,
+                              ctx->out + (size_t)worker * ctx->out_stride, &sealed);
+    if (rc != ENC_SUCCESS) {
+        ctx->rc = rc;
+    }
+}
+
+static int memory_op(void *raw) {
+    memory_ctx_t *ctx = (memory_ctx_t *)raw;
+    tp_parallel_for(ctx->pool, (size_t)enc_segment_count(&ctx->header), memory_seal_task, ctx);
+    return ctx->rc;
+}
+
+static int run_memory_case(const bench_opts_t *opts, const bench_row_t *spec,
+                           double min_seconds, int min_reps, case_stats_t *stats) {
+    memory_ctx_t ctx;
+    uint64_t state = opts->seed ? opts->seed : 1;
+    int rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    rc = enc_header_init(&ctx.header, spec->algorithm, 0, spec->size, 1);
+    if (rc == ENC_SUCCESS) {
+        rc = bench_wrap_key(&ctx.header, ENC_MIN_ITERATIONS, &ctx.key);
+    }
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    ctx.window_len = (size_t)(spec->size < BENCH_WINDOW ? spec->size : BENCH_WINDOW);
+    ctx.pool = tp_create(spec->threads);
+    ctx.out_stride = enc_sealed_len(spec->algorithm, ctx.header.segment_size);
+    ctx.window = (unsigned char *)mem_alloc(ctx.window_len ? ctx.window_len : 1);
+    ctx.out = ctx.pool ? (unsigned char *)mem_alloc((size_t)tp_size(ctx.pool) * ctx.out_stride) : NULL;
+
+    if (!ctx.pool || !ctx.window || !ctx.out) {
+        rc = ENC_ERR_MEMORY;
+    } else {
+        fill_random(ctx.window, ctx.window_len, &state);
+        measure(memory_op, &ctx, min_seconds, min_reps, stats);
+        rc = stats->rc;
+    }
+
+    mem_free(ctx.out);
+    mem_free(ctx.window);
+    tp_destroy(ctx.pool);
+    enc_key_wipe(&ctx.key);
+    return rc;
+}
+
+/* ── File backend: full stream_encrypt_file() round through the kernel ── */
+
+typedef struct {
+    char in_path[512];
+    char out_path[512];
+    stream_opts_t opts;
+} file_ctx_t;
+
+static int file_op(void *raw) {
+    file_ctx_t *ctx = (file_ctx_t *)raw;
+    return stream_encrypt_file(ctx->in_path, ctx->out_path, BENCH_PASSPHRASE, &ctx->opts, NULL);
+}
+
+static int write_input_file(const char *path, uint64_t size, unsigned int seed) {
+    const size_t chunk = 1024 * 1024;
+    unsigned char *buf = (unsigned char *)mem_alloc(chunk);
+    uint64_t state = seed ? seed : 1;
+    int fd = -1;
+    int rc = ENC_SUCCESS;
+
+    if (!buf) {
+        return ENC_ERR_MEMORY;
+    }
+    if (fio_open_output(path, &fd) != FIO_SUCCESS) {
+        mem_free(buf);
+        return ENC_ERR_IO;
+    }
+
+    for (uint64_t done = 0; done < size && rc == ENC_SUCCESS; ) {
+        const size_t len = (size - done < chunk) ? (size_t)(size - done) : chunk;
+        fill_random(buf, len, &state);
+        if (fio_write_full(fd, buf, len) != FIO_SUCCESS) {
+            rc = ENC_ERR_IO;
+        }
+        done += len;
+    }
+
+    close(fd);
+    mem_free(buf);
+    return rc;
+}
+
+static int run_file_case(const bench_opts_t *opts, const bench_row_t *spec,
+                         double min_seconds, int min_reps, case_stats_t *stats) {
+    file_ctx_t ctx;
+    int rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    snprintf(ctx.in_path, sizeof(ctx.in_path), "%s/encrypt_tool_bench_%d.in",
+             opts->dir, (int)getpid());
+    snprintf(ctx.out_path, sizeof(ctx.out_path), "%s/encrypt_tool_bench_%d.enc",
+             opts->dir, (int)getpid());
+    stream_opts_init(&ctx.opts);
+    ctx.opts.algorithm = spec->algorithm;
+    ctx.opts.threads = spec->threads;
+    ctx.opts.kdf_iterations = spec->kdf_iterations;
+
+    rc = write_input_file(ctx.in_path, spec->size, opts->seed);
+    if (rc == ENC_SUCCESS) {
+        measure(file_op, &ctx, min_seconds, min_reps, stats);
+        rc = stats->rc;
+    }
+
+    unlink(ctx.in_path);
+    unlink(ctx.out_path);
+    return rc;
+}
+
+/* ── KDF cost ────────────────────────────────────────────────────── */
+
+typedef struct {
+    enc_header_t header;
+} kdf_ctx_t;
+
+static int kdf_op(void *raw) {
+    kdf_ctx_t *ctx = (kdf_ctx_t *)raw;
+    enc_key_t key;
+    int rc = enc_derive_key(BENCH_PASSPHRASE, &ctx->header, &key);
+    enc_key_wipe(&key);
+    return rc;
+}
+
+static int run_kdf_case(const bench_row_t *spec, double min_seconds, case_stats_t *stats) {
+    kdf_ctx_t ctx;
+    enc_key_t key;
+    int rc = enc_header_init(&ctx.header, ENC_ALG_AES_256_GCM, 0, 0, 1);
+
+    if (rc == ENC_SUCCESS) {
+        rc = bench_wrap_key(&ctx.header, spec->kdf_iterations, &key);
+        enc_key_wipe(&key);
+    }
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    measure(kdf_op, &ctx, min_seconds, 3, stats);
+    return stats->rc;
+}
+
+/* ── Case runner ─────────────────────────────────────────────────── */
+
+static int run_case_child(const bench_opts_t *opts, const bench_row_t *spec, case_stats_t *stats) {
+    const double min_seconds = opts->min_seconds > 0.0 ? opts->min_seconds
+                             : (opts->quick ? 0.05 : 0.5);
+    const int min_reps = spec->size >= BENCH_LARGE_CASE ? 1 : 3;
+
+    if (strcmp(spec->backend, "kdf") == 0) {
+        return run_kdf_case(spec, min_seconds, stats);
+    }
+    if (strcmp(spec->section, "pages") == 0) {
+        /* Same streaming run, with the pipeline buffers on another page size */
+        secmem_stats_t pool;
+        int rc;
+
+        secmem_set_pages(spec->pages);
+        rc = run_file_case(opts, spec, min_seconds, min_reps, stats);
+        secmem_get_stats(&pool);
+        stats->huge_bytes = pool.huge_bytes;
+        return rc;
+    }
+    if (strcmp(spec->backend, "file") == 0) {
+        return run_file_case(opts, spec, min_seconds, min_reps, stats);
+    }
+    return run_memory_case(opts, spec, min_seconds, min_reps, stats);
+}
+
+/* Run one case in a child process and fill in the measured fields */
+static void run_case(const bench_opts_t *opts, bench_row_t *row) {
+    case_stats_t stats;
+    struct rusage usage;
+    int pipefd[2];
+    int status = 0;
+    pid_t pid;
+
+    memset(&stats, 0, sizeof(stats));
+    memset(&usage, 0, sizeof(usage));
+    row->rc = ENC_ERR_IO;
+
+    if (pipe(pipefd) == -1) {
+        return;
+    }
+
+    fflush(NULL);  /* Don't duplicate buffered output into the child */
+    pid = fork();
+    if (pid == -1) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        close(pipefd[0]);
+        stats.rc = run_case_child(opts, row, &stats);
+        (void)fio_write_full(pipefd[1], (const unsigned char *)&stats, sizeof(stats));
+        close(pipefd[1]);
+        _exit(0);
+    }
+
+    close(pipefd[1]);
+    size_t got = 0;
+    if (fio_read_full(pipefd[0], (unsigned char *)&stats, sizeof(stats), &got) != FIO_SUCCESS ||
+        got != sizeof(stats)) {
+        stats.rc = ENC_ERR_IO;
+    }
+    close(pipefd[0]);
+
+    while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR) {
+    }
+
+    row->rc = stats.rc;
+    row->reps = stats.reps;
+    row->huge_bytes = stats.huge_bytes;
+    row->p50_ms = (double)stats.p50_ns / 1e6;
+    row->p99_ms = (double)stats.p99_ns / 1e6;
+    /* Throughput at the median latency: robust against a few slow outliers */
+    if (stats.p50_ns > 0 && row->size > 0) {
+        row->mb_per_s = ((double)row->size / (1024.0 * 1024.0)) / ((double)stats.p50_ns / 1e9);
+    }
+#ifdef __APPLE__
+    row->peak_rss_kb = usage.ru_maxrss / 1024;   /* bytes on macOS */
+#else
+    row->peak_rss_kb = usage.ru_maxrss;          /* kilobytes on Linux */
+#endif
+}
+
+/* ── Output ──────────────────────────────────────────────────────── */
+
+static const char *row_alg_name(const bench_row_t *row) {
+    return strcmp(row->backend, "kdf") == 0 ? "PBKDF2-SHA256" : enc_alg_name(row->algorithm);
+}
+
+static void print_text_header(FILE *out, const bench_opts_t *opts) {
+    fprintf(out, "encrypt_tool benchmark  (cpus=%d, segment=%d KiB, seed=%u%s)\n\n",
+            tp_default_threads(), ENC_DEFAULT_SEGMENT_SIZE / 1024, opts->seed,
+            opts->quick ? ", quick" : "");
+    fprintf(out, "%-10s %-7s %-18s %7s %4s %7s %5s %10s %10s %10s %10s\n",
+            "section", "backend", "algorithm", "size", "thr", "kdf", "reps",
+            "MB/s", "p50 ms", "p99 ms", "peak RSS");
+}
+
+static void print_text_row(FILE *out, const bench_row_t *row) {
+    char size[16];
+
+    format_size(row->size, size, sizeof(size));
+
+    if (row->rc != ENC_SUCCESS) {
+        fprintf(out, "%-10s %-7s %-18s %7s %4d  FAILED: %s\n", row->section, row->backend,
+                row_alg_name(row), size, row->threads, enc_strerror(row->rc));
+        return;
+    }
+
+    fprintf(out, "%-10s %-7s %-18s %7s %4d %7u %5d %10.1f %10.3f %10.3f %9ldK%s\n",
+            row->section, row->backend,
+            row_alg_name(row), size, row->threads, row->kdf_iterations, row->reps,
+            row->mb_per_s, row->p50_ms, row->p99_ms, row->peak_rss_kb,
+            (row->pages != SECMEM_PAGES_DEFAULT && row->huge_bytes == 0)
+                ? "  (no huge pages, ran on 4k)" : "");
+}
+
+static void print_json(FILE *out, const bench_opts_t *opts, const bench_row_t *rows, int count) {
+    fprintf(out, "{\n  \"cpus\": %d,\n  \"segment_size\": %d,\n  \"seed\": %u,\n  \"results\": [\n",
+            tp_default_threads(), ENC_DEFAULT_SEGMENT_SIZE, opts->seed);
+    for (int i = 0; i < count; i++) {
+        const bench_row_t *r = &rows[i];
+        fprintf(out,
+                "    {\"section\": \"%s\", \"backend\": \"%s\", \"algorithm\": \"%s\", "
+                "\"size\": %llu, \"threads\": %d, \"kdf_iterations\": %u, \"reps\": %d, "
+                "\"mb_per_s\": %.2f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+                "\"peak_rss_kb\": %ld, \"huge_bytes\": %llu, \"ok\": %s}%s\n",
+                r->section, r->backend, row_alg_name(r),
+                (unsigned long long)r->size, r->threads, r->kdf_iterations, r->reps,
+                r->mb_per_s, r->p50_ms, r->p99_ms, r->peak_rss_kb,
+                (unsigned long long)r->huge_bytes,
+                r->rc == ENC_SUCCESS ? "true" : "false", (i + 1 < count) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void print_csv(FILE *out, const bench_row_t *rows, int count) {
+    fprintf(out, "section,backend,algorithm,size,threads,kdf_iterations,reps,"
+                 "mb_per_s,p50_ms,p99_ms,peak_rss_kb,huge_bytes,ok\n");
+    for (int i = 0; i < count; i++) {
+        const bench_row_t *r = &rows[i];
+        fprintf(out, "%s,%s,%s,%llu,%d,%u,%d,%.2f,%.4f,%.4f,%ld,%llu,%d\n",
+                r->section, r->backend, row_alg_name(r),
+                (unsigned long long)r->size, r->threads, r->kdf_iterations, r->reps,
+                r->mb_per_s, r->p50_ms, r->p99_ms, r->peak_rss_kb,
+                (unsigned long long)r->huge_bytes, r->rc == ENC_SUCCESS);
+    }
+}
+
+static void print_report(FILE *out, int format, const bench_opts_t *opts,
+                         const bench_row_t *rows, int count) {
+    if (format == BENCH_FORMAT_JSON) {
+        print_json(out, opts, rows, count);
+    } else if (format == BENCH_FORMAT_CSV) {
+        print_csv(out, rows, count);
+    }
+}
+
+/* ── Sweep ───────────────────────────────────────────────────────── */
+
+static bench_row_t *add_case(bench_row_t *rows, int *count, const char *section,
+                             const char *backend, int algorithm, uint64_t size,
+                             int threads, uint32_t kdf_iterations) {
+    if (*count >= BENCH_MAX_ROWS) {
+        return NULL;
+    }
+    bench_row_t *row = &rows[(*count)++];
+    memset(row, 0, sizeof(*row));
+    snprintf(row->section, sizeof(row->section), "%s", section);
+    snprintf(row->backend, sizeof(row->backend), "%s", backend);
+    row->algorithm = algorithm;
+    row->size = size;
+    row->threads = threads;
+    row->kdf_iterations = kdf_iterations;
+    return row;
+}
+
+static int build_cases(const bench_opts_t *opts, bench_row_t *rows) {
+    static const int algorithms[] = {
+        ENC_ALG_AES_256_GCM, ENC_ALG_CHACHA20_POLY1305, ENC_ALG_AES_256_CBC_HMAC
+    };
+    static const uint32_t kdf_costs[] = {10000, 100000, 250000, 600000};
+    const int threads = opts->threads > 0 ? opts->threads : tp_default_threads();
+    const uint64_t step = opts->quick ? 64 : 16;
+    const uint64_t max_size = opts->max_size >= 1024 ? opts->max_size : 1024;
+    const uint64_t large = max_size < (opts->quick ? 16ULL << 20 : BENCH_LARGE_CASE)
+        ? max_size : (opts->quick ? 16ULL << 20 : BENCH_LARGE_CASE);
+    int count = 0;
+
+    /* Per-algorithm throughput across payload sizes: 1K, 16K, ... max */
+    for (size_t a = 0; a < 3; a++) {
+        uint64_t size = 1024;
+        for (; size < max_size; size *= step) {
+            add_case(rows, &count, "algorithm", "memory", algorithms[a], size, threads, 0);
+        }
+        add_case(rows, &count, "algorithm", "memory", algorithms[a], max_size, threads, 0);
+    }
+
+    /* Thread scaling: 1, 2, 4, ... CPUs */
+    const int cpus = tp_default_threads();
+    for (int t = 1; ; t *= 2) {
+        const int n = t < cpus ? t : cpus;
+        add_case(rows, &count, "threads", "memory", ENC_ALG_AES_256_GCM, large, n, 0);
+        if (n == cpus) break;
+    }
+
+    /* Key derivation cost */
+    for (size_t k = 0; k < 4; k++) {
+        if (opts->quick && (kdf_costs[k] == 100000 || kdf_costs[k] == 600000)) {
+            continue;
+        }
+        add_case(rows, &count, "kdf", "kdf", ENC_ALG_AES_256_GCM, 0, 1, kdf_costs[k]);
+    }
+
+    /* I/O backends: in-memory crypto vs streaming through the file system */
+    const uint64_t io_sizes[] = {1024 * 1024, large};
+    for (size_t s = 0; s < 2; s++) {
+        add_case(rows, &count, "io", "memory", ENC_ALG_AES_256_GCM, io_sizes[s], threads, 0);
+        add_case(rows, &count, "io", "file", ENC_ALG_AES_256_GCM, io_sizes[s], threads,
+                 ENC_MIN_ITERATIONS);
+    }
+
+    /* Pipeline buffers on 4 KiB pages vs transparent vs hugetlbfs huge pages */
+    for (int m = SECMEM_PAGES_DEFAULT; m <= SECMEM_PAGES_HUGETLB; m++) {
+        bench_row_t *row = add_case(rows, &count, "pages", secmem_pages_name(m),
+                                    ENC_ALG_AES_256_GCM, large, threads, ENC_MIN_ITERATIONS);
+        if (row) {
+            row->pages = m;
+        }
+    }
+
+    return count;
+}
+
+/* Run every case, streaming text rows as they finish; returns non-zero on failure */
+static int run_rows(const bench_opts_t *opts, bench_row_t *rows, int count, FILE *out) {
+    int failed = 0;
+
+    if (opts->format == BENCH_FORMAT_TEXT) {
+        print_text_header(out, opts);
+    }
+
+    for (int i = 0; i < count; i++) {
+        run_case(opts, &rows[i]);
+        if (rows[i].rc != ENC_SUCCESS) {
+            failed = 1;
+        }
+        if (opts->format == BENCH_FORMAT_TEXT) {
+            print_text_row(out, &rows[i]);
+            fflush(out);
+        }
+    }
+    return failed;
+}
+
+int bench_run(const bench_opts_t *opts, FILE *out) {
+    bench_opts_t defaults;
+    bench_row_t *rows;
+    int count;
+    int failed;
+
+    if (!opts) {
+        bench_opts_init(&defaults);
+        opts = &defaults;
+    }
+
+    rows = (bench_row_t *)mem_calloc(BENCH_MAX_ROWS, sizeof(bench_row_t));
+    if (!rows) {
+        return -1;
+    }
+
+    count = build_cases(opts, rows);
+    failed = run_rows(opts, rows, count, out);
+
+    print_report(out, opts->format, opts, rows, count);
+
+    if (opts->report_path) {
+        const char *ext = strrchr(opts->report_path, '.');
+        FILE *report = fopen(opts->report_path, "w");
+
+        if (!report) {
+            fprintf(stderr, "Error: cannot write %s\n", opts->report_path);
+            failed = 1;
+        } else {
+            print_report(report, (ext && strcasecmp(ext, ".csv") == 0)
+                                     ? BENCH_FORMAT_CSV : BENCH_FORMAT_JSON,
+                         opts, rows, count);
+            fclose(report);
+        }
+    }
+
+    mem_free(rows);
+    return failed ? -1 : 0;
+}
+
+/* ── Regression gate ─────────────────────────────────────────────── */
+
+/* Metrics tracked in a baseline, with default tolerances for --bench-save */
+static const struct {
+    const char *name;
+    int higher_is_better;
+    double tolerance;
+} METRICS[] = {
+    {"mb_per_s", 1, 0.15},
+    {"p50_ms", 0, 0.20},
+    {"p99_ms", 0, 0.50},     /* Tail latency is the noisiest metric */
+    {"peak_rss_kb", 0, 0.10},
+};
+#define METRIC_COUNT (sizeof(METRICS) / sizeof(METRICS[0]))
+
+static double row_metric(const bench_row_t *row, size_t metric) {
+    switch (metric) {
+        case 0: return row->mb_per_s;
+        case 1: return row->p50_ms;
+        case 2: return row->p99_ms;
+        default: return (double)row->peak_rss_kb;
+    }
+}
+
+static void set_row_metric(bench_row_t *row, size_t metric, double value) {
+    switch (metric) {
+        case 0: row->mb_per_s = value; break;
+        case 1: row->p50_ms = value; break;
+        case 2: row->p99_ms = value; break;
+        default: row->peak_rss_kb = (long)value; break;
+    }
+}
+
+static void row_key(const bench_row_t *row, char *buf, size_t len) {
+    char size[16];
+    format_size(row->size, size, sizeof(size));
+    snprintf(buf, len, "%s/%s/%s/%s/t%d/k%u", row->section, row->backend,
+             row_alg_name(row), size, row->threads, row->kdf_iterations);
+}
+
+/*
+ * Fixed regression set: single-threaded so results do not depend on the
+ * host's core count, seeded payloads, sizes small enough for CI but large
+ * enough (>= 64K) that timer and scheduler noise stay well below tolerance.
+ */
+static int build_regression_cases(bench_row_t *rows) {
+    static const int algorithms[] = {
+        ENC_ALG_AES_256_GCM, ENC_ALG_CHACHA20_POLY1305, ENC_ALG_AES_256_CBC_HMAC
+    };
+    static const uint64_t sizes[] = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    int count = 0;
+
+    for (size_t a = 0; a < 3; a++) {
+        for (size_t s = 0; s < 3; s++) {
+            add_case(rows, &count, "algorithm", "memory", algorithms[a], sizes[s], 1, 0);
+        }
+    }
+    add_case(rows, &count, "kdf", "kdf", ENC_ALG_AES_256_GCM, 0, 1, 100000);
+    add_case(rows, &count, "io", "file", ENC_ALG_AES_256_GCM, 16 * 1024 * 1024, 1,
+             ENC_MIN_ITERATIONS);
+    return count;
+}
+
+/* "host <key>" line of a baseline file */
+#define BASELINE_HOST_LEN 160
+#define BASELINE_HOST_SCAN "159"
+
+/*
+ * Absolute MB/s, latency and RSS only mean something on the machine that
+ * recorded them, so a baseline names its host: architecture, CPU model
+ * and online CPU count, spaces folded to '_' to keep it one token
+ */
+static void host_key(char *buf, size_t len) {
+    struct utsname u;
+    char model[128] = "unknown-cpu";
+    char line[256];
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+    while (cpuinfo && fgets(line, sizeof(line), cpuinfo)) {
+        char *colon = strchr(line, ':');
+        if (colon && strncmp(line, "model name", 10) == 0) {
+            snprintf(model, sizeof(model), "%s", colon + 2);
+            model[strcspn(model, "\n")] = '\0';
+            break;
+        }
+    }
+    if (cpuinfo) {
+        fclose(cpuinfo);
+    }
+
+    snprintf(buf, len, "%s/%s/%dcpu", uname(&u) == 0 ? u.machine : "unknown",
+             model, tp_default_threads());
+    for (char *p = buf; *p; p++) {
+        if (*p == ' ' || *p == '\t') *p = '_';
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Run the regression set BENCH_CHECK_ROUNDS times and keep the median of
+ * every metric. Rounds are interleaved (all cases, then all cases again),
+ * so a slow patch on a shared host hits one sample of many cases rather
+ * than every sample of one case.
+ */
+static int run_regression_set(const bench_opts_t *opts, bench_row_t *rows, FILE *out) {
+    static bench_row_t samples[BENCH_CHECK_ROUNDS][BENCH_MAX_ROWS];
+    bench_opts_t fixed = *opts;
+    double values[BENCH_CHECK_ROUNDS];
+
+    fixed.format = BENCH_FORMAT_TEXT;
+    fixed.quick = 0;
+    fixed.seed = BENCH_DEFAULT_SEED;
+    fixed.min_seconds = 0.5;
+
+    const int count = build_regression_cases(rows);
+    memcpy(samples[0], rows, (size_t)count * sizeof(*rows));
+    if (run_rows(&fixed, samples[0], count, out)) {
+        return -1;
+    }
+    for (int round = 1; round < BENCH_CHECK_ROUNDS; round++) {
+        fprintf(out, "Round %d of %d...\n", round + 1, BENCH_CHECK_ROUNDS);
+        fflush(out);
+        for (int i = 0; i < count; i++) {
+            samples[round][i] = rows[i];
+            run_case(&fixed, &samples[round][i]);
+            if (samples[round][i].rc != ENC_SUCCESS) {
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        rows[i] = samples[0][i];
+        for (size_t m = 0; m < METRIC_COUNT; m++) {
+            for (int round = 0; round < BENCH_CHECK_ROUNDS; round++) {
+                values[round] = row_metric(&samples[round][i], m);
+            }
+            qsort(values, BENCH_CHECK_ROUNDS, sizeof(values[0]), compare_double);
+            set_row_metric(&rows[i], m, values[BENCH_CHECK_ROUNDS / 2]);
+        }
+    }
+    return count;
+}
+
+int bench_save_baseline(const bench_opts_t *opts, const char *path, FILE *out) {
+    bench_row_t rows[BENCH_MAX_ROWS];
+    FILE *file;
+    char key[96];
+    char host[BASELINE_HOST_LEN];
+    int count = run_regression_set(opts, rows, out);
+
+    if (count < 0) {
+        fprintf(stderr, "Error: benchmark cases failed, baseline not written\n");
+        return -1;
+    }
+
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return -1;
+    }
+
+    fprintf(file, "# encrypt_tool performance baseline (make perf-baseline to regenerate)\n");
+    fprintf(file, "# Tolerance is the allowed relative change in the bad direction:\n");
+    fprintf(file, "# mb_per_s may drop, latency and peak RSS may grow, by at most that fraction.\n");
+    fprintf(file, "# Values are medians of %d interleaved runs of the set, as --bench-check measures.\n",
+            BENCH_CHECK_ROUNDS);
+    fprintf(file, "# Only meaningful on the host below; --bench-check skips on any other.\n");
+    host_key(host, sizeof(host));
+    fprintf(file, "host %s\n", host);
+    fprintf(file, "# %-44s %-12s %14s %9s\n", "case", "metric", "baseline", "tolerance");
+    for (int i = 0; i < count; i++) {
+        row_key(&rows[i], key, sizeof(key));
+        for (size_t m = 0; m < METRIC_COUNT; m++) {
+            const double value = row_metric(&rows[i], m);
+            if (value <= 0.0) {
+                continue;  /* e.g. throughput of a KDF case */
+            }
+            fprintf(file, "%-46s %-12s %14.4f %9.2f\n", key, METRICS[m].name, value,
+                    METRICS[m].tolerance);
+        }
+    }
+
+    fclose(file);
+    fprintf(out, "\nBaseline written to %s\n", path);
+    return 0;
+}
+
+/* One "<case> <metric> <value> <tolerance>" line of a baseline file */
+typedef struct {
+    char key[96];
+    size_t metric;             /* Index into METRICS, METRIC_COUNT if unknown */
+    double baseline;
+    double tolerance;
+} baseline_entry_t;
+
+/* Entries and the "host <key>" line (host left empty if there is none) */
+static int load_baseline(const char *path, baseline_entry_t *entries, int max, char *host) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    char metric[32];
+    int count = 0;
+
+    host[0] = '\0';
+    if (!file) {
+        return -1;
+    }
+
+    while (count < max && fgets(line, sizeof(line), file)) {
+        baseline_entry_t *e = &entries[count];
+
+        if (strncmp(line, "host ", 5) == 0) {
+            sscanf(line + 5, "%" BASELINE_HOST_SCAN "s", host);
+            continue;
+        }
+        if (line[0] == '#' || sscanf(line, "%95s %31s %lf %lf", e->key, metric,
+                                     &e->baseline, &e->tolerance) != 4) {
+            continue;
+        }
+        for (e->metric = 0; e->metric < METRIC_COUNT; e->metric++) {
+            if (strcmp(metric, METRICS[e->metric].name) == 0) break;
+        }
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+static int find_row(const bench_row_t *rows, int count, const char *key) {
+    char row_name[96];
+
+    for (int i = 0; i < count; i++) {
+        row_key(&rows[i], row_name, sizeof(row_name));
+        if (strcmp(row_name, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Relative change vs baseline; *regressed set when beyond tolerance */
+static double compare_entry(const baseline_entry_t *e, const bench_row_t *row, int *regressed) {
+    const double change = (row_metric(row, e->metric) - e->baseline) / e->baseline;
+    *regressed = METRICS[e->metric].higher_is_better ? (change < -e->tolerance)
+                                                     : (change > e->tolerance);
+    return change;
+}
+
+int bench_check(const bench_opts_t *opts, const char *path, FILE *out) {
+    static baseline_entry_t entries[BENCH_MAX_ROWS * METRIC_COUNT];
+    bench_row_t rows[BENCH_MAX_ROWS];
+    char host[BASELINE_HOST_LEN];
+    char here[BASELINE_HOST_LEN];
+    int regressions = 0;
+
+    const int entry_count = load_baseline(path, entries, BENCH_MAX_ROWS * (int)METRIC_COUNT,
+                                          host);
+    host_key(here, sizeof(here));
+    if (entry_count < 0) {
+        fprintf(out, "Performance check: SKIPPED (no baseline %s; record one on this "
+                     "machine with make perf-baseline)\n", path);
+        return 0;
+    }
+    if (strcmp(host, here) != 0) {
+        fprintf(out, "Performance check: SKIPPED (baseline %s was recorded on %s, this is "
+                     "%s; record one here with make perf-baseline)\n", path,
+                host[0] ? host : "an unnamed host", here);
+        return 0;
+    }
+    if (entry_count == 0) {
+        fprintf(out, "Performance check: FAIL (baseline %s has no entries)\n", path);
+        return -1;
+    }
+
+    const int count = run_regression_set(opts, rows, out);
+    if (count < 0) {
+        fprintf(out, "\nPerformance check: FAIL (benchmark cases failed)\n");
+        return -1;
+    }
+
+    fprintf(out, "\n%-46s %-12s %12s %12s %8s  %s\n",
+            "case", "metric", "baseline", "current", "change", "result");
+
+    for (int i = 0; i < entry_count; i++) {
+        const baseline_entry_t *e = &entries[i];
+        const int r = e->metric < METRIC_COUNT ? find_row(rows, count, e->key) : -1;
+        int regressed = 0;
+
+        if (r < 0 || e->baseline <= 0.0) {
+            fprintf(out, "%-46s %-12s %12.3f %12s %8s  UNKNOWN\n", e->key,
+                    e->metric < METRIC_COUNT ? METRICS[e->metric].name : "?", e->baseline, "-", "-");
+            regressions++;
+            continue;
+        }
+
+        const double change = compare_entry(e, &rows[r], &regressed);
+        fprintf(out, "%-46s %-12s %12.3f %12.3f %+7.1f%%  %s\n", e->key,
+                METRICS[e->metric].name, e->baseline, row_metric(&rows[r], e->metric),
+                change * 100.0, regressed ? "REGRESSION" : "ok");
+        regressions += regressed;
+    }
+
+    fprintf(out, "\nPerformance check: %s (%d metrics, %d regressions)\n",
+            regressions ? "FAIL" : "PASS", entry_count, regressions);
+    return regressions ? -1 : 0;
+}
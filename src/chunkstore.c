@@ -0,0 +1,821 @@
+/*
+ * chunkstore.c - Deduplicating encrypted version store
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Put, per round of CHUNK_WINDOW input bytes:
+ *   read()  ->  find chunk boundaries (sequential rolling hash)
+ *   ->  ID + seal + write new chunks on the thread pool
+ * then one syncfs() and the manifest, written last so it never names a
+ * chunk that is not on disk.
+ *
+ * Demonstrates OS concepts:
+ * - Content-addressed storage with atomic publication via link()
+ * - Batched durability: syncfs() instead of one fsync() per chunk
+ */
+
+#include "../include/chunkstore.h"
+#include "../include/encryption.h"
+#include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/thread_pool.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE_HEADER "store.hdr"
+#define PATH_LEN 4096
+
+#define MANIFEST_MAGIC "FMAN"
+#define MANIFEST_FORMAT 1
+#define MANIFEST_FIXED_LEN 20                 /* magic, format, length, count */
+#define MANIFEST_ENTRY_LEN (ENC_BLOB_ID_LEN + 4)
+
+/*
+ * Cut when the top bits of the Gear hash are zero. Before the average
+ * size more bits must match (cuts are rarer), after it fewer, which pulls
+ * chunk sizes toward CHUNK_AVG_SIZE (normalized chunking).
+ */
+#define MASK_SMALL (~0ULL << (64 - 18))
+#define MASK_LARGE (~0ULL << (64 - 14))
+
+/* Most chunks one round can hold */
+#define ROUND_CHUNKS ((CHUNK_WINDOW + CHUNK_MAX_SIZE) / CHUNK_MIN_SIZE + 1)
+
+/* Worker scratch: the largest sealed chunk and its plaintext */
+#define CHUNK_SCRATCH (2 * CHUNK_MAX_SIZE + ENC_BLOB_OVERHEAD)
+
+typedef struct {
+    enc_key_t keys;                /* key seals chunks, mac_key names them */
+    uint64_t gear[256];            /* Keyed, so boundaries do not leak content */
+} store_t;
+
+typedef struct {
+    unsigned char id[ENC_BLOB_ID_LEN];
+    uint32_t len;
+} chunk_ref_t;
+
+typedef struct {
+    const store_t *st;
+    const char *root;
+    unsigned char *buf;            /* Plaintext for this round */
+    const size_t *offsets;         /* Start of chunk i in buf */
+    chunk_ref_t *refs;
+    unsigned char **scratch;       /* Per worker: a sealed chunk, then room to
+                                      open an existing one (CHUNK_SCRATCH) */
+    uint64_t new_chunks;
+    uint64_t new_bytes;
+    uint64_t reused;               /* Referenced chunks found already stored */
+    int rc;
+} round_t;
+
+void chunk_opts_init(chunk_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+}
+
+/* ── Helpers ─────────────────────────────────────────────────────── */
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void set_error(int *rc, int value) {
+    int expected = ENC_SUCCESS;
+    __atomic_compare_exchange_n(rc, &expected, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int valid_name(const char *name) {
+    return name && name[0] != '\0' && name[0] != '.' && !strchr(name, '/') &&
+           strlen(name) < 256;
+}
+
+static void chunk_path(const char *root, const unsigned char *id, char *dir, char *path) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[2 * ENC_BLOB_ID_LEN + 1];
+
+    for (int i = 0; i < ENC_BLOB_ID_LEN; i++) {
+        hex[2 * i] = digits[id[i] >> 4];
+        hex[2 * i + 1] = digits[id[i] & 0x0f];
+    }
+    hex[2 * ENC_BLOB_ID_LEN] = '\0';
+    snprintf(dir, PATH_LEN, "%s/chunks/%.2s", root, hex);
+    snprintf(path, PATH_LEN, "%s/%s", dir, hex);
+}
+
+/*
+ * Publish data at path through a temporary file and link(), so readers
+ * never see a partial file and an existing path is left alone.
+ * *created is 0 if path already existed. With replace set the file is
+ * renamed over whatever is at path instead.
+ */
+static int publish(const char *dir, const char *path, const unsigned char *data, size_t len,
+                   int durable, int replace, int *created) {
+    char tmp[PATH_LEN + sizeof(FIO_TEMP_SUFFIX) + FIO_TEMP_ID_LEN];
+    int fd = -1;
+    int rc = ENC_SUCCESS;
+
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        return ENC_ERR_IO;
+    }
+    if (fio_open_temp(path, NULL, tmp, sizeof(tmp), &fd) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+    if (fio_write_full(fd, data, len) != FIO_SUCCESS ||
+        (durable && fio_sync(fd) != FIO_SUCCESS)) {
+        rc = ENC_ERR_IO;
+    }
+    if (fio_close(fd) != FIO_SUCCESS) {
+        rc = ENC_ERR_IO;
+    }
+
+    *created = 0;
+    if (rc == ENC_SUCCESS && replace) {
+        if (rename(tmp, path) == 0) {
+            *created = 1;
+        } else {
+            rc = ENC_ERR_IO;
+        }
+    } else if (rc == ENC_SUCCESS) {
+        if (link(tmp, path) == 0) {
+            *created = 1;
+        } else if (errno != EEXIST) {
+            rc = ENC_ERR_IO;
+        }
+    }
+    unlink(tmp);
+
+    if (rc == ENC_SUCCESS && durable && *created && fio_sync_dir(dir) != FIO_SUCCESS) {
+        rc = ENC_ERR_IO;
+    }
+    return rc;
+}
+
+/* ── Store key ───────────────────────────────────────────────────── */
+
+/* splitmix64: expands the keyed seed into the Gear table */
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Unlock the store key from DIR/store.hdr, or create the store when
+ * create is set and there is none yet.
+ */
+static int store_open(const char *root, const char *passphrase, int create, uint32_t iterations,
+                      store_t *st) {
+    static const char gear_label[] = "FENC-CDC-GEAR";
+    char path[PATH_LEN];
+    char dir[PATH_LEN];
+    unsigned char seed[ENC_BLOB_ID_LEN];
+    enc_header_t header;
+    enc_key_t *master;
+    enc_kek_t *kek = NULL;
+    unsigned char *raw = NULL;
+    size_t raw_len = 0;
+    int rc;
+
+    snprintf(path, sizeof(path), "%s/%s", root, STORE_HEADER);
+    master = (enc_key_t *)secmem_alloc(sizeof(*master));
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+
+    if (create && access(path, F_OK) == -1) {
+        int created = 0;
+
+        snprintf(dir, sizeof(dir), "%s/chunks", root);
+        if ((mkdir(root, 0700) == -1 && errno != EEXIST) ||
+            (mkdir(dir, 0700) == -1 && errno != EEXIST)) {
+            rc = ENC_ERR_IO;
+            goto done;
+        }
+        snprintf(dir, sizeof(dir), "%s/versions", root);
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+            rc = ENC_ERR_IO;
+            goto done;
+        }
+
+        kek = (enc_kek_t *)secmem_alloc(sizeof(*kek));
+        rc = kek ? enc_header_init(&header, ENC_ALG_AES_256_GCM, 0, 0, 1) : ENC_ERR_MEMORY;
+        if (rc == ENC_SUCCESS) rc = enc_kek_derive(passphrase, NULL, iterations, kek);
+        if (rc == ENC_SUCCESS) rc = enc_generate_key(&header, kek, master);
+        if (rc == ENC_SUCCESS) {
+            rc = publish(root, path, header.raw, header.header_len, 1, 0, &created);
+        }
+        if (rc != ENC_SUCCESS || created) {
+            goto keys;
+        }
+        /* Lost a race with another creator: open theirs instead */
+    }
+
+    if (read_file(path, &raw, &raw_len) != FIO_SUCCESS) {
+        rc = ENC_ERR_IO;
+        goto done;
+    }
+    rc = enc_header_decode(raw, raw_len, &header);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_derive_key(passphrase, &header, master);
+    }
+
+keys:
+    if (rc == ENC_SUCCESS) {
+        rc = enc_blob_keys(master, &st->keys);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = enc_blob_id(&st->keys, (const unsigned char *)gear_label, sizeof(gear_label) - 1,
+                         seed);
+    }
+    if (rc == ENC_SUCCESS) {
+        uint64_t state;
+        memcpy(&state, seed, sizeof(state));
+        for (int i = 0; i < 256; i++) {
+            st->gear[i] = splitmix64(&state);
+        }
+    }
+
+done:
+    mem_free(raw);
+    secmem_free(kek);
+    secmem_free(master);
+    return rc;
+}
+
+/* ── Chunking ────────────────────────────────────────────────────── */
+
+/* Length of the chunk starting at p, given n bytes available */
+static size_t cut_point(const uint64_t *gear, const unsigned char *p, size_t n) {
+    const size_t limit = n < CHUNK_MAX_SIZE ? n : CHUNK_MAX_SIZE;
+    const size_t normal = limit < CHUNK_AVG_SIZE ? limit : CHUNK_AVG_SIZE;
+    uint64_t h = 0;
+    size_t i = CHUNK_MIN_SIZE;
+
+    if (n <= CHUNK_MIN_SIZE) {
+        return n;
+    }
+    for (; i < normal; i++) {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & MASK_SMALL)) return i + 1;
+    }
+    for (; i < limit; i++) {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & MASK_LARGE)) return i + 1;
+    }
+    return limit;
+}
+
+/*
+ * Read the chunk stored for ref into sealed and open it into out.
+ * ENC_ERR_IO if it cannot be read, ENC_ERR_INVALID_FORMAT if it has the
+ * wrong size, ENC_ERR_DECRYPT if it does not authenticate.
+ */
+static int load_chunk(const round_t *r, const chunk_ref_t *ref, const char *path,
+                      unsigned char *sealed, unsigned char *out) {
+    const size_t want = ref->len + ENC_BLOB_OVERHEAD;
+    uint64_t size = 0;
+    size_t got = 0;
+    size_t opened = 0;
+    int fd = -1;
+
+    if (fio_open_input(path, &fd, &size) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+    if (size != want || fio_read_full(fd, sealed, want, &got) != FIO_SUCCESS || got != want) {
+        fio_close(fd);
+        return size != want ? ENC_ERR_INVALID_FORMAT : ENC_ERR_IO;
+    }
+    fio_close(fd);
+
+    /* AAD = ID: a chunk only opens under the name it was stored as */
+    if (enc_open_blob(&r->st->keys, ref->id, ENC_BLOB_ID_LEN, sealed, want, out,
+                      &opened) != ENC_SUCCESS || opened != ref->len) {
+        return ENC_ERR_DECRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+static void put_task(void *arg, size_t i, int worker) {
+    round_t *r = (round_t *)arg;
+    chunk_ref_t *ref = &r->refs[i];
+    const unsigned char *data = r->buf + r->offsets[i];
+    unsigned char *sealed = r->scratch[worker];
+    char dir[PATH_LEN];
+    char path[PATH_LEN];
+    const size_t want = ref->len + ENC_BLOB_OVERHEAD;
+    struct stat st;
+    int replace = 0;
+    int created = 0;
+    int rc = enc_blob_id(&r->st->keys, data, ref->len, ref->id);
+
+    if (rc != ENC_SUCCESS) {
+        set_error(&r->rc, rc);
+        return;
+    }
+
+    chunk_path(r->root, ref->id, dir, path);
+    if (stat(path, &st) == 0) {
+        /* Already stored by this or an earlier version, but possibly by a
+         * process that crashed before its syncfs(): the name can then hold
+         * zeros or garbage of the right size. Reuse it only if it opens. */
+        if (S_ISREG(st.st_mode) && (size_t)st.st_size == want) {
+            rc = load_chunk(r, ref, path, sealed, sealed + want);
+            if (rc == ENC_SUCCESS) {
+                __atomic_fetch_add(&r->reused, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            if (rc == ENC_ERR_IO) {
+                set_error(&r->rc, rc);
+                return;
+            }
+        }
+        replace = 1;  /* Torn by a crash: write it again */
+    } else if (errno != ENOENT) {
+        set_error(&r->rc, ENC_ERR_IO);
+        return;
+    }
+
+    rc = enc_seal_blob(&r->st->keys, ref->id, ENC_BLOB_ID_LEN, data, ref->len, sealed);
+    if (rc == ENC_SUCCESS) {
+        rc = publish(dir, path, sealed, want, 0, replace, &created);
+    }
+    if (rc != ENC_SUCCESS) {
+        set_error(&r->rc, rc);
+    } else if (created) {
+        __atomic_fetch_add(&r->new_chunks, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&r->new_bytes, want, __ATOMIC_RELAXED);
+    }
+}
+
+static void get_task(void *arg, size_t i, int worker) {
+    round_t *r = (round_t *)arg;
+    const chunk_ref_t *ref = &r->refs[i];
+    char dir[PATH_LEN];
+    char path[PATH_LEN];
+    int rc;
+
+    chunk_path(r->root, ref->id, dir, path);
+    rc = load_chunk(r, ref, path, r->scratch[worker], r->buf + r->offsets[i]);
+    if (rc != ENC_SUCCESS) {
+        set_error(&r->rc, rc);
+    }
+}
+
+/* ── Manifests ───────────────────────────────────────────────────── */
+
+static size_t manifest_aad(const char *name, uint32_t version, unsigned char *aad) {
+    const size_t len = strlen(name);
+
+    memcpy(aad, name, len);
+    aad[len] = '\0';
+    put_u32(aad + len + 1, version);
+    return len + 5;
+}
+
+/* Highest version number stored for name, 0 if none */
+static uint32_t latest_version(const char *root, const char *name) {
+    char dir[PATH_LEN];
+    struct dirent *ent;
+    uint32_t latest = 0;
+    DIR *d;
+
+    snprintf(dir, sizeof(dir), "%s/versions/%s", root, name);
+    d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    while ((ent = readdir(d)) != NULL) {
+        char *end = NULL;
+        unsigned long v = strtoul(ent->d_name, &end, 10);
+        if (ent->d_name[0] != '.' && *end == '\0' && v > latest && v <= UINT32_MAX) {
+            latest = (uint32_t)v;
+        }
+    }
+    closedir(d);
+    return latest;
+}
+
+static int write_manifest(const store_t *st, const char *root, const char *name,
+                          const chunk_ref_t *refs, uint64_t count, uint64_t bytes,
+                          uint32_t *version) {
+    const size_t plain_len = MANIFEST_FIXED_LEN + (size_t)count * MANIFEST_ENTRY_LEN;
+    unsigned char *plain = (unsigned char *)mem_alloc(plain_len);
+    unsigned char *sealed = (unsigned char *)mem_alloc(plain_len + ENC_BLOB_OVERHEAD);
+    unsigned char aad[256 + 5];
+    char dir[PATH_LEN];
+    char path[PATH_LEN + 16];
+    int rc = ENC_SUCCESS;
+
+    if (!plain || !sealed || count > UINT32_MAX) {
+        mem_free(plain);
+        mem_free(sealed);
+        return ENC_ERR_MEMORY;
+    }
+
+    memcpy(plain, MANIFEST_MAGIC, 4);
+    put_u32(plain + 4, MANIFEST_FORMAT);
+    put_u32(plain + 8, (uint32_t)(bytes >> 32));
+    put_u32(plain + 12, (uint32_t)bytes);
+    put_u32(plain + 16, (uint32_t)count);
+    for (uint64_t i = 0; i < count; i++) {
+        unsigned char *e = plain + MANIFEST_FIXED_LEN + i * MANIFEST_ENTRY_LEN;
+        memcpy(e, refs[i].id, ENC_BLOB_ID_LEN);
+        put_u32(e + ENC_BLOB_ID_LEN, refs[i].len);
+    }
+
+    snprintf(dir, sizeof(dir), "%s/versions/%s", root, name);
+
+    /* link() refuses an existing version, so concurrent puts each get their own */
+    for (uint32_t v = latest_version(root, name) + 1; rc == ENC_SUCCESS; v++) {
+        int created = 0;
+
+        snprintf(path, sizeof(path), "%s/%u", dir, v);
+        rc = enc_seal_blob(&st->keys, aad, manifest_aad(name, v, aad), plain, plain_len, sealed);
+        if (rc == ENC_SUCCESS) {
+            rc = publish(dir, path, sealed, plain_len + ENC_BLOB_OVERHEAD, 1, 0, &created);
+        }
+        if (rc == ENC_SUCCESS && created) {
+            *version = v;
+            break;
+        }
+    }
+
+    mem_free(plain);
+    mem_free(sealed);
+    return rc;
+}
+
+static int read_manifest(const store_t *st, const char *root, const char *name,
+                         uint32_t version, chunk_ref_t **out_refs, uint64_t *out_count,
+                         uint64_t *out_bytes) {
+    unsigned char aad[256 + 5];
+    char path[PATH_LEN];
+    unsigned char *sealed = NULL;
+    unsigned char *plain = NULL;
+    chunk_ref_t *refs = NULL;
+    size_t sealed_len = 0;
+    size_t plain_len = 0;
+    uint64_t total = 0;
+    int rc;
+
+    snprintf(path, sizeof(path), "%s/versions/%s/%u", root, name, version);
+    if (read_file(path, &sealed, &sealed_len) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+
+    plain = (unsigned char *)mem_alloc(sealed_len);
+    rc = plain ? enc_open_blob(&st->keys, aad, manifest_aad(name, version, aad), sealed,
+                               sealed_len, plain, &plain_len)
+               : ENC_ERR_MEMORY;
+    if (rc == ENC_SUCCESS &&
+        (plain_len < MANIFEST_FIXED_LEN || memcmp(plain, MANIFEST_MAGIC, 4) != 0 ||
+         get_u32(plain + 4) != MANIFEST_FORMAT ||
+         plain_len != MANIFEST_FIXED_LEN + (size_t)get_u32(plain + 16) * MANIFEST_ENTRY_LEN)) {
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+
+    const uint64_t count = rc == ENC_SUCCESS ? get_u32(plain + 16) : 0;
+    const uint64_t bytes = rc == ENC_SUCCESS
+        ? ((uint64_t)get_u32(plain + 8) << 32) | get_u32(plain + 12) : 0;
+
+    if (rc == ENC_SUCCESS) {
+        refs = (chunk_ref_t *)mem_alloc((count ? count : 1) * sizeof(*refs));
+        if (!refs) rc = ENC_ERR_MEMORY;
+    }
+    for (uint64_t i = 0; rc == ENC_SUCCESS && i < count; i++) {
+        const unsigned char *e = plain + MANIFEST_FIXED_LEN + i * MANIFEST_ENTRY_LEN;
+        memcpy(refs[i].id, e, ENC_BLOB_ID_LEN);
+        refs[i].len = get_u32(e + ENC_BLOB_ID_LEN);
+        if (refs[i].len == 0 || refs[i].len > CHUNK_MAX_SIZE) {
+            rc = ENC_ERR_INVALID_FORMAT;
+        }
+        total += refs[i].len;
+    }
+    if (rc == ENC_SUCCESS && total != bytes) {
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+
+    mem_free(sealed);
+    mem_free(plain);
+    if (rc != ENC_SUCCESS) {
+        mem_free(refs);
+        return rc;
+    }
+    *out_refs = refs;
+    *out_count = count;
+    *out_bytes = bytes;
+    return ENC_SUCCESS;
+}
+
+/* ── Put / get ───────────────────────────────────────────────────── */
+
+static unsigned char **scratch_alloc(int workers) {
+    unsigned char **scratch = (unsigned char **)mem_calloc((size_t)workers, sizeof(*scratch));
+
+    for (int i = 0; scratch && i < workers; i++) {
+        scratch[i] = (unsigned char *)secmem_alloc(CHUNK_SCRATCH);
+        if (!scratch[i]) {
+            for (int j = 0; j < i; j++) secmem_free(scratch[j]);
+            mem_free(scratch);
+            return NULL;
+        }
+    }
+    return scratch;
+}
+
+static void scratch_free(unsigned char **scratch, int workers) {
+    for (int i = 0; scratch && i < workers; i++) {
+        secmem_free(scratch[i]);
+    }
+    mem_free(scratch);
+}
+
+int chunk_put(const char *store, const char *name, const char *input, const char *passphrase,
+              const chunk_opts_t *opts, chunk_result_t *result) {
+    chunk_opts_t defaults;
+    chunk_result_t local;
+    store_t *st = NULL;
+    thread_pool_t *pool = NULL;
+    unsigned char **scratch = NULL;
+    unsigned char *buf = NULL;
+    size_t *offsets = NULL;
+    chunk_ref_t *refs = NULL;
+    uint64_t count = 0;
+    uint64_t cap = 0;
+    uint64_t in_size = 0;
+    int in_fd = -1;
+    int workers = 0;
+    int rc;
+
+    if (!store || !valid_name(name) || !input || !passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        chunk_opts_init(&defaults);
+        opts = &defaults;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    if (fio_open_input(input, &in_fd, &in_size) != FIO_SUCCESS) {
+        result->io_error = FIO_ERR_OPEN;
+        result->io_path = input;
+        return ENC_ERR_IO;
+    }
+
+    st = (store_t *)secmem_alloc(sizeof(*st));
+    rc = st ? store_open(store, passphrase, 1, opts->kdf_iterations, st) : ENC_ERR_MEMORY;
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+
+    pool = tp_create(opts->threads);
+    workers = tp_size(pool);
+    scratch = pool ? scratch_alloc(workers) : NULL;
+    buf = (unsigned char *)mem_alloc(CHUNK_WINDOW + CHUNK_MAX_SIZE);
+    offsets = (size_t *)mem_alloc(ROUND_CHUNKS * sizeof(*offsets));
+    if (!pool || !scratch || !buf || !offsets) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    round_t round = { .st = st, .root = store, .buf = buf, .offsets = offsets,
+                      .scratch = scratch };
+    size_t fill = 0;
+    int eof = 0;
+
+    for (;;) {
+        /* Top up the window; the tail of the last round is already at the front */
+        if (!eof) {
+            const size_t want = CHUNK_WINDOW + CHUNK_MAX_SIZE - fill;
+            size_t got = 0;
+
+            if (fio_read_full(in_fd, buf + fill, want, &got) != FIO_SUCCESS) {
+                result->io_error = FIO_ERR_READ;
+                result->io_path = input;
+                rc = ENC_ERR_IO;
+                goto cleanup;
+            }
+            fill += got;
+            eof = got < want;
+        }
+
+        if (count + ROUND_CHUNKS > cap) {
+            const uint64_t next = cap ? cap * 2 : 4 * ROUND_CHUNKS;
+            chunk_ref_t *grown = (chunk_ref_t *)mem_alloc(next * sizeof(*grown));
+            if (!grown) {
+                rc = ENC_ERR_MEMORY;
+                goto cleanup;
+            }
+            if (count) memcpy(grown, refs, count * sizeof(*grown));
+            mem_free(refs);
+            refs = grown;
+            cap = next;
+        }
+
+        /* A boundary needs CHUNK_MAX_SIZE of lookahead unless the input ended */
+        size_t pos = 0;
+        size_t n = 0;
+        while (pos < fill && (eof || fill - pos >= CHUNK_MAX_SIZE)) {
+            const size_t len = cut_point(st->gear, buf + pos, fill - pos);
+            offsets[n] = pos;
+            refs[count + n].len = (uint32_t)len;
+            pos += len;
+            n++;
+        }
+
+        round.refs = refs + count;
+        round.rc = ENC_SUCCESS;
+        tp_parallel_for(pool, n, put_task, &round);
+        if (round.rc != ENC_SUCCESS) {
+            rc = round.rc;
+            goto cleanup;
+        }
+        count += n;
+        result->bytes += pos;
+
+        memmove(buf, buf + pos, fill - pos);
+        fill -= pos;
+        if (eof && fill == 0) {
+            break;
+        }
+    }
+
+    result->chunks = count;
+    result->new_chunks = round.new_chunks;
+    result->new_bytes = round.new_bytes;
+
+    /* Chunks were written without fsync(); make them durable in one go
+     * before the manifest that references them. Reused chunks count too:
+     * the put that wrote one may have died before its own syncfs() */
+    if (round.new_chunks > 0 || round.reused > 0) {
+        int dir_fd = open(store, O_RDONLY | O_DIRECTORY);
+        if (dir_fd == -1 || fio_syncfs(dir_fd) != FIO_SUCCESS) {
+            rc = ENC_ERR_IO;
+        }
+        if (dir_fd != -1) close(dir_fd);
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    rc = write_manifest(st, store, name, refs, count, result->bytes, &result->version);
+
+cleanup:
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_error = result->io_error ? result->io_error : FIO_ERR_WRITE;
+        result->io_path = store;
+    }
+    fio_close(in_fd);
+    tp_destroy(pool);
+    scratch_free(scratch, workers);
+    mem_free(buf);
+    mem_free(offsets);
+    mem_free(refs);
+    secmem_free(st);
+    return rc;
+}
+
+int chunk_get(const char *store, const char *name, uint32_t version, const char *output,
+              const char *passphrase, const chunk_opts_t *opts, chunk_result_t *result) {
+    chunk_opts_t defaults;
+    chunk_result_t local;
+    store_t *st = NULL;
+    thread_pool_t *pool = NULL;
+    unsigned char **scratch = NULL;
+    unsigned char *buf = NULL;
+    size_t *offsets = NULL;
+    chunk_ref_t *refs = NULL;
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    char tmp[PATH_LEN + sizeof(FIO_TEMP_SUFFIX) + FIO_TEMP_ID_LEN];
+    int out_fd = -1;
+    int workers = 0;
+    int rc;
+
+    if (!store || !valid_name(name) || !output || !passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        chunk_opts_init(&defaults);
+        opts = &defaults;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    st = (store_t *)secmem_alloc(sizeof(*st));
+    rc = st ? store_open(store, passphrase, 0, 0, st) : ENC_ERR_MEMORY;
+    if (rc == ENC_SUCCESS && version == 0) {
+        version = latest_version(store, name);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = version ? read_manifest(st, store, name, version, &refs, &count, &bytes)
+                     : ENC_ERR_IO;
+    }
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+    result->version = version;
+
+    pool = tp_create(opts->threads);
+    workers = tp_size(pool);
+    scratch = pool ? scratch_alloc(workers) : NULL;
+    buf = (unsigned char *)mem_alloc(CHUNK_WINDOW + CHUNK_MAX_SIZE);
+    offsets = (size_t *)mem_alloc(ROUND_CHUNKS * sizeof(*offsets));
+    if (!pool || !scratch || !buf || !offsets) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    if (fio_open_temp(output, NULL, tmp, sizeof(tmp), &out_fd) != FIO_SUCCESS) {
+        result->io_error = FIO_ERR_OPEN;
+        result->io_path = output;
+        rc = ENC_ERR_IO;
+        goto cleanup;
+    }
+    /* The manifest gives the size: reserve it before fetching any chunk */
+    if (fio_preallocate(out_fd, 0, bytes) != FIO_SUCCESS) {
+        result->io_error = FIO_ERR_WRITE;
+        result->io_path = output;
+        rc = ENC_ERR_IO;
+        goto cleanup;
+    }
+
+    round_t round = { .st = st, .root = store, .buf = buf, .offsets = offsets,
+                      .scratch = scratch };
+
+    for (uint64_t i = 0; i < count;) {
+        size_t fill = 0;
+        size_t n = 0;
+
+        while (i + n < count && n < ROUND_CHUNKS && fill + refs[i + n].len <= CHUNK_WINDOW) {
+            offsets[n] = fill;
+            fill += refs[i + n].len;
+            n++;
+        }
+
+        round.refs = refs + i;
+        round.rc = ENC_SUCCESS;
+        tp_parallel_for(pool, n, get_task, &round);
+        if (round.rc != ENC_SUCCESS) {
+            rc = round.rc;
+            goto cleanup;
+        }
+        if (fio_write_full(out_fd, buf, fill) != FIO_SUCCESS) {
+            result->io_error = FIO_ERR_WRITE;
+            result->io_path = output;
+            rc = ENC_ERR_IO;
+            goto cleanup;
+        }
+        result->bytes += fill;
+        i += n;
+    }
+    result->chunks = count;
+
+cleanup:
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_error = FIO_ERR_READ;
+        result->io_path = store;
+    }
+    if (out_fd != -1 && rc != ENC_SUCCESS) {
+        fio_close(out_fd);
+    } else if (out_fd != -1) {
+        /* Renamed over output only once every chunk has authenticated */
+        const int io = fio_commit(out_fd, tmp, output, FIO_SYNC_NONE);
+        if (io != FIO_SUCCESS) {
+            result->io_error = io;
+            result->io_path = output;
+            rc = ENC_ERR_IO;
+        }
+    }
+    if (out_fd != -1 && rc != ENC_SUCCESS) {
+        unlink(tmp);  /* Never leave a partial or unauthenticated output */
+    }
+    tp_destroy(pool);
+    scratch_free(scratch, workers);
+    mem_free(buf);
+    mem_free(offsets);
+    mem_free(refs);
+    secmem_free(st);
+    return rc;
+}
@@ -1,27 +1,40 @@
 /*
- * encryption.c - AES-256-GCM + PBKDF2-SHA256 implementation
+ * encryption.c - AES-256-GCM / ChaCha20-Poly1305 / AES-256-CBC-HMAC
+ *                + PBKDF2-SHA256 implementation
  */
 
 #include "../include/encryption.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/stats.h"
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <openssl/evp.h>
 #include <openssl/crypto.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 
 #define PAYLOAD_MAGIC "FENC"
 #define PAYLOAD_MAGIC_LEN 4
-#define PAYLOAD_VERSION 1
-#define PBKDF2_ITERATIONS 250000
-#define SALT_LEN 16
-#define IV_LEN 12
+#define PAYLOAD_VERSION_V1 1
+#define PAYLOAD_VERSION_V2 2
+#define PAYLOAD_VERSION_V3 3
+#define PBKDF2_ITERATIONS ENC_DEFAULT_ITERATIONS
+#define SALT_LEN ENC_SALT_LEN
+#define IV_LEN ENC_NONCE_LEN
 #define TAG_LEN 16
-#define KEY_LEN 32
+#define KEY_LEN ENC_KEY_LEN
 #define FIXED_HEADER_LEN (PAYLOAD_MAGIC_LEN + 1 + 4 + SALT_LEN + IV_LEN + TAG_LEN)
 
+#define CBC_BLOCK_LEN 16
+#define HMAC_TAG_LEN 32
+#define SEGMENT_AAD_LEN (ENC_HEADER_LEN + 8 + 4)   /* Largest AAD (v2, generation > 0) */
+
 static void write_u32_be(unsigned char *buf, uint32_t value) {
     buf[0] = (unsigned char)((value >> 24) & 0xFF);
     buf[1] = (unsigned char)((value >> 16) & 0xFF);
@@ -29,149 +42,1443 @@ static void write_u32_be(unsigned char *buf, uint32_t value) {
     buf[3] = (unsigned char)(value & 0xFF);
 }
 
-static uint32_t read_u32_be(const unsigned char *buf) {
-    return ((uint32_t)buf[0] << 24) |
-           ((uint32_t)buf[1] << 16) |
-           ((uint32_t)buf[2] << 8) |
-           (uint32_t)buf[3];
+static uint32_t read_u32_be(const unsigned char *buf) {
+    return ((uint32_t)buf[0] << 24) |
+           ((uint32_t)buf[1] << 16) |
+           ((uint32_t)buf[2] << 8) |
+           (uint32_t)buf[3];
+}
+
+static void write_u64_be(unsigned char *buf, uint64_t value) {
+    write_u32_be(buf, (uint32_t)(value >> 32));
+    write_u32_be(buf + 4, (uint32_t)value);
+}
+
+static uint64_t read_u64_be(const unsigned char *buf) {
+    return ((uint64_t)read_u32_be(buf) << 32) | read_u32_be(buf + 4);
+}
+
+/* ── Algorithm table ─────────────────────────────────────────────── */
+
+static const struct {
+    int id;
+    const char *name;
+    const char *aliases[3];
+} ALGORITHMS[] = {
+    {ENC_ALG_AES_256_GCM, "AES-256-GCM", {"aes-gcm", "gcm", NULL}},
+    {ENC_ALG_CHACHA20_POLY1305, "ChaCha20-Poly1305", {"chacha20", "chacha", NULL}},
+    {ENC_ALG_AES_256_CBC_HMAC, "AES-256-CBC-HMAC", {"aes-cbc", "cbc", NULL}},
+};
+#define ALGORITHM_COUNT (sizeof(ALGORITHMS) / sizeof(ALGORITHMS[0]))
+
+int enc_alg_from_name(const char *name) {
+    if (!name) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < ALGORITHM_COUNT; i++) {
+        if (strcasecmp(name, ALGORITHMS[i].name) == 0) {
+            return ALGORITHMS[i].id;
+        }
+        for (int j = 0; ALGORITHMS[i].aliases[j]; j++) {
+            if (strcasecmp(name, ALGORITHMS[i].aliases[j]) == 0) {
+                return ALGORITHMS[i].id;
+            }
+        }
+    }
+    return ENC_ERR_INVALID_ARG;
+}
+
+const char *enc_alg_name(int algorithm) {
+    for (size_t i = 0; i < ALGORITHM_COUNT; i++) {
+        if (ALGORITHMS[i].id == algorithm) {
+            return ALGORITHMS[i].name;
+        }
+    }
+    return "Unknown";
+}
+
+static int alg_is_valid(int algorithm) {
+    return algorithm == ENC_ALG_AES_256_GCM ||
+           algorithm == ENC_ALG_CHACHA20_POLY1305 ||
+           algorithm == ENC_ALG_AES_256_CBC_HMAC;
+}
+
+/* ── Fetched algorithms and per-thread cipher contexts ───────────── */
+
+/*
+ * EVP_aes_256_gcm() and friends make OpenSSL 3 look the implementation
+ * up in the provider on every init. We fetch each algorithm once per
+ * process and keep one context per use per thread; a context that was
+ * last keyed with the same key only has its IV reloaded. Contexts live
+ * as long as their thread: stream runs take their workers from
+ * tp_acquire(), so the pool threads keep theirs from one file (or queued
+ * job) to the next, and a batch runs every file on its long-lived
+ * workers.
+ */
+static EVP_CIPHER *fetched_gcm = NULL;
+static EVP_CIPHER *fetched_chacha = NULL;
+static EVP_CIPHER *fetched_cbc = NULL;
+static EVP_CIPHER *fetched_ecb = NULL;
+static EVP_CIPHER *fetched_ctr = NULL;
+static EVP_MD *fetched_sha256 = NULL;
+static EVP_MAC *fetched_hmac = NULL;
+static pthread_once_t fetch_once = PTHREAD_ONCE_INIT;
+
+#define SLOT_AEAD  0   /* GCM / ChaCha20-Poly1305 segments, v1 payloads */
+#define SLOT_CBC   1
+#define SLOT_ECB   2   /* CBC IV derivation */
+#define SLOT_CTR   3   /* Keystream for overwrite patterns */
+#define SLOT_COUNT 4
+
+typedef struct {
+    EVP_CIPHER_CTX *ctx;
+    const EVP_CIPHER *cipher;     /* NULL until keyed */
+    int enc;
+    unsigned char key[KEY_LEN];   /* Key the schedule was built from */
+} ctx_slot_t;
+
+/* Lives in the locked pool because it holds key copies */
+typedef struct {
+    ctx_slot_t slots[SLOT_COUNT];
+    EVP_MAC_CTX *mac;
+} thread_ctx_t;
+
+static pthread_key_t thread_ctx_key;
+
+static void thread_ctx_free(void *raw) {
+    thread_ctx_t *tc = (thread_ctx_t *)raw;
+
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        EVP_CIPHER_CTX_free(tc->slots[i].ctx);
+    }
+    EVP_MAC_CTX_free(tc->mac);
+    secmem_free(tc);
+}
+
+static void fetch_algorithms(void) {
+    fetched_gcm = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+    fetched_chacha = EVP_CIPHER_fetch(NULL, "ChaCha20-Poly1305", NULL);
+    fetched_cbc = EVP_CIPHER_fetch(NULL, "AES-256-CBC", NULL);
+    fetched_ecb = EVP_CIPHER_fetch(NULL, "AES-256-ECB", NULL);
+    fetched_ctr = EVP_CIPHER_fetch(NULL, "AES-256-CTR", NULL);
+    fetched_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    fetched_hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    pthread_key_create(&thread_ctx_key, thread_ctx_free);
+}
+
+/* The calling thread's contexts, created on first use */
+static thread_ctx_t *thread_ctx(void) {
+    thread_ctx_t *tc;
+
+    pthread_once(&fetch_once, fetch_algorithms);
+    tc = (thread_ctx_t *)pthread_getspecific(thread_ctx_key);
+    if (tc) {
+        return tc;
+    }
+
+    tc = (thread_ctx_t *)secmem_alloc(sizeof(*tc));
+    if (!tc) {
+        return NULL;
+    }
+    memset(tc, 0, sizeof(*tc));
+    if (pthread_setspecific(thread_ctx_key, tc) != 0) {
+        secmem_free(tc);
+        return NULL;
+    }
+    return tc;
+}
+
+static const EVP_MD *sha256(void) {
+    pthread_once(&fetch_once, fetch_algorithms);
+    return fetched_sha256;
+}
+
+static const EVP_CIPHER *aead_cipher(int algorithm) {
+    pthread_once(&fetch_once, fetch_algorithms);
+    return (algorithm == ENC_ALG_CHACHA20_POLY1305) ? fetched_chacha : fetched_gcm;
+}
+
+/*
+ * Ready slot's context for cipher/key/direction with a fresh IV.
+ * Returns the context, or NULL on failure.
+ */
+static EVP_CIPHER_CTX *slot_init(int slot_id, const EVP_CIPHER *cipher,
+                                 const unsigned char *key, const unsigned char *iv, int enc) {
+    thread_ctx_t *tc = thread_ctx();
+    ctx_slot_t *slot;
+
+    if (!tc || !cipher) {
+        return NULL;
+    }
+    slot = &tc->slots[slot_id];
+    if (!slot->ctx && !(slot->ctx = EVP_CIPHER_CTX_new())) {
+        return NULL;
+    }
+
+    if (slot->cipher == cipher && slot->enc == enc &&
+        CRYPTO_memcmp(slot->key, key, KEY_LEN) == 0) {
+        /* Same key schedule: only the IV changes */
+        return EVP_CipherInit_ex(slot->ctx, NULL, NULL, NULL, iv, enc) == 1 ? slot->ctx : NULL;
+    }
+
+    slot->cipher = NULL;
+    if (EVP_CipherInit_ex(slot->ctx, cipher, NULL, key, iv, enc) != 1) {
+        return NULL;
+    }
+    slot->cipher = cipher;
+    slot->enc = enc;
+    memcpy(slot->key, key, KEY_LEN);
+    return slot->ctx;
+}
+
+/* ── Header ──────────────────────────────────────────────────────── */
+
+static void header_encode(enc_header_t *header) {
+    unsigned char *buf = header->raw;
+
+    memset(buf, 0, sizeof(header->raw));
+    memcpy(buf, PAYLOAD_MAGIC, PAYLOAD_MAGIC_LEN);
+    buf[4] = PAYLOAD_VERSION_V3;
+    buf[5] = (unsigned char)header->algorithm;
+    buf[6] = (unsigned char)header->slot_count;
+    write_u32_be(buf + 8, header->segment_size);
+    write_u64_be(buf + 12, header->plaintext_len);
+    memcpy(buf + 20, header->nonce, IV_LEN);
+
+    for (int i = 0; i < header->slot_count; i++) {
+        unsigned char *slot = buf + ENC_V3_FIXED_LEN + (size_t)i * ENC_SLOT_LEN;
+        const enc_slot_t *s = &header->slots[i];
+
+        write_u32_be(slot, s->iterations);
+        memcpy(slot + 4, s->salt, SALT_LEN);
+        memcpy(slot + 20, s->nonce, IV_LEN);
+        memcpy(slot + 32, s->wrapped, sizeof(s->wrapped));
+    }
+}
+
+int enc_header_init(
+    enc_header_t *header,
+    int algorithm,
+    uint32_t segment_size,
+    uint64_t plaintext_len,
+    int slot_count
+) {
+    if (!header || !alg_is_valid(algorithm)) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (segment_size == 0) segment_size = ENC_DEFAULT_SEGMENT_SIZE;
+    if (slot_count == 0) slot_count = 1;
+    if (segment_size < ENC_MIN_SEGMENT_SIZE || segment_size > ENC_MAX_SEGMENT_SIZE ||
+        slot_count < 1 || slot_count > ENC_MAX_SLOTS) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->version = PAYLOAD_VERSION_V3;
+    header->algorithm = algorithm;
+    header->segment_size = segment_size;
+    header->plaintext_len = plaintext_len;
+    header->slot_count = slot_count;
+    header->header_len = ENC_V3_FIXED_LEN + (size_t)slot_count * ENC_SLOT_LEN;
+    header->aad_len = ENC_V3_FIXED_LEN;
+
+    if (RAND_bytes(header->nonce, IV_LEN) != 1) {
+        return ENC_ERR_RANDOM;
+    }
+
+    header_encode(header);
+    return ENC_SUCCESS;
+}
+
+int enc_payload_version(const unsigned char *buf, size_t len) {
+    if (!buf || len < PAYLOAD_MAGIC_LEN + 1 || memcmp(buf, PAYLOAD_MAGIC, PAYLOAD_MAGIC_LEN) != 0) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    if (buf[4] == PAYLOAD_VERSION_V1 || buf[4] == PAYLOAD_VERSION_V2 ||
+        buf[4] == PAYLOAD_VERSION_V3) {
+        return buf[4];
+    }
+    return ENC_ERR_INVALID_FORMAT;
+}
+
+int enc_header_size(const unsigned char *buf, size_t len, size_t *header_len) {
+    if (!header_len || len < ENC_HEADER_PREFIX_LEN) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    switch (enc_payload_version(buf, len)) {
+        case PAYLOAD_VERSION_V2:
+            *header_len = ENC_HEADER_LEN;
+            return ENC_SUCCESS;
+        case PAYLOAD_VERSION_V3:
+            if (buf[6] < 1 || buf[6] > ENC_MAX_SLOTS) {
+                return ENC_ERR_INVALID_FORMAT;
+            }
+            *header_len = ENC_V3_FIXED_LEN + (size_t)buf[6] * ENC_SLOT_LEN;
+            return ENC_SUCCESS;
+        default:
+            return ENC_ERR_INVALID_FORMAT;
+    }
+}
+
+static int decode_v2(const unsigned char *buf, enc_header_t *header) {
+    header->algorithm = buf[5];
+    header->iterations = read_u32_be(buf + 8);
+    memcpy(header->salt, buf + 12, SALT_LEN);
+    header->segment_size = read_u32_be(buf + 28);
+    header->plaintext_len = read_u64_be(buf + 32);
+    memcpy(header->nonce, buf + 40, IV_LEN);
+    header->aad_len = ENC_HEADER_LEN;
+
+    if (buf[6] != 0 || buf[7] != 0 || header->iterations < ENC_MIN_ITERATIONS) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    return ENC_SUCCESS;
+}
+
+static int decode_v3(const unsigned char *buf, enc_header_t *header) {
+    header->algorithm = buf[5];
+    header->slot_count = buf[6];
+    header->segment_size = read_u32_be(buf + 8);
+    header->plaintext_len = read_u64_be(buf + 12);
+    memcpy(header->nonce, buf + 20, IV_LEN);
+    header->aad_len = ENC_V3_FIXED_LEN;
+
+    for (int i = 0; i < header->slot_count; i++) {
+        const unsigned char *slot = buf + ENC_V3_FIXED_LEN + (size_t)i * ENC_SLOT_LEN;
+        enc_slot_t *s = &header->slots[i];
+
+        s->iterations = read_u32_be(slot);
+        memcpy(s->salt, slot + 4, SALT_LEN);
+        memcpy(s->nonce, slot + 20, IV_LEN);
+        memcpy(s->wrapped, slot + 32, sizeof(s->wrapped));
+        if (s->iterations != 0 && s->iterations < ENC_MIN_ITERATIONS) {
+            return ENC_ERR_INVALID_FORMAT;
+        }
+    }
+
+    if (buf[7] != 0) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    for (int i = 32; i < ENC_V3_FIXED_LEN; i++) {
+        if (buf[i] != 0) {
+            return ENC_ERR_INVALID_FORMAT;
+        }
+    }
+    return ENC_SUCCESS;
+}
+
+int enc_header_decode(const unsigned char *buf, size_t len, enc_header_t *header) {
+    size_t header_len = 0;
+    int rc;
+
+    if (!buf || !header) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (enc_header_size(buf, len, &header_len) != ENC_SUCCESS || len < header_len) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->version = buf[4];
+    header->header_len = header_len;
+    memcpy(header->raw, buf, header_len);
+
+    rc = (header->version == PAYLOAD_VERSION_V2) ? decode_v2(buf, header) : decode_v3(buf, header);
+    if (rc != ENC_SUCCESS || !alg_is_valid(header->algorithm) ||
+        header->segment_size < ENC_MIN_SEGMENT_SIZE ||
+        header->segment_size > ENC_MAX_SEGMENT_SIZE) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    return ENC_SUCCESS;
+}
+
+uint64_t enc_segment_count(const enc_header_t *header) {
+    if (header->plaintext_len == 0) {
+        return 1;
+    }
+    return (header->plaintext_len + header->segment_size - 1) / header->segment_size;
+}
+
+size_t enc_sealed_len(int algorithm, size_t plaintext_len) {
+    if (algorithm == ENC_ALG_AES_256_CBC_HMAC) {
+        /* PKCS#7 always adds 1..16 bytes of padding */
+        return (plaintext_len / CBC_BLOCK_LEN + 1) * CBC_BLOCK_LEN + HMAC_TAG_LEN;
+    }
+    return plaintext_len + TAG_LEN;
+}
+
+uint64_t enc_payload_size(const enc_header_t *header) {
+    const uint64_t segments = enc_segment_count(header);
+    const uint64_t last_len = header->plaintext_len - (segments - 1) * header->segment_size;
+
+    return header->header_len +
+           (segments - 1) * enc_sealed_len(header->algorithm, header->segment_size) +
+           enc_sealed_len(header->algorithm, (size_t)last_len);
+}
+
+/* ── Keys ────────────────────────────────────────────────────────── */
+
+static int pbkdf2(const char *passphrase, const unsigned char *salt, uint32_t iterations,
+                  unsigned char *key) {
+    stats_timer_t timer;
+    int ok;
+
+    stats_begin(&timer);
+    ok = PKCS5_PBKDF2_HMAC(
+        passphrase,
+        (int)strlen(passphrase),
+        salt,
+        SALT_LEN,
+        (int)iterations,
+        sha256(),
+        KEY_LEN,
+        key
+    );
+    stats_end(&timer, STATS_KDF, 0, 1);
+
+    return ok == 1 ? ENC_SUCCESS : ENC_ERR_KEY_DERIVATION;
+}
+
+/* Expand a master key (v2: PBKDF2 output, v3: data key) into the file's keys */
+static int expand_key(const unsigned char *master, int algorithm, enc_key_t *key) {
+    unsigned int len = KEY_LEN;
+
+    memset(key, 0, sizeof(*key));
+    key->algorithm = algorithm;
+
+    if (algorithm == ENC_ALG_AES_256_CBC_HMAC) {
+        /* Independent encryption and MAC keys for encrypt-then-MAC */
+        static const char enc_label[] = "FENC-CBC-ENC";
+        static const char mac_label[] = "FENC-CBC-MAC";
+
+        if (!HMAC(sha256(), master, KEY_LEN, (const unsigned char *)enc_label,
+                  sizeof(enc_label) - 1, key->key, &len) ||
+            !HMAC(sha256(), master, KEY_LEN, (const unsigned char *)mac_label,
+                  sizeof(mac_label) - 1, key->mac_key, &len)) {
+            enc_key_wipe(key);
+            return ENC_ERR_KEY_DERIVATION;
+        }
+        return ENC_SUCCESS;
+    }
+
+    memcpy(key->key, master, KEY_LEN);
+    return ENC_SUCCESS;
+}
+
+int enc_kek_derive(const char *passphrase, const unsigned char *salt, uint32_t iterations,
+                   enc_kek_t *kek) {
+    if (!passphrase || !kek) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (iterations == 0) iterations = PBKDF2_ITERATIONS;
+    if (iterations < ENC_MIN_ITERATIONS) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    kek->iterations = iterations;
+    if (salt) {
+        memcpy(kek->salt, salt, SALT_LEN);
+    } else if (RAND_bytes(kek->salt, SALT_LEN) != 1) {
+        return ENC_ERR_RANDOM;
+    }
+
+    int rc = pbkdf2(passphrase, kek->salt, iterations, kek->key);
+    if (rc != ENC_SUCCESS) {
+        enc_kek_wipe(kek);
+    }
+    return rc;
+}
+
+void enc_kek_wipe(enc_kek_t *kek) {
+    if (kek) {
+        OPENSSL_cleanse(kek, sizeof(*kek));
+    }
+}
+
+/* Seal master into slot with kek under a fresh wrap nonce */
+static int wrap_slot(enc_header_t *header, int slot, const enc_kek_t *kek,
+                     const unsigned char *master) {
+    enc_slot_t *s = &header->slots[slot];
+    EVP_CIPHER_CTX *ctx;
+    int len = 0;
+    int final_len = 0;
+
+    if (RAND_bytes(s->nonce, IV_LEN) != 1) {
+        return ENC_ERR_RANDOM;
+    }
+    s->iterations = kek->iterations;
+    memcpy(s->salt, kek->salt, SALT_LEN);
+
+    ctx = slot_init(SLOT_AEAD, aead_cipher(ENC_ALG_AES_256_GCM), kek->key, s->nonce, 1);
+    if (!ctx ||
+        EVP_EncryptUpdate(ctx, NULL, &len, header->raw, ENC_V3_FIXED_LEN) != 1 ||
+        EVP_EncryptUpdate(ctx, s->wrapped, &len, master, KEY_LEN) != 1 ||
+        EVP_EncryptFinal_ex(ctx, s->wrapped + KEY_LEN, &final_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, TAG_LEN, s->wrapped + KEY_LEN) != 1) {
+        memset(s, 0, sizeof(*s));
+        return ENC_ERR_ENCRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+/* Open slot with kek into master; ENC_ERR_DECRYPT if it does not match */
+static int unwrap_slot(const enc_header_t *header, int slot, const enc_kek_t *kek,
+                       unsigned char *master) {
+    const enc_slot_t *s = &header->slots[slot];
+    EVP_CIPHER_CTX *ctx;
+    int len = 0;
+    int final_len = 0;
+
+    if (s->iterations == 0 || s->iterations != kek->iterations ||
+        CRYPTO_memcmp(s->salt, kek->salt, SALT_LEN) != 0) {
+        return ENC_ERR_DECRYPT;
+    }
+
+    ctx = slot_init(SLOT_AEAD, aead_cipher(ENC_ALG_AES_256_GCM), kek->key, s->nonce, 0);
+    if (!ctx ||
+        EVP_DecryptUpdate(ctx, NULL, &len, header->raw, ENC_V3_FIXED_LEN) != 1 ||
+        EVP_DecryptUpdate(ctx, master, &len, s->wrapped, KEY_LEN) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, TAG_LEN,
+                            (void *)(s->wrapped + KEY_LEN)) != 1 ||
+        EVP_DecryptFinal_ex(ctx, master + len, &final_len) != 1) {
+        OPENSSL_cleanse(master, KEY_LEN);
+        return ENC_ERR_DECRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+int enc_generate_key(enc_header_t *header, const enc_kek_t *kek, enc_key_t *key) {
+    unsigned char *master;
+    int rc;
+
+    if (!header || !kek || !key || header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    master = (unsigned char *)secmem_alloc(KEY_LEN);
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+
+    rc = RAND_bytes(master, KEY_LEN) == 1 ? ENC_SUCCESS : ENC_ERR_RANDOM;
+    if (rc == ENC_SUCCESS) {
+        rc = wrap_slot(header, 0, kek, master);
+    }
+    if (rc == ENC_SUCCESS) {
+        header_encode(header);
+        rc = expand_key(master, header->algorithm, key);
+    }
+
+    secmem_free(master);
+    return rc;
+}
+
+int enc_unwrap_key(const enc_header_t *header, const enc_kek_t *kek, enc_key_t *key, int *slot) {
+    unsigned char *master;
+    int rc = ENC_ERR_DECRYPT;
+
+    if (!header || !kek || !key || header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    master = (unsigned char *)secmem_alloc(KEY_LEN);
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+
+    for (int i = 0; i < header->slot_count; i++) {
+        if (unwrap_slot(header, i, kek, master) == ENC_SUCCESS) {
+            rc = expand_key(master, header->algorithm, key);
+            if (slot) *slot = i;
+            break;
+        }
+    }
+
+    secmem_free(master);
+    return rc;
+}
+
+int enc_rewrap_slot(enc_header_t *header, int slot, const enc_kek_t *old_kek,
+                    const enc_kek_t *new_kek) {
+    unsigned char *master;
+    int rc;
+
+    if (!header || !old_kek || !new_kek || header->version != PAYLOAD_VERSION_V3 ||
+        slot < 0 || slot >= header->slot_count) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    master = (unsigned char *)secmem_alloc(KEY_LEN);
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+
+    rc = unwrap_slot(header, slot, old_kek, master);
+    if (rc == ENC_SUCCESS) {
+        rc = wrap_slot(header, slot, new_kek, master);
+    }
+    if (rc == ENC_SUCCESS) {
+        header_encode(header);
+    }
+
+    secmem_free(master);
+    return rc;
+}
+
+int enc_add_slot(enc_header_t *header, const enc_kek_t *kek, const enc_kek_t *new_kek,
+                 int *slot) {
+    unsigned char *master;
+    int free_slot = -1;
+    int rc = ENC_ERR_DECRYPT;
+
+    if (!header || !kek || !new_kek || header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < header->slot_count && free_slot < 0; i++) {
+        if (header->slots[i].iterations == 0) free_slot = i;
+    }
+    if (free_slot < 0) {
+        return ENC_ERR_NO_SLOT;
+    }
+
+    master = (unsigned char *)secmem_alloc(KEY_LEN);
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+
+    for (int i = 0; i < header->slot_count && rc != ENC_SUCCESS; i++) {
+        rc = unwrap_slot(header, i, kek, master);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = wrap_slot(header, free_slot, new_kek, master);
+    }
+    if (rc == ENC_SUCCESS) {
+        header_encode(header);
+        if (slot) *slot = free_slot;
+    }
+
+    secmem_free(master);
+    return rc;
+}
+
+int enc_remove_slot(enc_header_t *header, int slot) {
+    int used = 0;
+
+    if (!header || header->version != PAYLOAD_VERSION_V3 ||
+        slot < 0 || slot >= header->slot_count || header->slots[slot].iterations == 0) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < header->slot_count; i++) {
+        used += header->slots[i].iterations != 0;
+    }
+    if (used == 1) {
+        return ENC_ERR_LAST_SLOT;
+    }
+
+    memset(&header->slots[slot], 0, sizeof(header->slots[slot]));
+    header_encode(header);
+    return ENC_SUCCESS;
+}
+
+/*
+ * Find the slot passphrase opens, deriving one KEK per distinct
+ * salt/iterations pair. kek receives the KEK that matched.
+ */
+static int open_with_passphrase(const enc_header_t *header, const char *passphrase,
+                                enc_kek_t *kek, enc_key_t *key, int *slot) {
+    int rc = ENC_ERR_DECRYPT;
+
+    for (int i = 0; i < header->slot_count; i++) {
+        const enc_slot_t *s = &header->slots[i];
+        int seen = 0;
+
+        if (s->iterations == 0) {
+            continue;
+        }
+        for (int j = 0; j < i; j++) {
+            if (header->slots[j].iterations == s->iterations &&
+                memcmp(header->slots[j].salt, s->salt, SALT_LEN) == 0) {
+                seen = 1;   /* Same KEK as an earlier slot, already tried */
+                break;
+            }
+        }
+        if (seen) {
+            continue;
+        }
+
+        rc = enc_kek_derive(passphrase, s->salt, s->iterations, kek);
+        if (rc != ENC_SUCCESS) {
+            return rc;
+        }
+        rc = enc_unwrap_key(header, kek, key, slot);
+        if (rc != ENC_ERR_DECRYPT) {
+            return rc;
+        }
+        enc_kek_wipe(kek);
+    }
+    return ENC_ERR_DECRYPT;
+}
+
+int enc_derive_key(const char *passphrase, const enc_header_t *header, enc_key_t *key) {
+    if (!passphrase || !header || !key) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    int rc;
+
+    if (header->version == PAYLOAD_VERSION_V3) {
+        enc_kek_t *kek = (enc_kek_t *)secmem_alloc(sizeof(enc_kek_t));
+        if (!kek) {
+            return ENC_ERR_MEMORY;
+        }
+        rc = open_with_passphrase(header, passphrase, kek, key, NULL);
+        secmem_free(kek);  /* Wipes it */
+        return rc;
+    }
+
+    unsigned char *master = (unsigned char *)secmem_alloc(KEY_LEN);
+    if (!master) {
+        return ENC_ERR_MEMORY;
+    }
+    rc = pbkdf2(passphrase, header->salt, header->iterations, master);
+    if (rc == ENC_SUCCESS) {
+        rc = expand_key(master, header->algorithm, key);
+    }
+    secmem_free(master);  /* Wipes it */
+    return rc;
+}
+
+void enc_key_wipe(enc_key_t *key) {
+    if (key) {
+        OPENSSL_cleanse(key, sizeof(*key));
+    }
+}
+
+int enc_rekey_header(enc_header_t *header, const char *old_passphrase,
+                     const char *new_passphrase, uint32_t iterations) {
+    enc_kek_t *old_kek;
+    enc_kek_t *new_kek;
+    enc_key_t *key;
+    int slot = -1;
+    int rc;
+
+    if (!header || !old_passphrase || !new_passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    /* One locked block for both KEKs and the scratch data key */
+    old_kek = (enc_kek_t *)secmem_alloc(2 * sizeof(enc_kek_t) + sizeof(enc_key_t));
+    if (!old_kek) {
+        return ENC_ERR_MEMORY;
+    }
+    new_kek = old_kek + 1;
+    key = (enc_key_t *)(new_kek + 1);
+
+    rc = open_with_passphrase(header, old_passphrase, old_kek, key, &slot);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_kek_derive(new_passphrase, NULL, iterations, new_kek);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = enc_rewrap_slot(header, slot, old_kek, new_kek);
+    }
+
+    secmem_free(old_kek);
+    return rc;
+}
+
+int enc_add_recipient(enc_header_t *header, const char *passphrase,
+                      const char *new_passphrase, uint32_t iterations, int *slot) {
+    enc_kek_t *kek;
+    enc_kek_t *new_kek;
+    enc_key_t *key;
+    int rc;
+
+    if (!header || !passphrase || !new_passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    kek = (enc_kek_t *)secmem_alloc(2 * sizeof(enc_kek_t) + sizeof(enc_key_t));
+    if (!kek) {
+        return ENC_ERR_MEMORY;
+    }
+    new_kek = kek + 1;
+    key = (enc_key_t *)(new_kek + 1);
+
+    rc = open_with_passphrase(header, passphrase, kek, key, NULL);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_kek_derive(new_passphrase, NULL, iterations, new_kek);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = enc_add_slot(header, kek, new_kek, slot);
+    }
+
+    secmem_free(kek);
+    return rc;
+}
+
+int enc_remove_recipient(enc_header_t *header, const char *passphrase, int *slot) {
+    enc_kek_t *kek;
+    enc_key_t *key;
+    int found = -1;
+    int rc;
+
+    if (!header || !passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (header->version != PAYLOAD_VERSION_V3) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    kek = (enc_kek_t *)secmem_alloc(sizeof(enc_kek_t) + sizeof(enc_key_t));
+    if (!kek) {
+        return ENC_ERR_MEMORY;
+    }
+    key = (enc_key_t *)(kek + 1);
+
+    rc = open_with_passphrase(header, passphrase, kek, key, &found);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_remove_slot(header, found);
+    }
+    if (rc == ENC_SUCCESS && slot) {
+        *slot = found;
+    }
+
+    secmem_free(kek);
+    return rc;
+}
+
+/* ── Segments ────────────────────────────────────────────────────── */
+
+/* nonce = header nonce XOR (0^4 || index) at generation 0, else the
+ * random nonce drawn when the segment was resealed */
+static void segment_nonce(const enc_header_t *header, uint64_t index, const enc_gen_t *gen,
+                          unsigned char *nonce) {
+    if (gen->generation > 0) {
+        memcpy(nonce, gen->nonce, IV_LEN);
+        return;
+    }
+    memcpy(nonce, header->nonce, IV_LEN);
+    for (int i = 0; i < 8; i++) {
+        nonce[IV_LEN - 1 - i] ^= (unsigned char)(index >> (8 * i));
+    }
+}
+
+/* AAD = the header's immutable bytes || index [|| generation if > 0];
+ * returns its length */
+static int segment_aad(const enc_header_t *header, uint64_t index, const enc_gen_t *gen,
+                       unsigned char *aad) {
+    memcpy(aad, header->raw, header->aad_len);
+    write_u64_be(aad + header->aad_len, index);
+    if (gen->generation == 0) {
+        return (int)header->aad_len + 8;
+    }
+    write_u32_be(aad + header->aad_len + 8, gen->generation);
+    return (int)header->aad_len + 12;
+}
+
+static int aead_seal(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                     const enc_gen_t *gen, const unsigned char *in, size_t in_len, unsigned char *out) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char nonce[IV_LEN];
+    unsigned char aad[SEGMENT_AAD_LEN];
+    int out_len = 0;
+    int final_len = 0;
+
+    /* Both AEADs default to the 12-byte nonce we use */
+    segment_nonce(header, index, gen, nonce);
+    const int aad_len = segment_aad(header, index, gen, aad);
+    ctx = slot_init(SLOT_AEAD, aead_cipher(key->algorithm), key->key, nonce, 1);
+
+    if (!ctx ||
+        EVP_EncryptUpdate(ctx, NULL, &out_len, aad, aad_len) != 1 ||
+        (in_len > 0 && EVP_EncryptUpdate(ctx, out, &out_len, in, (int)in_len) != 1) ||
+        EVP_EncryptFinal_ex(ctx, out + in_len, &final_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, TAG_LEN, out + in_len) != 1) {
+        return ENC_ERR_ENCRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+static int aead_open(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                     const enc_gen_t *gen, const unsigned char *in, size_t in_len, unsigned char *out) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char nonce[IV_LEN];
+    unsigned char aad[SEGMENT_AAD_LEN];
+    const size_t ct_len = in_len - TAG_LEN;
+    int out_len = 0;
+    int final_len = 0;
+
+    segment_nonce(header, index, gen, nonce);
+    const int aad_len = segment_aad(header, index, gen, aad);
+    ctx = slot_init(SLOT_AEAD, aead_cipher(key->algorithm), key->key, nonce, 0);
+
+    if (!ctx ||
+        EVP_DecryptUpdate(ctx, NULL, &out_len, aad, aad_len) != 1 ||
+        (ct_len > 0 && EVP_DecryptUpdate(ctx, out, &out_len, in, (int)ct_len) != 1) ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, TAG_LEN, (void *)(in + ct_len)) != 1 ||
+        EVP_DecryptFinal_ex(ctx, out + ct_len, &final_len) != 1) {
+        return ENC_ERR_DECRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+/* CBC IV = AES-ECB(enc_key, segment_nonce || 0^4): unique and unpredictable */
+static int cbc_iv(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                  const enc_gen_t *gen, unsigned char *iv) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char block[CBC_BLOCK_LEN] = {0};
+    int len = 0;
+
+    pthread_once(&fetch_once, fetch_algorithms);
+    segment_nonce(header, index, gen, block);
+    ctx = slot_init(SLOT_ECB, fetched_ecb, key->key, NULL, 1);
+
+    if (!ctx ||
+        EVP_CIPHER_CTX_set_padding(ctx, 0) != 1 ||
+        EVP_EncryptUpdate(ctx, iv, &len, block, CBC_BLOCK_LEN) != 1) {
+        return ENC_ERR_ENCRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+static int cbc_mac(const enc_key_t *key, const unsigned char *aad, size_t aad_len,
+                   const unsigned char *ct, size_t ct_len, unsigned char *tag) {
+    thread_ctx_t *tc = thread_ctx();
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string("digest", "SHA256", 0),
+        OSSL_PARAM_construct_end()
+    };
+    size_t tag_len = 0;
+
+    if (!tc || !fetched_hmac) {
+        return ENC_ERR_ENCRYPT;
+    }
+    if (!tc->mac && !(tc->mac = EVP_MAC_CTX_new(fetched_hmac))) {
+        return ENC_ERR_MEMORY;
+    }
+
+    if (EVP_MAC_init(tc->mac, key->mac_key, KEY_LEN, params) != 1 ||
+        EVP_MAC_update(tc->mac, aad, aad_len) != 1 ||
+        EVP_MAC_update(tc->mac, ct, ct_len) != 1 ||
+        EVP_MAC_final(tc->mac, tag, &tag_len, HMAC_TAG_LEN) != 1) {
+        return ENC_ERR_ENCRYPT;
+    }
+    return ENC_SUCCESS;
+}
+
+static int cbc_seal(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                    const enc_gen_t *gen, const unsigned char *in, size_t in_len, unsigned char *out) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char iv[CBC_BLOCK_LEN];
+    unsigned char aad[SEGMENT_AAD_LEN];
+    const size_t ct_len = enc_sealed_len(ENC_ALG_AES_256_CBC_HMAC, in_len) - HMAC_TAG_LEN;
+    int out_len = 0;
+    int final_len = 0;
+    int rc = cbc_iv(header, key, index, gen, iv);
+
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    ctx = slot_init(SLOT_CBC, fetched_cbc, key->key, iv, 1);
+    if (!ctx ||
+        (in_len > 0 && EVP_EncryptUpdate(ctx, out, &out_len, in, (int)in_len) != 1) ||
+        EVP_EncryptFinal_ex(ctx, out + out_len, &final_len) != 1 ||
+        (size_t)(out_len + final_len) != ct_len) {
+        return ENC_ERR_ENCRYPT;
+    }
+
+    const int aad_len = segment_aad(header, index, gen, aad);
+    return cbc_mac(key, aad, (size_t)aad_len, out, ct_len, out + ct_len);
 }
 
-int aes_encrypt_payload(
-    const unsigned char *plaintext,
-    size_t plaintext_len,
-    const char *passphrase,
-    unsigned char **out_payload,
-    size_t *out_payload_len
+static int cbc_open(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                    const enc_gen_t *gen, const unsigned char *in, size_t in_len, unsigned char *out,
+                    size_t *out_len) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char iv[CBC_BLOCK_LEN];
+    unsigned char aad[SEGMENT_AAD_LEN];
+    unsigned char tag[HMAC_TAG_LEN];
+    const size_t ct_len = in_len - HMAC_TAG_LEN;
+    int len = 0;
+    int final_len = 0;
+    int rc;
+
+    if (ct_len == 0 || ct_len % CBC_BLOCK_LEN != 0) {
+        return ENC_ERR_DECRYPT;
+    }
+
+    /* Encrypt-then-MAC: authenticate before touching the ciphertext */
+    const int aad_len = segment_aad(header, index, gen, aad);
+    if (cbc_mac(key, aad, (size_t)aad_len, in, ct_len, tag) != ENC_SUCCESS ||
+        CRYPTO_memcmp(tag, in + ct_len, HMAC_TAG_LEN) != 0) {
+        return ENC_ERR_DECRYPT;
+    }
+
+    rc = cbc_iv(header, key, index, gen, iv);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    ctx = slot_init(SLOT_CBC, fetched_cbc, key->key, iv, 0);
+    if (!ctx ||
+        EVP_DecryptUpdate(ctx, out, &len, in, (int)ct_len) != 1 ||
+        EVP_DecryptFinal_ex(ctx, out + len, &final_len) != 1) {
+        return ENC_ERR_DECRYPT;
+    }
+
+    *out_len = (size_t)(len + final_len);
+    return ENC_SUCCESS;
+}
+
+static int seal_any(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                    const enc_gen_t *gen, const unsigned char *in, size_t in_len,
+                    unsigned char *out) {
+    return (header->algorithm == ENC_ALG_AES_256_CBC_HMAC)
+        ? cbc_seal(header, key, index, gen, in, in_len, out)
+        : aead_seal(header, key, index, gen, in, in_len, out);
+}
+
+static int open_any(const enc_header_t *header, const enc_key_t *key, uint64_t index,
+                    const enc_gen_t *gen, const unsigned char *in, size_t in_len,
+                    unsigned char *out, size_t *out_len) {
+    int rc;
+
+    *out_len = 0;
+    if (header->algorithm == ENC_ALG_AES_256_CBC_HMAC) {
+        if (in_len < CBC_BLOCK_LEN + HMAC_TAG_LEN) {
+            return ENC_ERR_INVALID_FORMAT;
+        }
+        return cbc_open(header, key, index, gen, in, in_len, out, out_len);
+    }
+
+    if (in_len < TAG_LEN) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    rc = aead_open(header, key, index, gen, in, in_len, out);
+    if (rc == ENC_SUCCESS) {
+        *out_len = in_len - TAG_LEN;
+    }
+    return rc;
+}
+
+int enc_seal_segment_gen(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const enc_gen_t *gen,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
 ) {
-    if (!passphrase || !out_payload || !out_payload_len) {
+    static const enc_gen_t first = {0};
+
+    if (!header || !key || !out || !out_len || (!in && in_len != 0) ||
+        in_len > header->segment_size || key->algorithm != header->algorithm ||
+        index == ENC_INDEX_SEGMENT || (gen && gen->generation == ENC_GEN_HOLE)) {
         return ENC_ERR_INVALID_ARG;
     }
 
-    if (!plaintext && plaintext_len != 0) {
+    stats_timer_t timer;
+    stats_begin(&timer);
+
+    int rc = seal_any(header, key, index, gen ? gen : &first, in, in_len, out);
+
+    stats_end(&timer, STATS_CRYPTO, in_len, 1);
+    *out_len = (rc == ENC_SUCCESS) ? enc_sealed_len(header->algorithm, in_len) : 0;
+    return rc;
+}
+
+int enc_open_segment_gen(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const enc_gen_t *gen,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+) {
+    static const enc_gen_t first = {0};
+    const int hole = gen && gen->generation == ENC_GEN_HOLE;
+
+    if (!header || !key || (!in && !hole) || !out || !out_len ||
+        key->algorithm != header->algorithm || index == ENC_INDEX_SEGMENT) {
         return ENC_ERR_INVALID_ARG;
     }
 
-    int rc = ENC_ERR_ENCRYPT;
-    EVP_CIPHER_CTX *ctx = NULL;
-    unsigned char salt[SALT_LEN];
-    unsigned char iv[IV_LEN];
-    unsigned char key[KEY_LEN];
-    unsigned char tag[TAG_LEN];
-    unsigned char *payload = NULL;
-    unsigned char *ciphertext = NULL;
+    if (hole) {
+        /* Nothing was stored; the authenticated index vouches for the zeros */
+        if (index >= enc_segment_count(header)) {
+            return ENC_ERR_INVALID_FORMAT;
+        }
+        const uint64_t left = header->plaintext_len - index * header->segment_size;
+        *out_len = left < header->segment_size ? (size_t)left : header->segment_size;
+        memset(out, 0, *out_len);
+        return ENC_SUCCESS;
+    }
+
+    stats_timer_t timer;
+    stats_begin(&timer);
+
+    int rc = open_any(header, key, index, gen ? gen : &first, in, in_len, out, out_len);
+
+    stats_end(&timer, STATS_CRYPTO, in_len, 1);
+    return rc;
+}
+
+int enc_seal_segment(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+) {
+    return enc_seal_segment_gen(header, key, index, NULL, in, in_len, out, out_len);
+}
+
+int enc_open_segment(
+    const enc_header_t *header,
+    const enc_key_t *key,
+    uint64_t index,
+    const unsigned char *in,
+    size_t in_len,
+    unsigned char *out,
+    size_t *out_len
+) {
+    return enc_open_segment_gen(header, key, index, NULL, in, in_len, out, out_len);
+}
+
+int enc_next_gen(const enc_gen_t *current, enc_gen_t *next) {
+    if (!current || !next) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    /* A hole was never sealed, so its first reseal starts over at 1 */
+    const uint32_t generation = (current->generation == ENC_GEN_HOLE) ? 1 : current->generation + 1;
+    if (generation == ENC_GEN_HOLE) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    if (RAND_bytes(next->nonce, IV_LEN) != 1) {
+        return ENC_ERR_RANDOM;
+    }
+    next->generation = generation;
+    return ENC_SUCCESS;
+}
+
+/* ── Segment index ───────────────────────────────────────────────── */
+
+uint64_t enc_index_size(const enc_header_t *header) {
+    return enc_sealed_len(header->algorithm,
+                          (size_t)enc_segment_count(header) * ENC_INDEX_ENTRY_LEN) +
+           ENC_INDEX_FOOTER_LEN;
+}
+
+int enc_seal_index(const enc_header_t *header, const enc_key_t *key, uint32_t epoch,
+                   const enc_gen_t *generations, unsigned char *out) {
+    if (!header || !key || !generations || !out || epoch == 0 || epoch == ENC_GEN_HOLE ||
+        key->algorithm != header->algorithm) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    const uint64_t segments = enc_segment_count(header);
+    const size_t table_len = (size_t)segments * ENC_INDEX_ENTRY_LEN;
+    unsigned char *table = (unsigned char *)mem_alloc(table_len);
+    enc_gen_t self = { .generation = epoch };
+    int rc;
+
+    if (!table) {
+        return ENC_ERR_MEMORY;
+    }
+    for (uint64_t i = 0; i < segments; i++) {
+        unsigned char *entry = table + i * ENC_INDEX_ENTRY_LEN;
+        write_u32_be(entry, generations[i].generation);
+        memcpy(entry + 4, generations[i].nonce, IV_LEN);
+    }
+
+    /* Sealed as one more segment, at generation epoch under a fresh nonce */
+    rc = (RAND_bytes(self.nonce, IV_LEN) == 1) ? ENC_SUCCESS : ENC_ERR_RANDOM;
+    if (rc == ENC_SUCCESS) {
+        rc = seal_any(header, key, ENC_INDEX_SEGMENT, &self, table, table_len, out);
+    }
+    if (rc == ENC_SUCCESS) {
+        const size_t sealed = enc_sealed_len(header->algorithm, table_len);
+        memcpy(out + sealed, self.nonce, IV_LEN);
+        write_u32_be(out + sealed + IV_LEN, epoch);
+        memcpy(out + sealed + IV_LEN + 4, ENC_INDEX_MAGIC, 4);
+    }
+
+    mem_free(table);
+    return rc;
+}
+
+int enc_open_index(const enc_header_t *header, const enc_key_t *key, const unsigned char *in,
+                   size_t in_len, enc_gen_t *generations, uint32_t *epoch) {
+    if (!header || !key || !in || !generations || !epoch ||
+        key->algorithm != header->algorithm) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (in_len != enc_index_size(header) ||
+        memcmp(in + in_len - 4, ENC_INDEX_MAGIC, 4) != 0) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    const uint64_t segments = enc_segment_count(header);
+    const size_t sealed = in_len - ENC_INDEX_FOOTER_LEN;
+    enc_gen_t self = { .generation = read_u32_be(in + sealed + IV_LEN) };
+    unsigned char *table = NULL;
+    size_t table_len = 0;
+    int rc;
+
+    if (self.generation == 0 || self.generation == ENC_GEN_HOLE) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    memcpy(self.nonce, in + sealed, IV_LEN);
+
+    table = (unsigned char *)mem_alloc(sealed);
+    if (!table) {
+        return ENC_ERR_MEMORY;
+    }
+
+    rc = open_any(header, key, ENC_INDEX_SEGMENT, &self, in, sealed, table, &table_len);
+    if (rc == ENC_SUCCESS && table_len != segments * ENC_INDEX_ENTRY_LEN) {
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+    if (rc == ENC_SUCCESS) {
+        for (uint64_t i = 0; i < segments; i++) {
+            const unsigned char *entry = table + i * ENC_INDEX_ENTRY_LEN;
+            generations[i].generation = read_u32_be(entry);
+            memcpy(generations[i].nonce, entry + 4, IV_LEN);
+        }
+        *epoch = self.generation;
+    }
+
+    mem_free(table);
+    return rc;
+}
+
+/* ── Blobs ───────────────────────────────────────────────────────── */
+
+int enc_blob_keys(const enc_key_t *master, enc_key_t *keys) {
+    static const char enc_label[] = "FENC-BLOB-ENC";
+    static const char id_label[] = "FENC-BLOB-ID";
+    unsigned int len = KEY_LEN;
+
+    if (!master || !keys) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    memset(keys, 0, sizeof(*keys));
+    keys->algorithm = ENC_ALG_AES_256_GCM;
+    if (!HMAC(sha256(), master->key, KEY_LEN, (const unsigned char *)enc_label,
+              sizeof(enc_label) - 1, keys->key, &len) ||
+        !HMAC(sha256(), master->key, KEY_LEN, (const unsigned char *)id_label,
+              sizeof(id_label) - 1, keys->mac_key, &len)) {
+        enc_key_wipe(keys);
+        return ENC_ERR_KEY_DERIVATION;
+    }
+    return ENC_SUCCESS;
+}
+
+int enc_blob_id(const enc_key_t *keys, const unsigned char *data, size_t len, unsigned char *id) {
+    if (!keys || (!data && len != 0) || !id) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    pthread_once(&fetch_once, fetch_algorithms);
+    return cbc_mac(keys, NULL, 0, data, len, id);
+}
+
+int enc_seal_blob(const enc_key_t *keys, const unsigned char *aad, size_t aad_len,
+                  const unsigned char *in, size_t in_len, unsigned char *out) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char *ct = out + IV_LEN;
     int out_len = 0;
     int final_len = 0;
 
-    *out_payload = NULL;
-    *out_payload_len = 0;
+    if (!keys || !out || (!in && in_len != 0) || in_len > INT32_MAX) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (RAND_bytes(out, IV_LEN) != 1) {
+        return ENC_ERR_RANDOM;
+    }
 
-    if (RAND_bytes(salt, SALT_LEN) != 1 || RAND_bytes(iv, IV_LEN) != 1) {
-        rc = ENC_ERR_RANDOM;
-        goto cleanup;
+    ctx = slot_init(SLOT_AEAD, aead_cipher(ENC_ALG_AES_256_GCM), keys->key, out, 1);
+    if (!ctx ||
+        (aad_len > 0 && EVP_EncryptUpdate(ctx, NULL, &out_len, aad, (int)aad_len) != 1) ||
+        (in_len > 0 && EVP_EncryptUpdate(ctx, ct, &out_len, in, (int)in_len) != 1) ||
+        EVP_EncryptFinal_ex(ctx, ct + in_len, &final_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, TAG_LEN, ct + in_len) != 1) {
+        return ENC_ERR_ENCRYPT;
     }
+    return ENC_SUCCESS;
+}
 
-    if (PKCS5_PBKDF2_HMAC(
-            passphrase,
-            (int)strlen(passphrase),
-            salt,
-            SALT_LEN,
-            PBKDF2_ITERATIONS,
-            EVP_sha256(),
-            KEY_LEN,
-            key
-        ) != 1) {
-        rc = ENC_ERR_KEY_DERIVATION;
-        goto cleanup;
+int enc_open_blob(const enc_key_t *keys, const unsigned char *aad, size_t aad_len,
+                  const unsigned char *in, size_t in_len, unsigned char *out, size_t *out_len) {
+    EVP_CIPHER_CTX *ctx;
+    int len = 0;
+    int final_len = 0;
+
+    if (!keys || !in || !out || !out_len || in_len < ENC_BLOB_OVERHEAD ||
+        in_len - ENC_BLOB_OVERHEAD > INT32_MAX) {
+        return ENC_ERR_INVALID_ARG;
     }
 
-    ciphertext = (unsigned char *)malloc(plaintext_len == 0 ? 1 : plaintext_len);
-    if (!ciphertext) {
-        rc = ENC_ERR_MEMORY;
-        goto cleanup;
+    const size_t ct_len = in_len - ENC_BLOB_OVERHEAD;
+    ctx = slot_init(SLOT_AEAD, aead_cipher(ENC_ALG_AES_256_GCM), keys->key, in, 0);
+    if (!ctx ||
+        (aad_len > 0 && EVP_DecryptUpdate(ctx, NULL, &len, aad, (int)aad_len) != 1) ||
+        (ct_len > 0 && EVP_DecryptUpdate(ctx, out, &len, in + IV_LEN, (int)ct_len) != 1) ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, TAG_LEN,
+                            (void *)(in + IV_LEN + ct_len)) != 1 ||
+        EVP_DecryptFinal_ex(ctx, out + ct_len, &final_len) != 1) {
+        return ENC_ERR_DECRYPT;
+    }
+
+    *out_len = ct_len;
+    return ENC_SUCCESS;
+}
+
+/* ── Keystream ───────────────────────────────────────────────────── */
+
+int enc_keystream(const unsigned char *key, uint64_t block, unsigned char *out, size_t len) {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char iv[CBC_BLOCK_LEN] = {0};
+    int out_len = 0;
+
+    if (!key || (!out && len != 0)) {
+        return ENC_ERR_INVALID_ARG;
     }
 
-    ctx = EVP_CIPHER_CTX_new();
+    pthread_once(&fetch_once, fetch_algorithms);
+    write_u64_be(iv + 8, block);
+    ctx = slot_init(SLOT_CTR, fetched_ctr, key, iv, 1);
     if (!ctx) {
-        rc = ENC_ERR_ENCRYPT;
-        goto cleanup;
+        return ENC_ERR_ENCRYPT;
     }
 
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1 ||
-        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, IV_LEN, NULL) != 1 ||
-        EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv) != 1) {
-        rc = ENC_ERR_ENCRYPT;
-        goto cleanup;
+    /* CTR over zeros is the bare keystream */
+    memset(out, 0, len);
+    while (len > 0) {
+        const int chunk = len > (1u << 30) ? (1 << 30) : (int)len;
+        if (EVP_EncryptUpdate(ctx, out, &out_len, out, chunk) != 1) {
+            return ENC_ERR_ENCRYPT;
+        }
+        out += chunk;
+        len -= (size_t)chunk;
     }
+    return ENC_SUCCESS;
+}
 
-    if (EVP_EncryptUpdate(ctx, ciphertext, &out_len, plaintext, (int)plaintext_len) != 1) {
-        rc = ENC_ERR_ENCRYPT;
-        goto cleanup;
+/* ── In-memory payloads ──────────────────────────────────────────── */
+
+int enc_encrypt_payload(
+    int algorithm,
+    const unsigned char *plaintext,
+    size_t plaintext_len,
+    const char *passphrase,
+    unsigned char **out_payload,
+    size_t *out_payload_len
+) {
+    if (!passphrase || !out_payload || !out_payload_len) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    if (!plaintext && plaintext_len != 0) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    enc_header_t header;
+    enc_key_t *key = NULL;
+    enc_kek_t *kek = NULL;
+    unsigned char *payload = NULL;
+    size_t offset;
+    int rc;
+
+    *out_payload = NULL;
+    *out_payload_len = 0;
+
+    rc = enc_header_init(&header, algorithm, 0, plaintext_len, 1);
+    if (rc != ENC_SUCCESS) {
+        return rc;
     }
 
-    if (EVP_EncryptFinal_ex(ctx, ciphertext + out_len, &final_len) != 1) {
-        rc = ENC_ERR_ENCRYPT;
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    kek = (enc_kek_t *)secmem_alloc(sizeof(*kek));
+    if (!key || !kek) {
+        rc = ENC_ERR_MEMORY;
         goto cleanup;
     }
-    out_len += final_len;
 
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_LEN, tag) != 1) {
-        rc = ENC_ERR_ENCRYPT;
+    rc = enc_kek_derive(passphrase, NULL, 0, kek);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_generate_key(&header, kek, key);
+    }
+    if (rc != ENC_SUCCESS) {
         goto cleanup;
     }
+    offset = header.header_len;
+
+    const size_t payload_len = (size_t)enc_payload_size(&header);
+    const uint64_t segments = enc_segment_count(&header);
 
-    *out_payload_len = FIXED_HEADER_LEN + (size_t)out_len;
-    payload = (unsigned char *)malloc(*out_payload_len);
+    payload = (unsigned char *)mem_alloc(payload_len);
     if (!payload) {
         rc = ENC_ERR_MEMORY;
         goto cleanup;
     }
+    memcpy(payload, header.raw, header.header_len);
 
-    memcpy(payload, PAYLOAD_MAGIC, PAYLOAD_MAGIC_LEN);
-    payload[4] = PAYLOAD_VERSION;
-    write_u32_be(payload + 5, PBKDF2_ITERATIONS);
-    memcpy(payload + 9, salt, SALT_LEN);
-    memcpy(payload + 25, iv, IV_LEN);
-    memcpy(payload + 37, tag, TAG_LEN);
-    if (out_len > 0) {
-        memcpy(payload + FIXED_HEADER_LEN, ciphertext, (size_t)out_len);
+    for (uint64_t i = 0; i < segments; i++) {
+        const size_t start = (size_t)(i * header.segment_size);
+        const size_t len = (plaintext_len - start < header.segment_size)
+            ? plaintext_len - start : header.segment_size;
+        size_t sealed = 0;
+
+        rc = enc_seal_segment(&header, key, i, plaintext ? plaintext + start : NULL, len,
+                              payload + offset, &sealed);
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+        offset += sealed;
     }
 
     *out_payload = payload;
-    rc = ENC_SUCCESS;
+    *out_payload_len = payload_len;
+    payload = NULL;
 
 cleanup:
-    if (ctx) EVP_CIPHER_CTX_free(ctx);
-    if (ciphertext) free(ciphertext);
-    if (rc != ENC_SUCCESS) {
-        if (payload) free(payload);
-        *out_payload = NULL;
-        *out_payload_len = 0;
-    }
-    OPENSSL_cleanse(key, sizeof(key));
+    mem_free(payload);
+    secmem_free(kek);
+    secmem_free(key);
     return rc;
 }
 
-int aes_decrypt_payload(
+/* Original single-shot AES-256-GCM format, kept readable for old files */
+static int decrypt_payload_v1(
     const unsigned char *payload,
     size_t payload_len,
     const char *passphrase,
     unsigned char **out_plaintext,
     size_t *out_plaintext_len
 ) {
-    if (!payload || !passphrase || !out_plaintext || !out_plaintext_len) {
-        return ENC_ERR_INVALID_ARG;
-    }
-
     if (payload_len < FIXED_HEADER_LEN) {
         return ENC_ERR_INVALID_FORMAT;
     }
 
-    if (memcmp(payload, PAYLOAD_MAGIC, PAYLOAD_MAGIC_LEN) != 0 || payload[4] != PAYLOAD_VERSION) {
-        return ENC_ERR_INVALID_FORMAT;
-    }
-
     const uint32_t iterations = read_u32_be(payload + 5);
-    if (iterations < 10000) {
+    if (iterations < ENC_MIN_ITERATIONS) {
         return ENC_ERR_INVALID_FORMAT;
     }
 
@@ -183,75 +1490,176 @@ int aes_decrypt_payload(
 
     int rc = ENC_ERR_DECRYPT;
     EVP_CIPHER_CTX *ctx = NULL;
-    unsigned char key[KEY_LEN];
+    unsigned char *key = (unsigned char *)secmem_alloc(KEY_LEN);
     unsigned char *plaintext = NULL;
     int out_len = 0;
     int final_len = 0;
 
-    *out_plaintext = NULL;
-    *out_plaintext_len = 0;
+    if (!key) {
+        return ENC_ERR_MEMORY;
+    }
 
-    if (PKCS5_PBKDF2_HMAC(
-            passphrase,
-            (int)strlen(passphrase),
-            salt,
-            SALT_LEN,
-            (int)iterations,
-            EVP_sha256(),
-            KEY_LEN,
-            key
-        ) != 1) {
-        rc = ENC_ERR_KEY_DERIVATION;
+    rc = pbkdf2(passphrase, salt, iterations, key);
+    if (rc != ENC_SUCCESS) {
         goto cleanup;
     }
 
-    plaintext = (unsigned char *)malloc(ciphertext_len == 0 ? 1 : ciphertext_len);
+    plaintext = (unsigned char *)mem_alloc(ciphertext_len == 0 ? 1 : ciphertext_len);
     if (!plaintext) {
         rc = ENC_ERR_MEMORY;
         goto cleanup;
     }
 
-    ctx = EVP_CIPHER_CTX_new();
+    rc = ENC_ERR_DECRYPT;
+    ctx = slot_init(SLOT_AEAD, aead_cipher(ENC_ALG_AES_256_GCM), key, iv, 0);
     if (!ctx) {
-        rc = ENC_ERR_DECRYPT;
         goto cleanup;
     }
 
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1 ||
-        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, IV_LEN, NULL) != 1 ||
-        EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv) != 1) {
-        rc = ENC_ERR_DECRYPT;
+    stats_timer_t timer;
+    stats_begin(&timer);
+    int ok = EVP_DecryptUpdate(ctx, plaintext, &out_len, ciphertext, (int)ciphertext_len) == 1 &&
+             EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_LEN, (void *)tag) == 1 &&
+             EVP_DecryptFinal_ex(ctx, plaintext + out_len, &final_len) == 1;
+    stats_end(&timer, STATS_CRYPTO, ciphertext_len, 1);
+
+    if (!ok) {
         goto cleanup;
     }
+    out_len += final_len;
+
+    *out_plaintext = plaintext;
+    *out_plaintext_len = (size_t)out_len;
+    plaintext = NULL;
+    rc = ENC_SUCCESS;
+
+cleanup:
+    if (plaintext) mem_free(plaintext);
+    secmem_free(key);
+    return rc;
+}
+
+int enc_decrypt_payload(
+    const unsigned char *payload,
+    size_t payload_len,
+    const char *passphrase,
+    unsigned char **out_plaintext,
+    size_t *out_plaintext_len
+) {
+    if (!payload || !passphrase || !out_plaintext || !out_plaintext_len) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    *out_plaintext = NULL;
+    *out_plaintext_len = 0;
+
+    const int version = enc_payload_version(payload, payload_len);
+    if (version == PAYLOAD_VERSION_V1) {
+        return decrypt_payload_v1(payload, payload_len, passphrase,
+                                  out_plaintext, out_plaintext_len);
+    }
+
+    enc_header_t header;
+    enc_key_t *key = NULL;
+    unsigned char *plaintext = NULL;
+    enc_gen_t *generations = NULL;
+    uint32_t epoch = 0;
+    size_t out_offset = 0;
+    size_t in_offset;
+    int rc = enc_header_decode(payload, payload_len, &header);
+
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    in_offset = header.header_len;
+
+    /* Updated in place: a segment index follows the segments */
+    const size_t segments_end = (size_t)enc_payload_size(&header);
+    if (segments_end != payload_len &&
+        (segments_end > payload_len || payload_len - segments_end != enc_index_size(&header))) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
 
-    if (EVP_DecryptUpdate(ctx, plaintext, &out_len, ciphertext, (int)ciphertext_len) != 1) {
-        rc = ENC_ERR_DECRYPT;
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    if (!key) {
+        return ENC_ERR_MEMORY;
+    }
+
+    rc = enc_derive_key(passphrase, &header, key);
+    if (rc != ENC_SUCCESS) {
         goto cleanup;
     }
 
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_LEN, (void *)tag) != 1) {
-        rc = ENC_ERR_DECRYPT;
+    const uint64_t segments = enc_segment_count(&header);
+    const size_t full_sealed = enc_sealed_len(header.algorithm, header.segment_size);
+
+    if (segments_end != payload_len) {
+        generations = (enc_gen_t *)mem_alloc((size_t)segments * sizeof(*generations));
+        rc = generations ? enc_open_index(&header, key, payload + segments_end,
+                                          payload_len - segments_end, generations, &epoch)
+                         : ENC_ERR_MEMORY;
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    plaintext = (unsigned char *)mem_alloc(header.plaintext_len == 0 ? 1 : (size_t)header.plaintext_len);
+    if (!plaintext) {
+        rc = ENC_ERR_MEMORY;
         goto cleanup;
     }
 
-    if (EVP_DecryptFinal_ex(ctx, plaintext + out_len, &final_len) != 1) {
-        rc = ENC_ERR_DECRYPT;
+    for (uint64_t i = 0; i < segments; i++) {
+        const size_t sealed = (i + 1 < segments) ? full_sealed : segments_end - in_offset;
+        size_t opened = 0;
+
+        rc = enc_open_segment_gen(&header, key, i, generations ? &generations[i] : NULL,
+                                  payload + in_offset, sealed, plaintext + out_offset, &opened);
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+        in_offset += sealed;
+        out_offset += opened;
+    }
+
+    if (out_offset != header.plaintext_len) {
+        rc = ENC_ERR_INVALID_FORMAT;
         goto cleanup;
     }
-    out_len += final_len;
 
     *out_plaintext = plaintext;
-    *out_plaintext_len = (size_t)out_len;
+    *out_plaintext_len = out_offset;
     plaintext = NULL;
-    rc = ENC_SUCCESS;
 
 cleanup:
-    if (ctx) EVP_CIPHER_CTX_free(ctx);
-    if (plaintext) free(plaintext);
-    OPENSSL_cleanse(key, sizeof(key));
+    mem_free(plaintext);
+    mem_free(generations);
+    secmem_free(key);
     return rc;
 }
 
+int aes_encrypt_payload(
+    const unsigned char *plaintext,
+    size_t plaintext_len,
+    const char *passphrase,
+    unsigned char **out_payload,
+    size_t *out_payload_len
+) {
+    return enc_encrypt_payload(ENC_ALG_AES_256_GCM, plaintext, plaintext_len,
+                               passphrase, out_payload, out_payload_len);
+}
+
+int aes_decrypt_payload(
+    const unsigned char *payload,
+    size_t payload_len,
+    const char *passphrase,
+    unsigned char **out_plaintext,
+    size_t *out_plaintext_len
+) {
+    return enc_decrypt_payload(payload, payload_len, passphrase,
+                               out_plaintext, out_plaintext_len);
+}
+
 const char *enc_strerror(int error_code) {
     switch (error_code) {
         case ENC_SUCCESS:
@@ -270,6 +1678,16 @@ const char *enc_strerror(int error_code) {
             return "Decryption failed (wrong key or corrupted data)";
         case ENC_ERR_INVALID_FORMAT:
             return "Invalid encrypted file format";
+        case ENC_ERR_IO:
+            return "File I/O failed";
+        case ENC_ERR_BUDGET:
+            return "Memory budget too small for this operation";
+        case ENC_ERR_NO_SLOT:
+            return "No free key slot in the header";
+        case ENC_ERR_LAST_SLOT:
+            return "Refusing to remove the only key slot";
+        case ENC_ERR_CANCELLED:
+            return "Operation cancelled";
         default:
             return "Unknown encryption error";
     }
@@ -11,13 +11,27 @@
  * - Error handling with errno
  */
 
+#define _GNU_SOURCE     /* syncfs(), copy_file_range(), fallocate() */
+
 #include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/stats.h"
 
 #include <fcntl.h>      /* File control: open(), O_RDONLY, O_WRONLY, etc. */
 #include <unistd.h>     /* POSIX API: read(), write(), close(), lseek() */
 #include <stdlib.h>     /* Memory: malloc(), free() */
 #include <errno.h>      /* Error handling */
 #include <sys/stat.h>   /* File status */
+#include <stdio.h>      /* rename(), snprintf() */
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>  /* ioctl() */
+#include <linux/fs.h>   /* FICLONE */
+#endif
+
+/* Buffer for the streamed fallback of fio_snapshot() */
+#define SNAPSHOT_BUFFER (1024 * 1024)
 
 /*
  * Read entire file into memory using system calls
@@ -32,8 +46,10 @@ int read_file(const char *filename, unsigned char **buffer, size_t *size) {
     int fd;
     off_t file_size;
     ssize_t bytes_read;
+    stats_timer_t timer;
     
     /* Open file for reading only */
+    stats_count(STATS_OPEN, 1);
     fd = open(filename, O_RDONLY);
     if (fd == -1) {
         return FIO_ERR_OPEN;
@@ -53,16 +69,18 @@ int read_file(const char *filename, unsigned char **buffer, size_t *size) {
     }
     
     /* Allocate buffer for file contents */
-    *buffer = (unsigned char *)malloc(file_size);
+    *buffer = (unsigned char *)mem_alloc(file_size);
     if (*buffer == NULL) {
         close(fd);
         return FIO_ERR_MEMORY;
     }
     
     /* Read entire file into buffer */
+    stats_begin(&timer);
     bytes_read = read(fd, *buffer, file_size);
+    stats_end(&timer, STATS_READ, bytes_read > 0 ? (uint64_t)bytes_read : 0, 1);
     if (bytes_read != file_size) {
-        free(*buffer);
+        mem_free(*buffer);
         *buffer = NULL;
         close(fd);
         return FIO_ERR_READ;
@@ -71,6 +89,7 @@ int read_file(const char *filename, unsigned char **buffer, size_t *size) {
     *size = (size_t)file_size;
     
     /* Close file descriptor */
+    stats_count(STATS_OPEN, 1);
     if (close(fd) == -1) {
         /* File was read successfully, but close failed - still return success */
         /* In production, you might want to handle this differently */
@@ -83,38 +102,621 @@ int read_file(const char *filename, unsigned char **buffer, size_t *size) {
  * Write buffer to file using system calls
  * 
  * System calls used:
- * - open()  : Create/truncate file and get file descriptor
- * - write() : Write data from buffer
- * - close() : Release file descriptor
+ * - open()   : Create a new temporary file beside it (O_EXCL)
+ * - write()  : Write data from buffer
+ * - close()  : Release file descriptor
+ * - rename() : Replace the destination with the finished file
  */
 int write_file(const char *filename, const unsigned char *buffer, size_t size) {
+    char tmp[4096];
     int fd;
     ssize_t bytes_written;
-    
-    /* 
-     * Open/create file for writing
-     * O_WRONLY : Write only
-     * O_CREAT  : Create if doesn't exist
-     * O_TRUNC  : Truncate if exists
-     * 0644    : Permissions (rw-r--r--)
-     */
-    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
+    stats_timer_t timer;
+    int rc;
+
+    /* Create a fresh temporary file beside the destination */
+    if (fio_open_temp(filename, NULL, tmp, sizeof(tmp), &fd) != FIO_SUCCESS) {
         return FIO_ERR_OPEN;
     }
     
     /* Write entire buffer to file */
+    stats_begin(&timer);
     bytes_written = write(fd, buffer, size);
+    stats_end(&timer, STATS_WRITE, bytes_written > 0 ? (uint64_t)bytes_written : 0, 1);
     if (bytes_written == -1 || (size_t)bytes_written != size) {
         close(fd);
+        unlink(tmp);
         return FIO_ERR_WRITE;
     }
     
-    /* Close file descriptor */
-    if (close(fd) == -1) {
-        return FIO_ERR_CLOSE;
+    /* Close and rename over the destination */
+    rc = fio_commit(fd, tmp, filename, FIO_SYNC_NONE);
+    if (rc != FIO_SUCCESS) {
+        unlink(tmp);
     }
-    
+    return rc;
+}
+
+/*
+ * Open input file and get its size
+ *
+ * System calls used:
+ * - open()  : Open file and get file descriptor
+ * - fstat() : Query size without moving the file offset
+ */
+int fio_open_input(const char *filename, int *fd, uint64_t *size) {
+    struct stat st;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    *fd = open(filename, O_RDONLY);
+    if (*fd == -1) {
+        stats_end(&timer, STATS_OPEN, 0, 1);
+        return FIO_ERR_OPEN;
+    }
+
+    if (fstat(*fd, &st) == -1) {
+        close(*fd);
+        *fd = -1;
+        stats_end(&timer, STATS_OPEN, 0, 3);
+        return FIO_ERR_READ;
+    }
+
+    *size = (uint64_t)st.st_size;
+    stats_end(&timer, STATS_OPEN, 0, 2);
+    return FIO_SUCCESS;
+}
+
+/*
+ * Open/create output file, truncating any existing content
+ */
+int fio_open_output(const char *filename, int *fd) {
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    *fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    stats_end(&timer, STATS_OPEN, 0, 1);
+    if (*fd == -1) {
+        return FIO_ERR_OPEN;
+    }
+    return FIO_SUCCESS;
+}
+
+/*
+ * Open/create a log file; every write() lands at its current end
+ */
+int fio_open_append(const char *filename, int *fd) {
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    *fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    stats_end(&timer, STATS_OPEN, 0, 1);
+    if (*fd == -1) {
+        return FIO_ERR_OPEN;
+    }
+    return FIO_SUCCESS;
+}
+
+/*
+ * Open an existing file for in-place updates and report its size
+ */
+int fio_open_update(const char *filename, int *fd, uint64_t *size) {
+    struct stat st;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    *fd = open(filename, O_RDWR);
+    if (*fd == -1) {
+        stats_end(&timer, STATS_OPEN, 0, 1);
+        return FIO_ERR_OPEN;
+    }
+
+    if (fstat(*fd, &st) == -1) {
+        close(*fd);
+        *fd = -1;
+        stats_end(&timer, STATS_OPEN, 0, 3);
+        return FIO_ERR_READ;
+    }
+
+    *size = (uint64_t)st.st_size;
+    stats_end(&timer, STATS_OPEN, 0, 2);
+    return FIO_SUCCESS;
+}
+
+/*
+ * Close a descriptor opened by fio_open_input/fio_open_output
+ */
+int fio_close(int fd) {
+    stats_timer_t timer;
+    int rc;
+
+    stats_begin(&timer);
+    rc = close(fd);
+    stats_end(&timer, STATS_OPEN, 0, 1);
+    return (rc == -1) ? FIO_ERR_CLOSE : FIO_SUCCESS;
+}
+
+/*
+ * Loop over read() until len bytes arrive or end of file
+ * read() may legally return fewer bytes than requested (signals, pipes,
+ * large requests), so a single call is not enough for streaming.
+ */
+int fio_read_full(int fd, unsigned char *buffer, size_t len, size_t *got) {
+    size_t total = 0;
+    uint64_t calls = 0;
+    int rc = FIO_SUCCESS;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    while (total < len) {
+        ssize_t n = read(fd, buffer + total, len - total);
+        calls++;
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = FIO_ERR_READ;
+            break;
+        }
+        if (n == 0) {
+            break;  /* End of file */
+        }
+        total += (size_t)n;
+    }
+    stats_end(&timer, STATS_READ, total, calls);
+
+    *got = total;
+    return rc;
+}
+
+/*
+ * Loop over write() until all bytes are written
+ */
+int fio_write_full(int fd, const unsigned char *buffer, size_t len) {
+    size_t total = 0;
+    uint64_t calls = 0;
+    int rc = FIO_SUCCESS;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    while (total < len) {
+        ssize_t n = write(fd, buffer + total, len - total);
+        calls++;
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = FIO_ERR_WRITE;
+            break;
+        }
+        total += (size_t)n;
+    }
+    stats_end(&timer, STATS_WRITE, total, calls);
+
+    return rc;
+}
+
+/*
+ * Positional variants: pread()/pwrite() leave the file offset alone,
+ * so several threads can work on one descriptor at once
+ */
+int fio_pread_full(int fd, unsigned char *buffer, size_t len, uint64_t offset, size_t *got) {
+    size_t total = 0;
+    uint64_t calls = 0;
+    int rc = FIO_SUCCESS;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    while (total < len) {
+        ssize_t n = pread(fd, buffer + total, len - total, (off_t)(offset + total));
+        calls++;
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = FIO_ERR_READ;
+            break;
+        }
+        if (n == 0) {
+            break;  /* End of file */
+        }
+        total += (size_t)n;
+    }
+    stats_end(&timer, STATS_READ, total, calls);
+
+    *got = total;
+    return rc;
+}
+
+int fio_pwrite_full(int fd, const unsigned char *buffer, size_t len, uint64_t offset) {
+    size_t total = 0;
+    uint64_t calls = 0;
+    int rc = FIO_SUCCESS;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    while (total < len) {
+        ssize_t n = pwrite(fd, buffer + total, len - total, (off_t)(offset + total));
+        calls++;
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = FIO_ERR_WRITE;
+            break;
+        }
+        total += (size_t)n;
+    }
+    stats_end(&timer, STATS_WRITE, total, calls);
+
+    return rc;
+}
+
+/*
+ * Flush file data and metadata to stable storage
+ */
+int fio_sync(int fd) {
+    stats_timer_t timer;
+    int rc;
+
+    stats_begin(&timer);
+    do {
+        rc = fsync(fd);
+    } while (rc == -1 && errno == EINTR);
+    stats_end(&timer, STATS_WRITE, 0, 1);
+    return (rc == -1) ? FIO_ERR_WRITE : FIO_SUCCESS;
+}
+
+/*
+ * Preallocate the output: disk full shows up before any work is done,
+ * and the file gets contiguous extents however its writes arrive
+ */
+int fio_preallocate(int fd, uint64_t offset, uint64_t len) {
+#ifdef __linux__
+    stats_timer_t timer;
+    int rc;
+
+    if (len == 0) {
+        return FIO_SUCCESS;
+    }
+    stats_begin(&timer);
+    rc = fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len);
+    stats_end(&timer, STATS_WRITE, 0, 1);
+    if (rc == -1 && (errno == ENOSPC || errno == EDQUOT)) {
+        return FIO_ERR_WRITE;
+    }
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+#endif
+    return FIO_SUCCESS;   /* Pipes, tmpfs quirks, old kernels: just write */
+}
+
+/*
+ * Flush every dirty file on fd's filesystem in one call; cheaper than an
+ * fsync() per file when many small files were just written
+ */
+int fio_syncfs(int fd) {
+    stats_timer_t timer;
+    int rc = 0;
+
+    stats_begin(&timer);
+#ifdef __linux__
+    rc = syncfs(fd);
+#else
+    (void)fd;
+    sync();
+#endif
+    stats_end(&timer, STATS_WRITE, 0, 1);
+    return (rc == -1) ? FIO_ERR_WRITE : FIO_SUCCESS;
+}
+
+/*
+ * fsync() a directory so entries created or renamed in it are durable
+ */
+int fio_sync_dir(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    int rc;
+
+    if (fd == -1) {
+        return FIO_ERR_OPEN;
+    }
+    rc = fio_sync(fd);
+    close(fd);
+    return rc;
+}
+
+int fio_positional(int fd, uint64_t *offset) {
+    struct stat st;
+    off_t pos;
+    int flags;
+
+    if (fstat(fd, &st) == -1 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+        return 0;
+    }
+    /* pwrite() on an O_APPEND descriptor appends on Linux */
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || (flags & O_APPEND)) {
+        return 0;
+    }
+    pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        return 0;
+    }
+    *offset = (uint64_t)pos;
+    return 1;
+}
+
+int fio_next_data(int fd, uint64_t offset, uint64_t size, uint64_t *data, uint64_t *end) {
+    *data = offset;
+    *end = size;
+    if (offset >= size) {
+        *data = size;
+        return FIO_SUCCESS;
+    }
+#ifdef SEEK_DATA
+    off_t pos = lseek(fd, (off_t)offset, SEEK_DATA);
+    if (pos == -1) {
+        if (errno == ENXIO) {
+            *data = size;          /* A hole runs to the end of the file */
+            return FIO_SUCCESS;
+        }
+        return errno == EINVAL ? FIO_SUCCESS : FIO_ERR_READ;  /* No hole support */
+    }
+    *data = (uint64_t)pos < size ? (uint64_t)pos : size;
+
+    pos = lseek(fd, pos, SEEK_HOLE);
+    if (pos == -1) {
+        return FIO_ERR_READ;
+    }
+    *end = (uint64_t)pos < size ? (uint64_t)pos : size;
+#else
+    (void)fd;
+#endif
+    return FIO_SUCCESS;
+}
+
+int fio_sync_parent(const char *path) {
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+
+    if (!slash) {
+        return fio_sync_dir(".");
+    }
+    const size_t len = (slash == path) ? 1 : (size_t)(slash - path);
+    if (len >= sizeof(dir)) {
+        return FIO_ERR_OPEN;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return fio_sync_dir(dir);
+}
+
+int fio_temp_id(char *id) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    unsigned char raw[FIO_TEMP_ID_LEN];
+
+    if (getentropy(raw, sizeof(raw)) == -1) {
+        return FIO_ERR_OPEN;
+    }
+    for (int i = 0; i < FIO_TEMP_ID_LEN; i++) {
+        id[i] = digits[raw[i] % (sizeof(digits) - 1)];
+    }
+    id[FIO_TEMP_ID_LEN] = '\0';
+    return FIO_SUCCESS;
+}
+
+int fio_temp_path(const char *path, const char *id, char *tmp, size_t len) {
+    const int n = snprintf(tmp, len, "%s%s%s", path, FIO_TEMP_SUFFIX, id);
+    return (n < 0 || (size_t)n >= len) ? FIO_ERR_OPEN : FIO_SUCCESS;
+}
+
+/*
+ * Create the temporary file exclusively: O_EXCL fails on anything already
+ * at the name, a symlink planted there included, and O_NOFOLLOW says so
+ * again, so no other file is ever truncated through it and no two writers
+ * share one. A random name that is taken is simply drawn again.
+ */
+int fio_open_temp(const char *path, const char *id, char *tmp, size_t len, int *fd) {
+    stats_timer_t timer;
+    char fresh[FIO_TEMP_ID_LEN + 1];
+
+    for (int attempt = 0; attempt < 16; attempt++) {
+        if ((!id && fio_temp_id(fresh) != FIO_SUCCESS) ||
+            fio_temp_path(path, id ? id : fresh, tmp, len) != FIO_SUCCESS) {
+            return FIO_ERR_OPEN;
+        }
+        stats_begin(&timer);
+        *fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+        stats_end(&timer, STATS_OPEN, 0, 1);
+        if (*fd != -1) {
+            return FIO_SUCCESS;
+        }
+        if (errno != EEXIST || id) {
+            break;
+        }
+    }
+    return FIO_ERR_OPEN;
+}
+
+/*
+ * Reopen a temporary file left by an interrupted run; it must still be a
+ * regular file of its own, not a symlink put in its place
+ */
+int fio_reopen_temp(const char *tmp, int *fd, uint64_t *size) {
+    struct stat st;
+    stats_timer_t timer;
+
+    stats_begin(&timer);
+    *fd = open(tmp, O_RDWR | O_NOFOLLOW);
+    stats_end(&timer, STATS_OPEN, 0, 1);
+    if (*fd == -1) {
+        return FIO_ERR_OPEN;
+    }
+    if (fstat(*fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_nlink != 1) {
+        close(*fd);
+        *fd = -1;
+        return FIO_ERR_OPEN;
+    }
+    *size = (uint64_t)st.st_size;
+    return FIO_SUCCESS;
+}
+
+/*
+ * Atomic publish: the data must be durable before the rename makes it
+ * visible, and the directory after it, or a crash could expose a renamed
+ * but empty file, or lose the rename. The new inode takes over the mode
+ * and owner of the file it replaces; changing the owner needs privilege,
+ * so without it the new file stays ours.
+ */
+int fio_commit(int fd, const char *tmp, const char *path, int sync) {
+    struct stat st;
+    int rc = FIO_SUCCESS;
+
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (fchmod(fd, st.st_mode & 07777) == -1) {
+            rc = FIO_ERR_WRITE;
+        }
+        if (fchown(fd, st.st_uid, st.st_gid) == -1 && errno != EPERM) {
+            rc = FIO_ERR_WRITE;
+        }
+    }
+    if (rc == FIO_SUCCESS && sync == FIO_SYNC_FILE && fio_sync(fd) != FIO_SUCCESS) {
+        rc = FIO_ERR_WRITE;
+    }
+    if (fio_close(fd) != FIO_SUCCESS && rc == FIO_SUCCESS) {
+        rc = FIO_ERR_CLOSE;
+    }
+    if (rc != FIO_SUCCESS) {
+        return rc;
+    }
+    if (rename(tmp, path) == -1) {
+        return FIO_ERR_WRITE;
+    }
+    if (sync == FIO_SYNC_FILE && fio_sync_parent(path) != FIO_SUCCESS) {
+        return FIO_ERR_WRITE;
+    }
+    return FIO_SUCCESS;
+}
+
+/*
+ * Copy src to dst as cheaply as the filesystem allows:
+ * - ioctl(FICLONE): dst shares src's extents copy-on-write (Btrfs, XFS),
+ *   so the snapshot costs no data I/O and no space until blocks diverge
+ * - copy_file_range(): the kernel copies without a trip through user
+ *   space, and may offload it (NFS server-side copy)
+ * - read()/write() through a fixed buffer otherwise
+ */
+int fio_snapshot(const char *src, const char *dst, int *method, uint64_t *bytes) {
+    stats_timer_t timer;
+    unsigned char *buffer = NULL;
+    char tmp[4096];
+    struct stat in_st;
+    struct stat out_st;
+    uint64_t size = 0;
+    uint64_t done = 0;
+    int in_fd = -1;
+    int out_fd = -1;
+    int rc;
+
+    *method = FIO_SNAP_STREAM;
+    *bytes = 0;
+
+    rc = fio_open_input(src, &in_fd, &size);
+    if (rc != FIO_SUCCESS) {
+        return rc;
+    }
+    /* dst is written beside itself and renamed over, so the old dst
+     * survives a failure; a dst that is src itself is refused outright */
+    if (fstat(in_fd, &in_st) == -1 ||
+        (stat(dst, &out_st) == 0 && out_st.st_dev == in_st.st_dev &&
+         out_st.st_ino == in_st.st_ino) ||
+        fio_open_temp(dst, NULL, tmp, sizeof(tmp), &out_fd) != FIO_SUCCESS) {
+        fio_close(in_fd);
+        return FIO_ERR_OPEN;
+    }
+
+#ifdef FICLONE
+    stats_begin(&timer);
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+        stats_end(&timer, STATS_WRITE, size, 1);
+        *method = FIO_SNAP_REFLINK;
+        done = size;
+        goto flush;
+    }
+    stats_end(&timer, STATS_WRITE, 0, 1);
+#endif
+
+#ifdef __linux__
+    while (done < size) {
+        const size_t want = (size - done > (1u << 30)) ? (1u << 30) : (size_t)(size - done);
+        ssize_t n;
+
+        stats_begin(&timer);
+        n = copy_file_range(in_fd, NULL, out_fd, NULL, want, 0);
+        stats_end(&timer, STATS_WRITE, n > 0 ? (uint64_t)n : 0, 1);
+
+        if (n > 0) {
+            done += (uint64_t)n;
+            *method = FIO_SNAP_COPY_RANGE;
+        } else if (n == 0) {
+            break;  /* Source shrank underneath us: a short copy, see flush */
+        } else if (errno == EINTR) {
+            continue;
+        } else if (done == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+                                 errno == EINVAL)) {
+            break;  /* Not supported here: stream it instead */
+        } else {
+            rc = FIO_ERR_WRITE;
+            goto done;
+        }
+    }
+    if (*method == FIO_SNAP_COPY_RANGE) {
+        goto flush;
+    }
+#endif
+
+    buffer = (unsigned char *)mem_alloc(SNAPSHOT_BUFFER);
+    if (!buffer) {
+        rc = FIO_ERR_MEMORY;
+        goto done;
+    }
+    for (;;) {
+        size_t got = 0;
+
+        rc = fio_read_full(in_fd, buffer, SNAPSHOT_BUFFER, &got);
+        if (rc == FIO_SUCCESS && got > 0) {
+            rc = fio_write_full(out_fd, buffer, got);
+        }
+        if (rc != FIO_SUCCESS) {
+            goto done;
+        }
+        done += got;
+        if (got < SNAPSHOT_BUFFER) {
+            break;
+        }
+    }
+
+flush:
+    if (done != size) {
+        rc = FIO_ERR_WRITE;  /* src changed size while it was copied */
+        goto done;
+    }
+    rc = fio_commit(out_fd, tmp, dst, FIO_SYNC_FILE);
+    out_fd = -1;
+
+done:
+    mem_free(buffer);
+    fio_close(in_fd);
+    if (out_fd != -1) {
+        fio_close(out_fd);
+    }
+    if (rc != FIO_SUCCESS) {
+        unlink(tmp);
+        return rc;
+    }
+    *bytes = done;
     return FIO_SUCCESS;
 }
 
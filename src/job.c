@@ -0,0 +1,141 @@
+/*
+ * job.c - One encrypt/decrypt run on its own thread
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Demonstrates OS concepts:
+ * - Keeping an interactive thread responsive while another blocks on I/O
+ * - Lock-free progress sharing with atomic loads and stores
+ * - Cooperative cancellation at safe points
+ */
+
+#include "../include/job.h"
+#include "../include/encryption.h"
+#include "../include/secmem.h"
+
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Runs on the worker: publish progress for the UI thread to sample */
+static void job_progress_hook(void *arg, uint64_t done, uint64_t total) {
+    job_t *job = (job_t *)arg;
+
+    __atomic_store_n(&job->total, total, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->done, done, __ATOMIC_RELAXED);
+}
+
+static void *job_main(void *arg) {
+    job_t *job = (job_t *)arg;
+
+    job->rc = job->decrypt
+        ? stream_decrypt_file(job->input, job->output, job->passphrase, &job->opts, &job->result)
+        : stream_encrypt_file(job->input, job->output, job->passphrase, &job->opts, &job->result);
+
+    job->end_ns = now_ns();
+    /* Release: rc, result and end_ns are visible to whoever sees JOB_DONE */
+    __atomic_store_n(&job->state, JOB_DONE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int job_init(job_t *job, int decrypt, const char *input, const char *output,
+             const char *passphrase, const stream_opts_t *opts) {
+    if (!job || !input || !output || !passphrase || !opts ||
+        strlen(input) >= JOB_PATH_LEN || strlen(output) >= JOB_PATH_LEN) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    memset(job, 0, sizeof(*job));
+    job->decrypt = decrypt;
+    strcpy(job->input, input);
+    strcpy(job->output, output);
+
+    /* The caller's buffer may be reused while the job runs */
+    const size_t pass_len = strlen(passphrase) + 1;
+    job->passphrase = (char *)secmem_alloc(pass_len);
+    if (!job->passphrase) {
+        return ENC_ERR_MEMORY;
+    }
+    memcpy(job->passphrase, passphrase, pass_len);
+
+    job->opts = *opts;
+    job->opts.progress = job_progress_hook;
+    job->opts.progress_arg = job;
+    job->opts.cancel = &job->cancel;
+    job->state = JOB_QUEUED;
+    return ENC_SUCCESS;
+}
+
+int job_run(job_t *job) {
+    if (job->state != JOB_QUEUED) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    job->start_ns = now_ns();
+    job->state = JOB_RUNNING;
+    if (pthread_create(&job->thread, NULL, job_main, job) != 0) {
+        job->state = JOB_QUEUED;
+        return ENC_ERR_MEMORY;
+    }
+    return ENC_SUCCESS;
+}
+
+int job_start(job_t *job, int decrypt, const char *input, const char *output,
+              const char *passphrase, const stream_opts_t *opts) {
+    int rc = job_init(job, decrypt, input, output, passphrase, opts);
+
+    if (rc == ENC_SUCCESS) {
+        rc = job_run(job);
+        if (rc != ENC_SUCCESS) {
+            job_wait(job);  /* Releases the passphrase */
+        }
+    }
+    return rc;
+}
+
+int job_state(const job_t *job) {
+    return __atomic_load_n(&job->state, __ATOMIC_ACQUIRE);
+}
+
+void job_progress(const job_t *job, uint64_t *done, uint64_t *total) {
+    *done = __atomic_load_n(&job->done, __ATOMIC_RELAXED);
+    *total = __atomic_load_n(&job->total, __ATOMIC_RELAXED);
+}
+
+double job_elapsed(const job_t *job) {
+    const int state = job_state(job);
+
+    if (state == JOB_RUNNING) {
+        return (double)(now_ns() - job->start_ns) / 1e9;
+    }
+    if (state == JOB_DONE || (state == JOB_IDLE && job->end_ns)) {
+        return (double)(job->end_ns - job->start_ns) / 1e9;
+    }
+    return 0.0;
+}
+
+void job_cancel(job_t *job) {
+    __atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+}
+
+int job_wait(job_t *job) {
+    const int state = job_state(job);
+
+    if (state == JOB_IDLE) {
+        return job->rc;
+    }
+    if (state == JOB_QUEUED) {
+        job->rc = ENC_ERR_CANCELLED;
+    } else {
+        pthread_join(job->thread, NULL);
+    }
+    secmem_free(job->passphrase);  /* Wipes it */
+    job->passphrase = NULL;
+    job->state = JOB_IDLE;
+    return job->rc;
+}
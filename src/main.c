@@ -1,40 +1,281 @@
 /*
- * main.c - AES-256-GCM file encryption/decryption CLI + ncurses UI
+ * main.c - AES-256-GCM / ChaCha20-Poly1305 / AES-CBC-HMAC file encryption
+ *          CLI + ncurses UI
  */
 
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
+#include "../include/batch.h"
+#include "../include/bench.h"
+#include "../include/chunkstore.h"
 #include "../include/encryption.h"
 #include "../include/file_io.h"
+#include "../include/job.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/stats.h"
+#include "../include/stream.h"
+#include "../include/thread_pool.h"
 #include "../include/ui.h"
+#include "../include/vault.h"
+#include "../include/wipe.h"
 
 #define MODE_NONE 0
 #define MODE_ENCRYPT 1
 #define MODE_DECRYPT 2
 #define MODE_MENU 3
+#define MODE_BENCH 4
+#define MODE_BENCH_CHECK 5
+#define MODE_BENCH_SAVE 6
+#define MODE_REKEY 7
+#define MODE_ADD_KEY 8
+#define MODE_REMOVE_KEY 9
+#define MODE_PUT 10
+#define MODE_GET 11
+#define MODE_UPDATE 12
+#define MODE_SNAPSHOT 13
+#define MODE_WIPE 14
 
 #define MENU_ENCRYPT 1
 #define MENU_DECRYPT 2
-#define MENU_EXIT 3
+#define MENU_QUEUE 3
+#define MENU_EXIT 4
+
+/* Job queue screen: rows kept, and jobs run at once (the rest wait) */
+#define QUEUE_MAX_JOBS 8
+#define QUEUE_PARALLEL 4
+
+/* Aggregate throughput/CPU are measured over at least this window */
+#define QUEUE_SAMPLE_NS 500000000ULL
+
+/* Long-only options */
+#define OPT_SEGMENT_SIZE 256
+#define OPT_BENCH 257
+#define OPT_BENCH_MAX_SIZE 258
+#define OPT_BENCH_QUICK 259
+#define OPT_BENCH_DIR 260
+#define OPT_BENCH_REPORT 261
+#define OPT_BENCH_SEED 262
+#define OPT_STATS 263
+#define OPT_BENCH_CHECK 264
+#define OPT_BENCH_SAVE 265
+#define OPT_MAX_MEMORY 266
+#define OPT_HUGE_PAGES 267
+#define OPT_REKEY 268
+#define OPT_NEW_KEY 269
+#define OPT_RESUME 270
+#define OPT_RECIPIENT 271
+#define OPT_KEY_SLOTS 272
+#define OPT_ADD_KEY 273
+#define OPT_REMOVE_KEY 274
+#define OPT_STORE 275
+#define OPT_PUT 276
+#define OPT_GET 277
+#define OPT_UPDATE 278
+#define OPT_SNAPSHOT 279
+#define OPT_WIPE 280
+#define OPT_PASSES 281
+#define OPT_MANIFEST 282
+#define OPT_DURABILITY 283
+#define OPT_SEQUENTIAL_IO 284
+#define OPT_NO_SPARSE 285
 
 static void print_usage(const char *program_name) {
-    printf("File Encryption & Decryption Tool (AES-256-GCM)\n");
+    printf("File Encryption & Decryption Tool (AES-256-GCM / ChaCha20-Poly1305 / AES-CBC-HMAC)\n");
     printf("Usage: %s [OPTIONS]\n\n", program_name);
     printf("Options:\n");
-    printf("  -e, --encrypt       Encrypt the input file\n");
-    printf("  -d, --decrypt       Decrypt the input file\n");
-    printf("  -k, --key KEY       Passphrase\n");
-    printf("  -i, --input FILE    Input file path\n");
-    printf("  -o, --output FILE   Output file path\n");
-    printf("  -m, --menu          Launch interactive menu mode\n");
-    printf("  -h, --help          Show this help message\n\n");
+    printf("  -e, --encrypt          Encrypt the input file\n");
+    printf("  -d, --decrypt          Decrypt the input file\n");
+    printf("      --rekey            Change the passphrase of -i FILE in place (-k old,\n");
+    printf("                         --new-key new); only the header is rewritten\n");
+    printf("      --new-key KEY      New passphrase for --rekey\n");
+    printf("                         With -i DIR, every .enc file below DIR is rekeyed\n");
+    printf("                         in parallel under a crash-safe journal\n");
+    printf("      --resume           Continue an interrupted directory --rekey or --manifest\n");
+    printf("      --recipient KEY    Encrypt: another passphrase that can open the file\n");
+    printf("                         (repeatable, up to %d)\n", ENC_MAX_SLOTS - 1);
+    printf("      --key-slots N      Encrypt: reserve N key slots for later --add-key\n");
+    printf("      --add-key          Let --new-key open -i FILE too (-k opens it now)\n");
+    printf("      --remove-key       Remove the key slot -k opens from -i FILE\n");
+    printf("      --update           Bring the existing -o FILE up to date with -i FILE\n");
+    printf("                         in place, resealing only the changed segments\n");
+    printf("      --snapshot         Copy -i FILE to -o FILE by reflink where the\n");
+    printf("                         filesystem allows (instant, copy-on-write)\n");
+    printf("      --wipe             Overwrite -i FILE (random, complement, random),\n");
+    printf("                         fsync each pass, discard its blocks, delete it\n");
+    printf("      --passes N         Overwrite passes for --wipe (default %d)\n",
+           WIPE_DEFAULT_PASSES);
+    printf("      --store DIR        Deduplicating version store for --put / --get\n");
+    printf("      --put NAME         Store -i FILE as the next version of NAME\n");
+    printf("      --get NAME[@N]     Restore version N of NAME (default latest) to -o\n");
+    printf("      --manifest FILE    With -e/-d: process every INPUT<TAB>OUTPUT line of\n");
+    printf("                         FILE (\"-\" = stdin, NUL-separated pairs allowed)\n");
+    printf("                         in one process, one KDF per passphrase; progress\n");
+    printf("                         is journalled to FILE.journal for --resume\n");
+    printf("      --durability P     none, file or group[:FILES[:MS]]: outputs are\n");
+    printf("                         renamed into place; file fsyncs each one (default\n");
+    printf("                         for -i/-o), group one syncfs per %d files or %d ms\n",
+           BATCH_GROUP_FILES, BATCH_GROUP_MS);
+    printf("                         (default for --manifest)\n");
+    printf("      --sequential-io    One reader and one writer per file instead of\n");
+    printf("                         pread/pwrite from every worker (seekable files)\n");
+    printf("      --no-sparse        Encrypt holes in -i FILE as zeros instead of\n");
+    printf("                         recording them (hides where they are)\n");
+    printf("  -k, --key KEY          Passphrase\n");
+    printf("  -i, --input FILE       Input file path\n");
+    printf("  -o, --output FILE      Output file path\n");
+    printf("  -a, --algorithm ALG    aes-256-gcm (default), chacha20-poly1305,\n");
+    printf("                         aes-256-cbc-hmac (decrypt reads it from the file)\n");
+    printf("  -t, --threads N        Worker threads (default: one per CPU)\n");
+    printf("      --segment-size N   Plaintext bytes per segment, K/M suffix allowed\n");
+    printf("                         (default 1M)\n");
+    printf("      --max-memory N     Cap buffer memory (K/M/G/T suffix); segment size,\n");
+    printf("                         pipeline depth and threads are scaled to fit\n");
+    printf("      --huge-pages[=M]   Back pipeline buffers with huge pages: thp\n");
+    printf("                         (default) or hugetlb; falls back to 4 KiB pages\n");
+    printf("      --stats[=json]     Print per-phase wall/CPU time, bytes, syscalls and\n");
+    printf("                         throughput to stderr when done\n");
+    printf("  -m, --menu             Launch interactive menu mode\n");
+    printf("  -h, --help             Show this help message\n\n");
+    printf("Benchmark:\n");
+    printf("      --bench[=FMT]      Run the benchmark suite; FMT is text (default),\n");
+    printf("                         json or csv\n");
+    printf("      --bench-max-size N Largest payload in the size sweep (default 1G)\n");
+    printf("      --bench-quick      Shorter timing windows and fewer cases\n");
+    printf("      --bench-dir DIR    Scratch directory for file-backed cases (/tmp)\n");
+    printf("      --bench-report F   Also write results to F (.json or .csv)\n");
+    printf("      --bench-seed N     Seed for generated payloads (default 1)\n");
+    printf("      --bench-check F    Run the regression set, fail on regressions vs F\n");
+    printf("      --bench-save F     Run the regression set and write baseline F\n\n");
     printf("Examples:\n");
     printf("  %s --menu\n", program_name);
     printf("  %s -e -k \"passphrase\" -i report.pdf -o report.enc\n", program_name);
+    printf("  %s -e -a chacha20 -k \"passphrase\" -i report.pdf -o report.enc\n", program_name);
     printf("  %s -d -k \"passphrase\" -i report.enc -o report.pdf\n", program_name);
+    printf("  %s -e -k \"passphrase\" --manifest files.tsv\n", program_name);
+    printf("  find in -type f -printf '%%p\\0out/%%f.enc\\0' | %s -e -k pw --manifest -\n",
+           program_name);
+    printf("  %s --rekey -k \"old\" --new-key \"new\" -i report.enc\n", program_name);
+    printf("  %s --rekey -t 8 -k \"old\" --new-key \"new\" -i vault/\n", program_name);
+    printf("  %s -e -k alice --recipient bob --key-slots 4 -i plan.pdf -o plan.enc\n",
+           program_name);
+    printf("  %s --add-key -k alice --new-key carol -i plan.enc\n", program_name);
+    printf("  %s --update -k \"passphrase\" -i report.pdf -o report.enc\n", program_name);
+    printf("  %s --snapshot -i report.enc -o report.v1.enc\n", program_name);
+    printf("  %s --wipe -i report.pdf\n", program_name);
+    printf("  %s --store versions/ --put plan -k \"passphrase\" -i plan.pdf\n", program_name);
+    printf("  %s --store versions/ --get plan@2 -k \"passphrase\" -o plan.pdf\n", program_name);
+    printf("  %s --bench=json --bench-max-size 4G\n", program_name);
+}
+
+/* Parse a byte count with optional K/M/G/T suffix; returns 0 on error,
+ * including a count that does not fit in 64 bits */
+static unsigned long long parse_size(const char *text) {
+    char *end = NULL;
+    unsigned long long value;
+    int shift = 0;
+
+    if (!isdigit((unsigned char)*text)) {
+        return 0;  /* strtoull() would take "-1" as a huge count */
+    }
+    errno = 0;
+    value = strtoull(text, &end, 10);
+    if (errno == ERANGE) {
+        return 0;
+    }
+    switch (toupper((unsigned char)*end)) {
+        case 'T': shift = 40; end++; break;
+        case 'G': shift = 30; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'K': shift = 10; end++; break;
+        default: break;
+    }
+    if (value > (UINT64_MAX >> shift)) {
+        return 0;
+    }
+    value <<= shift;
+    if (toupper((unsigned char)*end) == 'B' || toupper((unsigned char)*end) == 'I') {
+        end++;
+    }
+    return (*end == '\0') ? value : 0;
+}
+
+/* "none", "file" or "group[:FILES[:MS]]"; returns 0 on success */
+static int parse_durability(const char *text, int *durability, batch_opts_t *bopts) {
+    unsigned long files = 0;
+    unsigned long ms = 0;
+    char extra = 0;
+
+    if (strcmp(text, "none") == 0) {
+        *durability = FIO_SYNC_NONE;
+    } else if (strcmp(text, "file") == 0) {
+        *durability = FIO_SYNC_FILE;
+    } else if (strcmp(text, "group") == 0) {
+        *durability = FIO_SYNC_GROUP;
+    } else if (sscanf(text, "group:%lu%c", &files, &extra) == 1 ||
+               sscanf(text, "group:%lu:%lu%c", &files, &ms, &extra) == 2) {
+        if (files == 0 || files > 1000000 || ms > 3600000) {
+            return -1;
+        }
+        *durability = FIO_SYNC_GROUP;
+        bopts->group_files = (uint32_t)files;
+        bopts->group_ms = ms ? (uint32_t)ms : bopts->group_ms;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Menu mode: stream on a worker thread while this thread redraws the
+ * progress bar and watches for the cancel key. Cancelling stops at the
+ * next batch and the stream removes the partial output.
+ */
+static int run_ui_job(int mode, const char *passphrase, const char *input_file,
+                      const char *output_file, const stream_opts_t *opts,
+                      stream_result_t *result) {
+    job_t job;
+    ui_progress_t progress;
+    uint64_t done = 0;
+    uint64_t total = 0;
+    int cancelled = 0;
+    int rc;
+
+    memset(result, 0, sizeof(*result));
+    rc = job_start(&job, mode == MODE_DECRYPT, input_file, output_file, passphrase, opts);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    ui_message("Processing...  c: Cancel", COLOR_ACCENT);
+    ui_progress_start(&progress, (mode == MODE_ENCRYPT) ? "Encrypting..." : "Decrypting...");
+
+    while (job_state(&job) == JOB_RUNNING) {
+        const int ch = ui_poll_key(1000 / UI_PROGRESS_HZ);
+
+        if (!cancelled && (ch == 'c' || ch == 'C')) {
+            job_cancel(&job);
+            ui_message("Cancelling...           ", COLOR_WARNING);
+            cancelled = 1;
+        }
+        job_progress(&job, &done, &total);
+        ui_progress_update(&progress, done, total);
+    }
+
+    rc = job_wait(&job);
+    *result = job.result;
+    /* io_path pointed at the job's copies */
+    if (result->io_path) {
+        result->io_path = (result->io_path == job.input) ? input_file : output_file;
+    }
+    return rc;
 }
 
 static int perform_operation(
@@ -42,146 +283,641 @@ static int perform_operation(
     const char *passphrase,
     const char *input_file,
     const char *output_file,
+    const stream_opts_t *opts,
     int use_ui
 ) {
-    unsigned char *input_buffer = NULL;
-    unsigned char *output_buffer = NULL;
-    size_t input_size = 0;
-    size_t output_size = 0;
-    int result = EXIT_FAILURE;
-    int io_result = FIO_SUCCESS;
+    stream_result_t result;
     int enc_result = ENC_SUCCESS;
 
     const char *operation = (mode == MODE_ENCRYPT) ? "Encrypt" : "Decrypt";
 
     if (use_ui) {
         ui_clear_content();
-        ui_message("Reading input file...", COLOR_ACCENT);
+        enc_result = run_ui_job(mode, passphrase, input_file, output_file, opts, &result);
     } else {
         printf("Reading input file: %s\n", input_file);
+        if (mode == MODE_ENCRYPT) {
+            enc_result = stream_encrypt_file(input_file, output_file, passphrase, opts, &result);
+        } else {
+            enc_result = stream_decrypt_file(input_file, output_file, passphrase, opts, &result);
+        }
     }
 
-    io_result = read_file(input_file, &input_buffer, &input_size);
-    if (io_result != FIO_SUCCESS) {
+    if (enc_result != ENC_SUCCESS) {
+        const char *detail = (enc_result == ENC_ERR_IO)
+            ? fio_strerror(result.io_error) : enc_strerror(enc_result);
+
         if (use_ui) {
-            ui_error(fio_strerror(io_result));
+            ui_error(detail);
             ui_wait_key("Press any key to continue...");
+        } else if (enc_result == ENC_ERR_IO && result.io_path) {
+            fprintf(stderr, "Error: %s: %s\n", detail, result.io_path);
         } else {
-            fprintf(stderr, "Error: %s: %s\n", fio_strerror(io_result), input_file);
+            fprintf(stderr, "Error: %s\n", detail);
         }
         return EXIT_FAILURE;
     }
 
     if (use_ui) {
-        ui_progress_bar("Processing...", 0.3f);
+        ui_clear_content();
+        ui_show_summary(operation, enc_alg_name(result.algorithm), input_file, output_file,
+                        (size_t)result.bytes_out);
+        ui_wait_key("Press any key to continue...");
     } else {
-        printf("Read %zu bytes\n", input_size);
+        printf("Read %llu bytes\n", (unsigned long long)result.bytes_in);
+        printf("Successfully wrote %llu bytes to %s (%s)\n",
+               (unsigned long long)result.bytes_out, output_file, enc_alg_name(result.algorithm));
+        printf("Done!\n");
     }
 
-    if (mode == MODE_ENCRYPT) {
-        enc_result = aes_encrypt_payload(
-            input_buffer,
-            input_size,
-            passphrase,
-            &output_buffer,
-            &output_size
-        );
+    return EXIT_SUCCESS;
+}
+
+/* --rekey, --add-key, --remove-key on one file: header-only edits */
+static int perform_key_update(int mode, const char *passphrase, const char *new_passphrase,
+                              const char *input_file, const stream_opts_t *opts) {
+    stream_result_t result;
+    int rc;
+
+    if (mode == MODE_ADD_KEY) {
+        rc = stream_add_key_file(input_file, passphrase, new_passphrase, opts->kdf_iterations,
+                                 &result);
+    } else if (mode == MODE_REMOVE_KEY) {
+        rc = stream_remove_key_file(input_file, passphrase, &result);
     } else {
-        enc_result = aes_decrypt_payload(
-            input_buffer,
-            input_size,
-            passphrase,
-            &output_buffer,
-            &output_size
-        );
+        rc = stream_rekey_file(input_file, passphrase, new_passphrase, opts->kdf_iterations,
+                               &result);
     }
 
-    if (enc_result != ENC_SUCCESS) {
-        if (use_ui) {
-            ui_error(enc_strerror(enc_result));
-            ui_wait_key("Press any key to continue...");
+    if (rc != ENC_SUCCESS) {
+        const char *detail = (rc == ENC_ERR_IO)
+            ? fio_strerror(result.io_error) : enc_strerror(rc);
+
+        if (rc == ENC_ERR_IO && result.io_path) {
+            fprintf(stderr, "Error: %s: %s\n", detail, result.io_path);
         } else {
-            fprintf(stderr, "Error: %s\n", enc_strerror(enc_result));
+            fprintf(stderr, "Error: %s\n", detail);
         }
-        goto cleanup;
+        return EXIT_FAILURE;
     }
 
-    if (use_ui) {
-        ui_progress_bar("Processing...", 0.7f);
+    printf("Rewrote %llu-byte header of %s (%s); payload untouched\n",
+           (unsigned long long)result.bytes_out, input_file, enc_alg_name(result.algorithm));
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+static int perform_vault_rekey(const char *passphrase, const char *new_passphrase,
+                               const char *dir, const stream_opts_t *opts, int resume) {
+    vault_opts_t vopts;
+    vault_result_t result;
+    int rc;
+
+    vault_opts_init(&vopts);
+    vopts.threads = opts->threads;
+    vopts.iterations = opts->kdf_iterations;
+    vopts.resume = resume;
+
+    rc = vault_rekey(dir, passphrase, new_passphrase, &vopts, &result, stderr);
+    if (rc != ENC_SUCCESS && rc != ENC_ERR_DECRYPT) {
+        fprintf(stderr, "Error: %s\n", enc_strerror(rc));
+        return EXIT_FAILURE;
     }
 
-    io_result = write_file(output_file, output_buffer, output_size);
-    if (io_result != FIO_SUCCESS) {
-        if (use_ui) {
-            ui_error(fio_strerror(io_result));
-            ui_wait_key("Press any key to continue...");
+    printf("Rekeyed %llu of %llu files in %s (%llu already current, %llu restored, "
+           "%llu failed)\n",
+           (unsigned long long)result.rewrapped, (unsigned long long)result.files, dir,
+           (unsigned long long)result.current, (unsigned long long)result.restored,
+           (unsigned long long)result.failed);
+    printf("%llu key derivations, %llu header bytes written\n",
+           (unsigned long long)result.kdf_calls, (unsigned long long)result.bytes_written);
+    if (result.failed) {
+        fprintf(stderr, "Error: %llu files were not rekeyed; journal kept for --resume\n",
+                (unsigned long long)result.failed);
+        return EXIT_FAILURE;
+    }
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+static int perform_batch(int mode, const char *passphrase, const char *manifest,
+                         const batch_opts_t *bopts, const stream_opts_t *opts) {
+    batch_result_t result;
+    int rc = batch_run(manifest, passphrase, mode == MODE_DECRYPT, bopts, opts, &result, stdout);
+
+    if (rc == ENC_ERR_INVALID_FORMAT && result.bad_line) {
+        fprintf(stderr, "Error: %s: line %llu is not INPUT<TAB>OUTPUT\n", manifest,
+                (unsigned long long)result.bad_line);
+        return EXIT_FAILURE;
+    }
+    if (rc != ENC_SUCCESS && result.failed == 0) {
+        fprintf(stderr, "Error: %s: %s\n", manifest, enc_strerror(rc));
+        return EXIT_FAILURE;
+    }
+
+    const double secs = (double)result.wall_ns / 1e9;
+    printf("%s %llu of %llu files (%llu failed)\n", mode == MODE_DECRYPT ? "Decrypted" : "Encrypted",
+           (unsigned long long)result.succeeded, (unsigned long long)result.files,
+           (unsigned long long)result.failed);
+    printf("%llu bytes in, %llu bytes out in %.3f s (%.1f MB/s, %.1f files/s), "
+           "%llu key derivations, %llu group syncs\n",
+           (unsigned long long)result.bytes_in, (unsigned long long)result.bytes_out, secs,
+           secs > 0.0 ? (double)result.bytes_in / 1e6 / secs : 0.0,
+           secs > 0.0 ? (double)result.files / secs : 0.0,
+           (unsigned long long)result.kdf_calls, (unsigned long long)result.syncs);
+    if (result.skipped || result.resumed) {
+        printf("Resumed: %llu files already done, %llu continued from a checkpoint\n",
+               (unsigned long long)result.skipped, (unsigned long long)result.resumed);
+    }
+    if (result.failed) {
+        fprintf(stderr, "Error: %llu files failed (first: %s)%s\n",
+                (unsigned long long)result.failed, enc_strerror(rc),
+                strcmp(manifest, "-") != 0 ? "; journal kept for --resume" : "");
+        return EXIT_FAILURE;
+    }
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+static int perform_update(const char *passphrase, const char *input_file,
+                          const char *output_file, const stream_opts_t *opts) {
+    stream_result_t result;
+    int rc = stream_update_file(output_file, input_file, passphrase, opts, &result);
+
+    if (rc == ENC_ERR_INVALID_ARG) {
+        fprintf(stderr, "Error: %s is not the length %s was encrypted at; use -e instead\n",
+                input_file, output_file);
+        return EXIT_FAILURE;
+    }
+    if (rc != ENC_SUCCESS) {
+        const char *detail = (rc == ENC_ERR_IO)
+            ? fio_strerror(result.io_error) : enc_strerror(rc);
+
+        if (rc == ENC_ERR_IO && result.io_path) {
+            fprintf(stderr, "Error: %s: %s\n", detail, result.io_path);
         } else {
-            fprintf(stderr, "Error: %s: %s\n", fio_strerror(io_result), output_file);
+            fprintf(stderr, "Error: %s\n", detail);
         }
-        goto cleanup;
+        return EXIT_FAILURE;
     }
 
-    if (use_ui) {
-        ui_progress_bar("Processing...", 1.0f);
-        ui_clear_content();
-        ui_show_summary(operation, "AES-256-GCM", input_file, output_file, output_size);
-        ui_wait_key("Press any key to continue...");
+    printf("Read %llu bytes\n", (unsigned long long)result.bytes_in);
+    printf("Resealed %llu changed segments of %s in place (%s), wrote %llu bytes\n",
+           (unsigned long long)result.segments_updated, output_file,
+           enc_alg_name(result.algorithm), (unsigned long long)result.bytes_out);
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+static int perform_snapshot(const char *input_file, const char *output_file) {
+    static const char *const methods[] = { "", "reflink", "copy_file_range", "streamed copy" };
+    uint64_t bytes = 0;
+    int method = 0;
+    int rc = fio_snapshot(input_file, output_file, &method, &bytes);
+
+    if (rc != FIO_SUCCESS) {
+        fprintf(stderr, "Error: %s: %s\n", fio_strerror(rc), output_file);
+        return EXIT_FAILURE;
+    }
+    printf("Snapshot of %s at %s: %llu bytes by %s\n", input_file, output_file,
+           (unsigned long long)bytes, methods[method]);
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+static int perform_wipe(const char *input_file, int passes) {
+    wipe_opts_t wopts;
+    wipe_result_t result;
+    int rc;
+
+    wipe_opts_init(&wopts);
+    wopts.passes = passes;
+
+    rc = wipe_file(input_file, &wopts, &result);
+    if (rc != ENC_SUCCESS) {
+        const char *detail = (rc == ENC_ERR_IO)
+            ? fio_strerror(result.io_error) : enc_strerror(rc);
+        fprintf(stderr, "Error: %s: %s\n", detail, input_file);
+        return EXIT_FAILURE;
+    }
+
+    printf("Wiped %s: %d passes over %llu bytes (%llu written), blocks %s\n", input_file,
+           result.passes, (unsigned long long)result.bytes,
+           (unsigned long long)result.bytes_written,
+           result.discarded ? "discarded" : "not discarded");
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+/* --put / --get against a --store directory */
+static int perform_store_operation(int mode, const char *passphrase, const char *store,
+                                   const char *name, const char *input_file,
+                                   const char *output_file, const stream_opts_t *opts) {
+    chunk_opts_t copts;
+    chunk_result_t result;
+    char base[256];
+    uint32_t version = 0;
+    int rc;
+
+    chunk_opts_init(&copts);
+    copts.threads = opts->threads;
+    copts.kdf_iterations = opts->kdf_iterations;
+
+    if (mode == MODE_PUT) {
+        rc = chunk_put(store, name, input_file, passphrase, &copts, &result);
     } else {
-        printf("Successfully wrote %zu bytes to %s\n", output_size, output_file);
-        printf("Done!\n");
+        /* NAME@N selects a version */
+        const char *at = strrchr(name, '@');
+        if (at && at[1] != '\0' && (size_t)(at - name) < sizeof(base)) {
+            char *end = NULL;
+            unsigned long v = strtoul(at + 1, &end, 10);
+            if (*end != '\0' || v == 0 || v > UINT32_MAX) {
+                fprintf(stderr, "Error: Invalid version in %s\n", name);
+                return EXIT_FAILURE;
+            }
+            memcpy(base, name, (size_t)(at - name));
+            base[at - name] = '\0';
+            name = base;
+            version = (uint32_t)v;
+        }
+        rc = chunk_get(store, name, version, output_file, passphrase, &copts, &result);
     }
 
-    result = EXIT_SUCCESS;
+    if (rc != ENC_SUCCESS) {
+        const char *detail = (rc == ENC_ERR_IO)
+            ? fio_strerror(result.io_error) : enc_strerror(rc);
+
+        if (rc == ENC_ERR_IO && result.io_path) {
+            fprintf(stderr, "Error: %s: %s\n", detail, result.io_path);
+        } else {
+            fprintf(stderr, "Error: %s\n", detail);
+        }
+        return EXIT_FAILURE;
+    }
 
-cleanup:
-    if (input_buffer) free(input_buffer);
-    if (output_buffer) free(output_buffer);
-    return result;
+    if (mode == MODE_PUT) {
+        printf("Stored %s as version %u of %s (%llu bytes, %llu chunks)\n", input_file,
+               result.version, name, (unsigned long long)result.bytes,
+               (unsigned long long)result.chunks);
+        printf("%llu new chunks, %llu bytes written; %llu chunks deduplicated\n",
+               (unsigned long long)result.new_chunks, (unsigned long long)result.new_bytes,
+               (unsigned long long)(result.chunks - result.new_chunks));
+    } else {
+        printf("Restored version %u of %s to %s (%llu bytes, %llu chunks)\n", result.version,
+               name, output_file, (unsigned long long)result.bytes,
+               (unsigned long long)result.chunks);
+    }
+    printf("Done!\n");
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Ask for the algorithm (encrypt only), both paths and the passphrase.
+ * Returns 0 if the user backed out of a menu.
+ */
+static int prompt_operation(int mode, stream_opts_t *opts, char *input_file, int input_len,
+                            char *output_file, int output_len, char *key, int key_len) {
+    stream_opts_init(opts);
+
+    if (mode == MODE_ENCRYPT) {
+        menu_item_t alg_menu[] = {
+            {"[1] AES-256-GCM", ENC_ALG_AES_256_GCM},
+            {"[2] ChaCha20-Poly1305", ENC_ALG_CHACHA20_POLY1305},
+            {"[3] AES-256-CBC + HMAC-SHA256", ENC_ALG_AES_256_CBC_HMAC}
+        };
+
+        ui_clear_content();
+        opts->algorithm = ui_show_menu("Select Algorithm", alg_menu, 3);
+        if (opts->algorithm == -1) {
+            return 0;
+        }
+    }
+
+    ui_clear_content();
+    ui_get_string("Input file path:", input_file, input_len);
+
+    ui_clear_content();
+    ui_get_string("Output file path:", output_file, output_len);
+
+    ui_clear_content();
+    ui_get_string("Enter passphrase:", key, key_len);
+    return 1;
+}
+
+typedef struct {
+    job_t job;
+    const char *status;    /* Row text once the job has been collected */
+} queue_entry_t;
+
+/* Row status for a collected job */
+static const char *queue_status(const job_t *job) {
+    if (job->rc == ENC_SUCCESS) {
+        return "done";
+    }
+    if (job->rc == ENC_ERR_CANCELLED) {
+        return "cancelled";
+    }
+    return (job->rc == ENC_ERR_IO) ? fio_strerror(job->result.io_error) : enc_strerror(job->rc);
+}
+
+/* Whether queue_make_room() will succeed: a free row or a finished job */
+static int queue_has_room(queue_entry_t *const *entries, int count) {
+    for (int i = 0; count >= QUEUE_MAX_JOBS && i < count; i++) {
+        if (entries[i]->status) {
+            return 1;
+        }
+    }
+    return count < QUEUE_MAX_JOBS;
+}
+
+/* Make room for one more row by dropping the oldest finished one; its
+ * bytes move to *retired so the aggregate rate does not jump back */
+static int queue_make_room(queue_entry_t **entries, int *count, uint64_t *retired) {
+    if (*count < QUEUE_MAX_JOBS) {
+        return 1;
+    }
+    for (int i = 0; i < *count; i++) {
+        if (entries[i]->status) {
+            *retired += __atomic_load_n(&entries[i]->job.done, __ATOMIC_RELAXED);
+            mem_free(entries[i]);
+            memmove(&entries[i], &entries[i + 1], (size_t)(*count - i - 1) * sizeof(*entries));
+            (*count)--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Job queue screen: queue several encrypt/decrypt jobs and run up to
+ * QUEUE_PARALLEL of them at once, each on its own thread with a share of
+ * the cores. The totals line compares process CPU with host I/O wait to
+ * show whether the cores or the disks are the limit.
+ */
+static void run_queue_mode(void) {
+    queue_entry_t *entries[QUEUE_MAX_JOBS];
+    ui_job_row_t rows[QUEUE_MAX_JOBS];
+    ui_job_totals_t totals;
+    stats_load_t last_load;
+    stats_load_t load;
+    stats_live_t live_before;     /* Dashboard: the last two counter samples */
+    stats_live_t live_after;
+    double live_interval = 0.0;
+    int dashboard = 0;
+    uint64_t last_bytes = 0;
+    uint64_t retired_bytes = 0;   /* Progress of rows already dropped */
+    const char *note = "";
+    int count = 0;
+    int selected = 0;
+    int quitting = 0;
+
+    memset(&totals, 0, sizeof(totals));
+    totals.cpus = tp_default_threads();
+    stats_load_sample(&last_load);
+    stats_live_get(&live_after);
+    live_before = live_after;
+
+    while (1) {
+        uint64_t bytes = retired_bytes;
+        int running = 0;
+        int queued = 0;
+
+        /* Collect finished jobs */
+        for (int i = 0; i < count; i++) {
+            job_t *job = &entries[i]->job;
+            const int state = job_state(job);
+
+            if (state == JOB_DONE ||
+                (state == JOB_QUEUED && __atomic_load_n(&job->cancel, __ATOMIC_RELAXED))) {
+                job_wait(job);
+                entries[i]->status = queue_status(job);
+            } else if (state == JOB_RUNNING) {
+                running++;
+            } else if (state == JOB_QUEUED) {
+                queued++;
+            }
+        }
+
+        /* Start queued jobs in order as slots free up; each gets an even
+         * share of the cores across the jobs that will run together */
+        for (int i = 0; i < count && running < QUEUE_PARALLEL; i++) {
+            job_t *job = &entries[i]->job;
+            if (job_state(job) != JOB_QUEUED) {
+                continue;
+            }
+            const int sharing = (running + queued < QUEUE_PARALLEL) ? running + queued
+                                                                     : QUEUE_PARALLEL;
+            job->opts.threads = totals.cpus / sharing > 0 ? totals.cpus / sharing : 1;
+            if (job_run(job) != ENC_SUCCESS) {
+                note = "Could not start a worker thread";
+                break;
+            }
+            running++;
+            queued--;
+        }
+
+        if (quitting && running == 0 && queued == 0) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            job_t *job = &entries[i]->job;
+            const int state = job_state(job);
+            const double elapsed = job_elapsed(job);
+
+            job_progress(job, &rows[i].done, &rows[i].total);
+            rows[i].operation = job->decrypt ? "Decrypt" : "Encrypt";
+            rows[i].input = job->input;
+            rows[i].status = entries[i]->status ? entries[i]->status
+                           : (state == JOB_RUNNING || state == JOB_DONE) ? "running" : "queued";
+            rows[i].rate = elapsed > 0.0 ? (double)rows[i].done / elapsed : 0.0;
+            bytes += rows[i].done;
+        }
+
+        stats_load_sample(&load);
+        if (load.wall_ns - last_load.wall_ns >= QUEUE_SAMPLE_NS) {
+            totals.rate = (double)(bytes - last_bytes) * 1e9 / (double)(load.wall_ns - last_load.wall_ns);
+            stats_load_delta(&last_load, &load, totals.cpus, &totals.cpu_pct, &totals.iowait_pct);
+            live_interval = (double)(load.wall_ns - last_load.wall_ns) / 1e9;
+            live_before = live_after;
+            stats_live_get(&live_after);
+            last_load = load;
+            last_bytes = bytes;
+        }
+        totals.running = running;
+        totals.queued = queued;
+
+        if (dashboard && !quitting) {
+            ui_show_dashboard(&live_before, &live_after, live_interval, &totals);
+        } else {
+            ui_show_jobs(rows, count, count ? selected : -1, &totals,
+                         quitting ? "Cancelling unfinished jobs..." : note);
+        }
+
+        const int ch = ui_poll_key(1000 / UI_PROGRESS_HZ);
+        if (quitting || ch == ERR) {
+            continue;
+        }
+        if (dashboard) {
+            if (ch == 'p' || ch == 'P' || ch == 'q' || ch == 'Q') {
+                dashboard = 0;
+            }
+            continue;
+        }
+        note = "";
+
+        switch (ch) {
+            case KEY_UP:
+                if (count) selected = (selected - 1 + count) % count;
+                break;
+            case KEY_DOWN:
+                if (count) selected = (selected + 1) % count;
+                break;
+            case 'p':
+            case 'P':
+                dashboard = 1;
+                break;
+            case 'c':
+            case 'C':
+                if (count && !entries[selected]->status) {
+                    job_cancel(&entries[selected]->job);
+                }
+                break;
+            case 'e':
+            case 'E':
+            case 'd':
+            case 'D': {
+                const int mode = (ch == 'd' || ch == 'D') ? MODE_DECRYPT : MODE_ENCRYPT;
+                char input_file[256];
+                char output_file[256];
+                char key[128];
+                stream_opts_t opts;
+                queue_entry_t *entry;
+
+                if (!queue_has_room(entries, count)) {
+                    note = "Queue full: wait for a job to finish";
+                    break;
+                }
+                if (!prompt_operation(mode, &opts, input_file, sizeof(input_file),
+                                      output_file, sizeof(output_file), key, sizeof(key))) {
+                    break;
+                }
+                /* Only now that a job is accepted may a finished row go;
+                 * finished jobs stay finished, so the room is still there */
+                if (!queue_make_room(entries, &count, &retired_bytes)) {
+                    note = "Queue full: wait for a job to finish";
+                    memset(key, 0, sizeof(key));
+                    break;
+                }
+
+                entry = (queue_entry_t *)mem_calloc(1, sizeof(*entry));
+                if (!entry) {
+                    note = enc_strerror(ENC_ERR_MEMORY);
+                } else if (job_init(&entry->job, mode == MODE_DECRYPT, input_file, output_file,
+                                    key, &opts) != ENC_SUCCESS) {
+                    mem_free(entry);
+                    note = "Could not queue the job";
+                } else {
+                    entries[count++] = entry;
+                    selected = count - 1;
+                }
+                memset(key, 0, sizeof(key));
+                break;
+            }
+            case 'q':
+            case 'Q':
+                for (int i = 0; i < count; i++) {
+                    job_cancel(&entries[i]->job);
+                }
+                quitting = 1;
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        job_wait(&entries[i]->job);
+        mem_free(entries[i]);
+    }
 }
 
 static void run_menu_mode(void) {
     ui_init();
+    stats_live_enable();    /* Feeds the job queue's dashboard */
 
     while (1) {
         ui_clear_content();
 
         menu_item_t main_menu[] = {
-            {"[1] Encrypt a File (AES-256-GCM)", MENU_ENCRYPT},
-            {"[2] Decrypt a File (AES-256-GCM)", MENU_DECRYPT},
-            {"[3] Exit", MENU_EXIT}
+            {"[1] Encrypt a File", MENU_ENCRYPT},
+            {"[2] Decrypt a File", MENU_DECRYPT},
+            {"[3] Job Queue", MENU_QUEUE},
+            {"[4] Exit", MENU_EXIT}
         };
 
-        int choice = ui_show_menu("Main Menu", main_menu, 3);
+        int choice = ui_show_menu("Main Menu", main_menu, 4);
         if (choice == -1 || choice == MENU_EXIT) {
             break;
         }
+        if (choice == MENU_QUEUE) {
+            run_queue_mode();
+            continue;
+        }
 
         const int mode = (choice == MENU_ENCRYPT) ? MODE_ENCRYPT : MODE_DECRYPT;
 
+        stream_opts_t opts;
         char input_file[256];
         char output_file[256];
         char key[128];
 
-        ui_clear_content();
-        ui_get_string("Input file path:", input_file, sizeof(input_file));
-
-        ui_clear_content();
-        ui_get_string("Output file path:", output_file, sizeof(output_file));
-
-        ui_clear_content();
-        ui_get_string("Enter passphrase:", key, sizeof(key));
+        if (!prompt_operation(mode, &opts, input_file, sizeof(input_file),
+                              output_file, sizeof(output_file), key, sizeof(key))) {
+            continue;
+        }
 
-        perform_operation(mode, key, input_file, output_file, 1);
+        perform_operation(mode, key, input_file, output_file, &opts, 1);
     }
 
     ui_cleanup();
 }
 
+/* --stats: close the total timer started in main() and print the phases */
+static int report_stats(int rc, int format, stats_timer_t *total) {
+    stats_phase_t read_phase;
+
+    if (format < 0) {
+        return rc;
+    }
+    stats_get(STATS_READ, &read_phase);
+    stats_end(total, STATS_TOTAL, read_phase.bytes, 1);
+    stats_print(stderr, format);
+    return rc;
+}
+
 int main(int argc, char *argv[]) {
     int mode = MODE_NONE;
     const char *passphrase = NULL;
+    const char *new_passphrase = NULL;
     const char *input_file = NULL;
     const char *output_file = NULL;
+    const char *baseline_file = NULL;
+    const char *store_dir = NULL;
+    int wipe_passes = 0;
+    const char *store_name = NULL;
+    const char *manifest = NULL;
+    int stats_format = -1;
+    int resume = 0;
+    int durability = -1;
+    const char *recipients[ENC_MAX_SLOTS];
+    stream_opts_t opts;
+    batch_opts_t batch_opts;
+    bench_opts_t bench;
+
+    stream_opts_init(&opts);
+    batch_opts_init(&batch_opts);
+    bench_opts_init(&bench);
 
     static struct option long_options[] = {
         {"encrypt", no_argument, 0, 'e'},
@@ -189,6 +925,38 @@ int main(int argc, char *argv[]) {
         {"key", required_argument, 0, 'k'},
         {"input", required_argument, 0, 'i'},
         {"output", required_argument, 0, 'o'},
+        {"algorithm", required_argument, 0, 'a'},
+        {"threads", required_argument, 0, 't'},
+        {"segment-size", required_argument, 0, OPT_SEGMENT_SIZE},
+        {"rekey", no_argument, 0, OPT_REKEY},
+        {"new-key", required_argument, 0, OPT_NEW_KEY},
+        {"resume", no_argument, 0, OPT_RESUME},
+        {"recipient", required_argument, 0, OPT_RECIPIENT},
+        {"key-slots", required_argument, 0, OPT_KEY_SLOTS},
+        {"add-key", no_argument, 0, OPT_ADD_KEY},
+        {"remove-key", no_argument, 0, OPT_REMOVE_KEY},
+        {"update", no_argument, 0, OPT_UPDATE},
+        {"snapshot", no_argument, 0, OPT_SNAPSHOT},
+        {"wipe", no_argument, 0, OPT_WIPE},
+        {"passes", required_argument, 0, OPT_PASSES},
+        {"manifest", required_argument, 0, OPT_MANIFEST},
+        {"durability", required_argument, 0, OPT_DURABILITY},
+        {"sequential-io", no_argument, 0, OPT_SEQUENTIAL_IO},
+        {"no-sparse", no_argument, 0, OPT_NO_SPARSE},
+        {"store", required_argument, 0, OPT_STORE},
+        {"put", required_argument, 0, OPT_PUT},
+        {"get", required_argument, 0, OPT_GET},
+        {"max-memory", required_argument, 0, OPT_MAX_MEMORY},
+        {"huge-pages", optional_argument, 0, OPT_HUGE_PAGES},
+        {"stats", optional_argument, 0, OPT_STATS},
+        {"bench", optional_argument, 0, OPT_BENCH},
+        {"bench-max-size", required_argument, 0, OPT_BENCH_MAX_SIZE},
+        {"bench-quick", no_argument, 0, OPT_BENCH_QUICK},
+        {"bench-dir", required_argument, 0, OPT_BENCH_DIR},
+        {"bench-report", required_argument, 0, OPT_BENCH_REPORT},
+        {"bench-seed", required_argument, 0, OPT_BENCH_SEED},
+        {"bench-check", required_argument, 0, OPT_BENCH_CHECK},
+        {"bench-save", required_argument, 0, OPT_BENCH_SAVE},
         {"menu", no_argument, 0, 'm'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
@@ -197,7 +965,7 @@ int main(int argc, char *argv[]) {
     int opt;
     int option_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "edk:i:o:mh", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "edk:i:o:a:t:mh", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'e':
                 mode = MODE_ENCRYPT;
@@ -214,6 +982,165 @@ int main(int argc, char *argv[]) {
             case 'o':
                 output_file = optarg;
                 break;
+            case 'a':
+                opts.algorithm = enc_alg_from_name(optarg);
+                if (opts.algorithm < 0) {
+                    fprintf(stderr, "Error: Unknown algorithm: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                opts.threads = atoi(optarg);
+                if (opts.threads < 1) {
+                    fprintf(stderr, "Error: --threads must be at least 1\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_REKEY:
+                mode = MODE_REKEY;
+                break;
+            case OPT_NEW_KEY:
+                new_passphrase = optarg;
+                break;
+            case OPT_RESUME:
+                resume = 1;
+                break;
+            case OPT_RECIPIENT:
+                if (opts.recipient_count == ENC_MAX_SLOTS - 1) {
+                    fprintf(stderr, "Error: at most %d --recipient options\n", ENC_MAX_SLOTS - 1);
+                    return EXIT_FAILURE;
+                }
+                recipients[opts.recipient_count++] = optarg;
+                opts.recipients = recipients;
+                break;
+            case OPT_KEY_SLOTS:
+                opts.key_slots = atoi(optarg);
+                if (opts.key_slots < 1 || opts.key_slots > ENC_MAX_SLOTS) {
+                    fprintf(stderr, "Error: --key-slots must be between 1 and %d\n", ENC_MAX_SLOTS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_ADD_KEY:
+                mode = MODE_ADD_KEY;
+                break;
+            case OPT_REMOVE_KEY:
+                mode = MODE_REMOVE_KEY;
+                break;
+            case OPT_UPDATE:
+                mode = MODE_UPDATE;
+                break;
+            case OPT_SNAPSHOT:
+                mode = MODE_SNAPSHOT;
+                break;
+            case OPT_WIPE:
+                mode = MODE_WIPE;
+                break;
+            case OPT_PASSES:
+                wipe_passes = atoi(optarg);
+                if (wipe_passes < 1 || wipe_passes > WIPE_MAX_PASSES) {
+                    fprintf(stderr, "Error: --passes must be 1-%d\n", WIPE_MAX_PASSES);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_MANIFEST:
+                manifest = optarg;
+                break;
+            case OPT_DURABILITY:
+                if (parse_durability(optarg, &durability, &batch_opts) != 0) {
+                    fprintf(stderr, "Error: --durability must be none, file or "
+                                    "group[:FILES[:MS]]\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_SEQUENTIAL_IO:
+                opts.sequential_io = 1;
+                break;
+            case OPT_NO_SPARSE:
+                opts.dense = 1;
+                break;
+            case OPT_STORE:
+                store_dir = optarg;
+                break;
+            case OPT_PUT:
+                mode = MODE_PUT;
+                store_name = optarg;
+                break;
+            case OPT_GET:
+                mode = MODE_GET;
+                store_name = optarg;
+                break;
+            case OPT_SEGMENT_SIZE: {
+                unsigned long long size = parse_size(optarg);
+                if (size < ENC_MIN_SEGMENT_SIZE || size > ENC_MAX_SEGMENT_SIZE) {
+                    fprintf(stderr, "Error: --segment-size must be between %d and %d bytes\n",
+                            ENC_MIN_SEGMENT_SIZE, ENC_MAX_SEGMENT_SIZE);
+                    return EXIT_FAILURE;
+                }
+                opts.segment_size = (uint32_t)size;
+                break;
+            }
+            case OPT_MAX_MEMORY:
+                opts.max_memory = parse_size(optarg);
+                if (opts.max_memory == 0) {
+                    fprintf(stderr, "Error: Invalid --max-memory: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                mem_set_limit(opts.max_memory);
+                break;
+            case OPT_HUGE_PAGES: {
+                int pages = optarg ? secmem_pages_from_name(optarg) : SECMEM_PAGES_THP;
+                if (pages < 0) {
+                    fprintf(stderr, "Error: Unknown huge page mode: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                secmem_set_pages(pages);
+                break;
+            }
+            case OPT_STATS:
+                if (!optarg || strcmp(optarg, "text") == 0) {
+                    stats_format = STATS_FORMAT_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    stats_format = STATS_FORMAT_JSON;
+                } else {
+                    fprintf(stderr, "Error: Unknown stats format: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_BENCH:
+                mode = MODE_BENCH;
+                bench.format = bench_format_from_name(optarg);
+                if (bench.format < 0) {
+                    fprintf(stderr, "Error: Unknown benchmark format: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_BENCH_MAX_SIZE:
+                bench.max_size = parse_size(optarg);
+                if (bench.max_size == 0) {
+                    fprintf(stderr, "Error: Invalid --bench-max-size: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_BENCH_QUICK:
+                bench.quick = 1;
+                break;
+            case OPT_BENCH_DIR:
+                bench.dir = optarg;
+                break;
+            case OPT_BENCH_REPORT:
+                bench.report_path = optarg;
+                break;
+            case OPT_BENCH_SEED:
+                bench.seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_BENCH_CHECK:
+                mode = MODE_BENCH_CHECK;
+                baseline_file = optarg;
+                break;
+            case OPT_BENCH_SAVE:
+                mode = MODE_BENCH_SAVE;
+                baseline_file = optarg;
+                break;
             case 'm':
                 mode = MODE_MENU;
                 break;
@@ -231,16 +1158,111 @@ int main(int argc, char *argv[]) {
         return EXIT_SUCCESS;
     }
 
+    if (mode == MODE_BENCH) {
+        bench.threads = opts.threads;
+        return bench_run(&bench, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (mode == MODE_BENCH_CHECK) {
+        return bench_check(&bench, baseline_file, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (mode == MODE_BENCH_SAVE) {
+        return bench_save_baseline(&bench, baseline_file, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if (mode == MODE_NONE) {
-        fprintf(stderr, "Error: Must specify -e, -d, or --menu\n");
+        fprintf(stderr, "Error: Must specify -e, -d, --rekey, --add-key, --remove-key, --update, "
+                        "--snapshot, --wipe, --put, --get, --menu or --bench\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    /* Every operation below reports --stats, not only -e/-d */
+    stats_timer_t total;
+    if (stats_format >= 0) {
+        stats_enable();
+        stats_begin(&total);
+    }
+
+    if (mode == MODE_REKEY) {
+        if (!passphrase || !new_passphrase || !input_file) {
+            fprintf(stderr, "Error: --rekey needs -k, --new-key and -i\n");
+            return EXIT_FAILURE;
+        }
+        struct stat st;
+        if (stat(input_file, &st) == 0 && S_ISDIR(st.st_mode)) {
+            return report_stats(perform_vault_rekey(passphrase, new_passphrase, input_file,
+                                                    &opts, resume),
+                                stats_format, &total);
+        }
+        return report_stats(perform_key_update(mode, passphrase, new_passphrase, input_file, &opts),
+                            stats_format, &total);
+    }
+
+    if (mode == MODE_ADD_KEY || mode == MODE_REMOVE_KEY) {
+        if (!passphrase || !input_file || (mode == MODE_ADD_KEY && !new_passphrase)) {
+            fprintf(stderr, "Error: %s needs -k%s and -i\n",
+                    mode == MODE_ADD_KEY ? "--add-key" : "--remove-key",
+                    mode == MODE_ADD_KEY ? ", --new-key" : "");
+            return EXIT_FAILURE;
+        }
+        return report_stats(perform_key_update(mode, passphrase, new_passphrase, input_file, &opts),
+                            stats_format, &total);
+    }
+
+    if (mode == MODE_PUT || mode == MODE_GET) {
+        const char *file = (mode == MODE_PUT) ? input_file : output_file;
+        if (!passphrase || !store_dir || !file) {
+            fprintf(stderr, "Error: %s needs --store, -k and %s\n",
+                    mode == MODE_PUT ? "--put" : "--get", mode == MODE_PUT ? "-i" : "-o");
+            return EXIT_FAILURE;
+        }
+        return report_stats(perform_store_operation(mode, passphrase, store_dir, store_name,
+                                                    input_file, output_file, &opts),
+                            stats_format, &total);
+    }
+
+    if (mode == MODE_WIPE) {
+        if (!input_file) {
+            fprintf(stderr, "Error: --wipe needs -i\n");
+            return EXIT_FAILURE;
+        }
+        return report_stats(perform_wipe(input_file, wipe_passes), stats_format, &total);
+    }
+
+    if (mode == MODE_SNAPSHOT) {
+        if (!input_file || !output_file) {
+            fprintf(stderr, "Error: --snapshot needs -i and -o\n");
+            return EXIT_FAILURE;
+        }
+        return report_stats(perform_snapshot(input_file, output_file), stats_format, &total);
+    }
+
+    if (manifest) {
+        if (!passphrase || (mode != MODE_ENCRYPT && mode != MODE_DECRYPT)) {
+            fprintf(stderr, "Error: --manifest needs -e or -d, and -k\n");
+            return EXIT_FAILURE;
+        }
+        batch_opts.resume = resume;
+        opts.durability = durability >= 0 ? durability : FIO_SYNC_GROUP;
+        return report_stats(perform_batch(mode, passphrase, manifest, &batch_opts, &opts),
+                            stats_format, &total);
+    }
+
+    /* A single output is its own group */
+    opts.durability = durability == FIO_SYNC_NONE ? FIO_SYNC_NONE : FIO_SYNC_FILE;
+
     if (!passphrase || !input_file || !output_file) {
         fprintf(stderr, "Error: Must specify -k, -i, and -o\n");
         return EXIT_FAILURE;
     }
 
-    return perform_operation(mode, passphrase, input_file, output_file, 0);
+    if (mode == MODE_UPDATE) {
+        return report_stats(perform_update(passphrase, input_file, output_file, &opts),
+                            stats_format, &total);
+    }
+
+    return report_stats(perform_operation(mode, passphrase, input_file, output_file, &opts, 0),
+                        stats_format, &total);
 }
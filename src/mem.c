@@ -0,0 +1,114 @@
+/*
+ * mem.c - Tracking allocator with peak accounting and an optional budget
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Each block carries a 16-byte prefix recording its size, so mem_free()
+ * can account for it without the caller passing the size back.
+ *
+ * Demonstrates OS concepts:
+ * - Heap management on top of malloc()
+ * - Lock-free accounting with atomic compare-and-swap
+ */
+
+#include "../include/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MEM_PREFIX 16   /* Keeps the returned pointer 16-byte aligned */
+
+static uint64_t current_bytes = 0;
+static uint64_t peak_bytes = 0;
+static uint64_t limit_bytes = 0;
+
+/* Reserve size bytes against the budget; returns 0 if it would not fit */
+static int account_alloc(uint64_t size) {
+    const uint64_t limit = __atomic_load_n(&limit_bytes, __ATOMIC_RELAXED);
+    uint64_t now = __atomic_load_n(&current_bytes, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    do {
+        next = now + size;
+        if (limit != 0 && next > limit) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&current_bytes, &now, next, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint64_t peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+    while (next > peak &&
+           !__atomic_compare_exchange_n(&peak_bytes, &peak, next, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return 1;
+}
+
+int mem_reserve(uint64_t size) {
+    return account_alloc(size);
+}
+
+void mem_release(uint64_t size) {
+    __atomic_fetch_sub(&current_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *mem_alloc(size_t size) {
+    if (size > SIZE_MAX - MEM_PREFIX || !account_alloc(size)) {
+        return NULL;
+    }
+
+    unsigned char *block = (unsigned char *)malloc(size + MEM_PREFIX);
+    if (!block) {
+        __atomic_fetch_sub(&current_bytes, (uint64_t)size, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    memcpy(block, &size, sizeof(size));
+    return block + MEM_PREFIX;
+}
+
+void *mem_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *ptr = mem_alloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void mem_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    unsigned char *block = (unsigned char *)ptr - MEM_PREFIX;
+    size_t size;
+
+    memcpy(&size, block, sizeof(size));
+    __atomic_fetch_sub(&current_bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    free(block);
+}
+
+uint64_t mem_current(void) {
+    return __atomic_load_n(&current_bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t mem_peak(void) {
+    return __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+}
+
+void mem_reset_peak(void) {
+    __atomic_store_n(&peak_bytes, mem_current(), __ATOMIC_RELAXED);
+}
+
+void mem_set_limit(uint64_t limit) {
+    __atomic_store_n(&limit_bytes, limit, __ATOMIC_RELAXED);
+}
+
+uint64_t mem_limit(void) {
+    return __atomic_load_n(&limit_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,383 @@
+/*
+ * secmem.c - Pooled, locked buffers for segment data and key material
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Large blocks get their own page-rounded mapping; small ones (keys,
+ * bookkeeping) are carved from 64 KiB slabs. Every block keeps a 64-byte
+ * header so it can be recycled by exact size without a lookup table.
+ *
+ * Demonstrates OS concepts:
+ * - Anonymous memory mappings: mmap(), munmap()
+ * - Pinning pages in RAM: mlock() and RLIMIT_MEMLOCK
+ * - Thread-local storage and pthread key destructors
+ */
+
+#include "../include/secmem.h"
+#include "../include/mem.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SECMEM_HEADER     64          /* Keeps user pointers 64-byte aligned */
+#define SECMEM_SMALL_MAX  4096        /* Largest block carved from a slab */
+#define SECMEM_SLAB_SIZE  (64 * 1024)
+#define SECMEM_TLS_BLOCKS 8           /* Per-thread list length before spilling */
+#define SECMEM_HUGE_PAGE  (2 * 1024 * 1024)  /* Blocks this big may use huge pages */
+
+#ifdef MAP_POPULATE
+#define SECMEM_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE)
+#else
+#define SECMEM_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+#endif
+
+typedef struct block {
+    size_t size;                      /* Total size including this header */
+    size_t map_len;                   /* Mapping length (size rounded for huge pages) */
+    struct block *next;
+    int mapped;                       /* Own mapping (1) or slab carve (0) */
+    int locked;
+    int huge;
+} block_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static block_t *shared_free = NULL;
+static unsigned char *slab_next = NULL;
+static size_t slab_left = 0;
+static secmem_stats_t counters;
+static int page_mode = SECMEM_PAGES_DEFAULT;
+
+static __thread block_t *tls_free = NULL;
+static __thread int tls_count = 0;
+static pthread_key_t tls_key;
+static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+
+/* memset that the compiler may not drop as a dead store */
+static void wipe(void *ptr, size_t len) {
+    memset(ptr, 0, len);
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
+
+static size_t page_size(void) {
+    static size_t cached = 0;
+    if (cached == 0) {
+        long page = sysconf(_SC_PAGESIZE);
+        cached = page > 0 ? (size_t)page : 4096;
+    }
+    return cached;
+}
+
+/* Hand a dying thread's cached blocks to the shared list */
+static void tls_flush(void *unused) {
+    (void)unused;
+
+    pthread_mutex_lock(&pool_lock);
+    while (tls_free) {
+        block_t *b = tls_free;
+        tls_free = b->next;
+        b->next = shared_free;
+        shared_free = b;
+    }
+    tls_count = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void tls_init(void) {
+    pthread_key_create(&tls_key, tls_flush);
+}
+
+/*
+ * Reserve len bytes backed by huge pages, or return NULL. hugetlbfs pages
+ * must be reserved by the administrator (vm.nr_hugepages), so the usual
+ * outcome of MAP_HUGETLB is ENOMEM; transparent huge pages need a 2 MiB
+ * aligned range, so the mapping is over-allocated and trimmed.
+ */
+static unsigned char *map_huge(size_t len, int mode) {
+    unsigned char *p;
+
+#ifdef MAP_HUGETLB
+    if (mode == SECMEM_PAGES_HUGETLB) {
+        p = (unsigned char *)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    p = (unsigned char *)mmap(NULL, len + SECMEM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    const size_t head = (SECMEM_HUGE_PAGE - (uintptr_t)p % SECMEM_HUGE_PAGE) % SECMEM_HUGE_PAGE;
+    if (head) {
+        munmap(p, head);
+    }
+    munmap(p + head + len, SECMEM_HUGE_PAGE - head);
+    p += head;
+
+    if (madvise(p, len, MADV_HUGEPAGE) == 0) {
+        return p;   /* Faulted in below, after the advice is in place */
+    }
+    munmap(p, len);
+#else
+    (void)len;
+    (void)mode;
+#endif
+    return NULL;
+}
+
+/* Map, pre-fault and lock len bytes; returns NULL if mmap fails */
+static unsigned char *map_region(size_t len, int *locked, int *huge) {
+    unsigned char *p = NULL;
+
+    *huge = 0;
+    if (page_mode != SECMEM_PAGES_DEFAULT && len >= SECMEM_HUGE_PAGE) {
+        p = map_huge(len, page_mode);
+        *huge = p != NULL;
+    }
+    if (!p) {
+        p = (unsigned char *)mmap(NULL, len, PROT_READ | PROT_WRITE, SECMEM_MAP_FLAGS, -1, 0);
+        if (p == MAP_FAILED) {
+            return NULL;
+        }
+    }
+#ifdef MADV_DONTDUMP
+    madvise(p, len, MADV_DONTDUMP);   /* Keep secrets out of core dumps */
+#endif
+
+    *locked = mlock(p, len) == 0;
+    if (!*locked) {
+        /* Over RLIMIT_MEMLOCK: still fault the pages in up front */
+        for (size_t off = 0; off < len; off += page_size()) {
+            p[off] = 0;
+        }
+    }
+
+    const uint64_t mapped = __atomic_add_fetch(&counters.mapped_bytes, len, __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&counters.peak_mapped_bytes, __ATOMIC_RELAXED);
+    while (mapped > peak &&
+           !__atomic_compare_exchange_n(&counters.peak_mapped_bytes, &peak, mapped, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    if (*locked) {
+        __atomic_fetch_add(&counters.locked_bytes, len, __ATOMIC_RELAXED);
+    }
+    if (*huge) {
+        __atomic_fetch_add(&counters.huge_bytes, len, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+static void unmap_region(void *p, size_t len, int locked, int huge) {
+    if (locked) {
+        munlock(p, len);
+        __atomic_fetch_sub(&counters.locked_bytes, len, __ATOMIC_RELAXED);
+    }
+    if (huge) {
+        __atomic_fetch_sub(&counters.huge_bytes, len, __ATOMIC_RELAXED);
+    }
+    munmap(p, len);
+    __atomic_fetch_sub(&counters.mapped_bytes, len, __ATOMIC_RELAXED);
+    mem_release(len);
+}
+
+/* Unlink the first block of exactly `size` bytes from *list */
+static block_t *take(block_t **list, size_t size) {
+    for (block_t **link = list; *link; link = &(*link)->next) {
+        if ((*link)->size == size) {
+            block_t *b = *link;
+            *link = b->next;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Create a new block; caller holds pool_lock */
+static block_t *create_block(size_t size) {
+    block_t *b;
+    size_t map_len = size;
+    int locked = 0;
+    int huge = 0;
+
+    if (size > SECMEM_SMALL_MAX) {
+        unsigned char *p;
+
+        if (page_mode != SECMEM_PAGES_DEFAULT && size >= SECMEM_HUGE_PAGE) {
+            map_len = (size + SECMEM_HUGE_PAGE - 1) & ~(size_t)(SECMEM_HUGE_PAGE - 1);
+        }
+        if (!mem_reserve(map_len)) {
+            return NULL;
+        }
+        p = map_region(map_len, &locked, &huge);
+        if (!p) {
+            mem_release(map_len);
+            return NULL;
+        }
+        b = (block_t *)p;
+        b->mapped = 1;
+    } else {
+        if (slab_left < size) {
+            if (!mem_reserve(SECMEM_SLAB_SIZE)) {
+                return NULL;
+            }
+            slab_next = map_region(SECMEM_SLAB_SIZE, &locked, &huge);
+            if (!slab_next) {
+                mem_release(SECMEM_SLAB_SIZE);
+                slab_left = 0;
+                return NULL;
+            }
+            slab_left = SECMEM_SLAB_SIZE;
+        }
+        b = (block_t *)slab_next;
+        slab_next += size;
+        slab_left -= size;
+        b->mapped = 0;
+    }
+
+    b->size = size;
+    b->map_len = map_len;
+    b->locked = locked;
+    b->huge = huge;
+    b->next = NULL;
+    __atomic_fetch_add(&counters.maps, 1, __ATOMIC_RELAXED);
+    return b;
+}
+
+/* Unmap cached mapped blocks from *list; slab blocks stay listed.
+ * Returns the number of blocks left. */
+static int trim_list(block_t **list) {
+    block_t **link = list;
+    int left = 0;
+
+    while (*link) {
+        block_t *b = *link;
+        if (b->mapped) {
+            *link = b->next;
+            __atomic_fetch_sub(&counters.cached_bytes, b->size, __ATOMIC_RELAXED);
+            unmap_region(b, b->map_len, b->locked, b->huge);
+        } else {
+            link = &b->next;
+            left++;
+        }
+    }
+    return left;
+}
+
+void *secmem_alloc(size_t size) {
+    block_t *b;
+    size_t total;
+
+    if (size > SIZE_MAX - SECMEM_HEADER - page_size()) {
+        return NULL;
+    }
+
+    total = size + SECMEM_HEADER;
+    if (total > SECMEM_SMALL_MAX) {
+        total = (total + page_size() - 1) & ~(page_size() - 1);
+    } else {
+        total = (total + SECMEM_HEADER - 1) & ~(size_t)(SECMEM_HEADER - 1);
+    }
+
+    /* Fast path: this thread's own list, no locking */
+    b = take(&tls_free, total);
+    if (b) {
+        tls_count--;
+    } else {
+        pthread_mutex_lock(&pool_lock);
+        b = take(&shared_free, total);
+        if (!b) {
+            b = create_block(total);
+            if (!b) {
+                /* Cached blocks of other sizes may be what is over budget */
+                tls_count = trim_list(&tls_free);
+                trim_list(&shared_free);
+                b = create_block(total);
+            }
+            pthread_mutex_unlock(&pool_lock);
+            return b ? (unsigned char *)b + SECMEM_HEADER : NULL;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    __atomic_fetch_sub(&counters.cached_bytes, b->size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters.reuses, 1, __ATOMIC_RELAXED);
+    return (unsigned char *)b + SECMEM_HEADER;
+}
+
+void secmem_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    block_t *b = (block_t *)((unsigned char *)ptr - SECMEM_HEADER);
+    wipe(ptr, b->size - SECMEM_HEADER);
+    __atomic_fetch_add(&counters.cached_bytes, b->size, __ATOMIC_RELAXED);
+
+    if (tls_count < SECMEM_TLS_BLOCKS) {
+        if (tls_free == NULL) {
+            pthread_once(&tls_once, tls_init);
+            pthread_setspecific(tls_key, &tls_free);  /* Arms tls_flush at exit */
+        }
+        b->next = tls_free;
+        tls_free = b;
+        tls_count++;
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    b->next = shared_free;
+    shared_free = b;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void secmem_trim(void) {
+    pthread_mutex_lock(&pool_lock);
+    tls_count = trim_list(&tls_free);
+    trim_list(&shared_free);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void secmem_get_stats(secmem_stats_t *stats) {
+    stats->mapped_bytes = __atomic_load_n(&counters.mapped_bytes, __ATOMIC_RELAXED);
+    stats->locked_bytes = __atomic_load_n(&counters.locked_bytes, __ATOMIC_RELAXED);
+    stats->cached_bytes = __atomic_load_n(&counters.cached_bytes, __ATOMIC_RELAXED);
+    stats->maps = __atomic_load_n(&counters.maps, __ATOMIC_RELAXED);
+    stats->reuses = __atomic_load_n(&counters.reuses, __ATOMIC_RELAXED);
+    stats->huge_bytes = __atomic_load_n(&counters.huge_bytes, __ATOMIC_RELAXED);
+    stats->peak_mapped_bytes = __atomic_load_n(&counters.peak_mapped_bytes, __ATOMIC_RELAXED);
+}
+
+static const char *const PAGE_MODE_NAMES[] = {"4k", "thp", "hugetlb"};
+
+int secmem_pages_from_name(const char *name) {
+    if (!name) {
+        return -1;
+    }
+    if (strcmp(name, "off") == 0 || strcmp(name, "none") == 0) {
+        return SECMEM_PAGES_DEFAULT;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, PAGE_MODE_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *secmem_pages_name(int mode) {
+    return (mode >= 0 && mode < 3) ? PAGE_MODE_NAMES[mode] : "unknown";
+}
+
+void secmem_set_pages(int mode) {
+    pthread_mutex_lock(&pool_lock);
+    page_mode = mode;
+    pthread_mutex_unlock(&pool_lock);
+}
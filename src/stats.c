@@ -0,0 +1,256 @@
+/*
+ * stats.c - Per-phase timing instrumentation
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Demonstrates OS concepts:
+ * - Wall clock vs CPU time: CLOCK_MONOTONIC vs CLOCK_THREAD_CPUTIME_ID
+ * - Counting user-kernel transitions (system calls) per phase
+ * - Process CPU time vs host I/O wait (/proc/stat) for live load readings
+ */
+
+#include "../include/stats.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+
+#include <string.h>
+#include <time.h>
+
+int stats_enabled = 0;
+int stats_live_enabled = 0;
+
+static stats_phase_t phases[STATS_PHASE_COUNT];
+
+/* One cache line per worker so their counters do not false-share */
+typedef struct {
+    stats_worker_t w;
+    char pad[64 - sizeof(stats_worker_t) % 64];
+} worker_slot_t;
+
+static struct {
+    int64_t stage[STATS_STAGE_COUNT];
+    uint64_t read_ns;
+    uint64_t write_ns;
+    int workers;
+} live;
+static worker_slot_t live_workers[STATS_MAX_WORKERS] __attribute__((aligned(64)));
+
+static const char *PHASE_NAMES[STATS_PHASE_COUNT] = {
+    "open", "read", "kdf", "crypto", "write", "total"
+};
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void stats_enable(void) {
+    stats_enabled = 1;
+}
+
+void stats_reset(void) {
+    memset(phases, 0, sizeof(phases));
+}
+
+void stats_begin(stats_timer_t *timer) {
+    if (!stats_enabled) {
+        return;
+    }
+    timer->wall = clock_ns(CLOCK_MONOTONIC);
+    timer->cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stats_end(const stats_timer_t *timer, int phase, uint64_t bytes, uint64_t calls) {
+    if (!stats_enabled || phase < 0 || phase >= STATS_PHASE_COUNT) {
+        return;
+    }
+
+    const uint64_t wall = clock_ns(CLOCK_MONOTONIC) - timer->wall;
+    uint64_t cpu;
+
+    if (phase == STATS_TOTAL) {
+        /* The whole run spans every thread, not just the caller */
+        cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    } else {
+        cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - timer->cpu;
+    }
+
+    __atomic_fetch_add(&phases[phase].wall_ns, wall, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[phase].cpu_ns, cpu, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[phase].bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[phase].calls, calls, __ATOMIC_RELAXED);
+}
+
+void stats_count(int phase, uint64_t calls) {
+    if (stats_enabled && phase >= 0 && phase < STATS_PHASE_COUNT) {
+        __atomic_fetch_add(&phases[phase].calls, calls, __ATOMIC_RELAXED);
+    }
+}
+
+void stats_get(int phase, stats_phase_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (phase < 0 || phase >= STATS_PHASE_COUNT) {
+        return;
+    }
+    out->wall_ns = __atomic_load_n(&phases[phase].wall_ns, __ATOMIC_RELAXED);
+    out->cpu_ns = __atomic_load_n(&phases[phase].cpu_ns, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&phases[phase].bytes, __ATOMIC_RELAXED);
+    out->calls = __atomic_load_n(&phases[phase].calls, __ATOMIC_RELAXED);
+}
+
+static double mb_per_s(const stats_phase_t *p) {
+    if (p->wall_ns == 0 || p->bytes == 0) {
+        return 0.0;
+    }
+    return ((double)p->bytes / (1024.0 * 1024.0)) / ((double)p->wall_ns / 1e9);
+}
+
+void stats_print(FILE *out, int format) {
+    stats_phase_t p;
+    secmem_stats_t pool;
+
+    secmem_get_stats(&pool);
+
+    if (format == STATS_FORMAT_JSON) {
+        fprintf(out, "{\"phases\": {");
+        for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+            stats_get(i, &p);
+            fprintf(out, "%s\"%s\": {\"wall_ns\": %llu, \"cpu_ns\": %llu, \"bytes\": %llu, "
+                         "\"calls\": %llu, \"mb_per_s\": %.2f}",
+                    i ? ", " : "", PHASE_NAMES[i],
+                    (unsigned long long)p.wall_ns, (unsigned long long)p.cpu_ns,
+                    (unsigned long long)p.bytes, (unsigned long long)p.calls, mb_per_s(&p));
+        }
+        fprintf(out, "}, \"peak_memory_bytes\": %llu, \"memory_limit_bytes\": %llu, "
+                     "\"secure_pool\": {\"mapped_bytes\": %llu, \"locked_bytes\": %llu, "
+                     "\"huge_bytes\": %llu, \"maps\": %llu, \"reuses\": %llu}}\n",
+                (unsigned long long)mem_peak(), (unsigned long long)mem_limit(),
+                (unsigned long long)pool.mapped_bytes, (unsigned long long)pool.locked_bytes,
+                (unsigned long long)pool.huge_bytes, (unsigned long long)pool.maps,
+                (unsigned long long)pool.reuses);
+        return;
+    }
+
+    fprintf(out, "\n%-8s %12s %12s %14s %10s %10s\n",
+            "phase", "wall ms", "cpu ms", "bytes", "calls", "MB/s");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        stats_get(i, &p);
+        fprintf(out, "%-8s %12.3f %12.3f %14llu %10llu %10.1f\n",
+                PHASE_NAMES[i], (double)p.wall_ns / 1e6, (double)p.cpu_ns / 1e6,
+                (unsigned long long)p.bytes, (unsigned long long)p.calls, mb_per_s(&p));
+    }
+    fprintf(out, "peak buffer memory: %llu bytes", (unsigned long long)mem_peak());
+    if (mem_limit() != 0) {
+        fprintf(out, " (limit %llu)", (unsigned long long)mem_limit());
+    }
+    fprintf(out, "\n");
+    fprintf(out, "secure pool: %llu bytes mapped, %llu locked, %llu huge, %llu maps, %llu reuses\n",
+            (unsigned long long)pool.mapped_bytes, (unsigned long long)pool.locked_bytes,
+            (unsigned long long)pool.huge_bytes, (unsigned long long)pool.maps,
+            (unsigned long long)pool.reuses);
+}
+
+void stats_live_enable(void) {
+    stats_live_enabled = 1;
+}
+
+uint64_t stats_live_clock(void) {
+    return stats_live_enabled ? clock_ns(CLOCK_MONOTONIC) : 0;
+}
+
+void stats_live_workers(int workers) {
+    if (!stats_live_enabled) {
+        return;
+    }
+    int seen = __atomic_load_n(&live.workers, __ATOMIC_RELAXED);
+    while (workers > seen &&
+           !__atomic_compare_exchange_n(&live.workers, &seen, workers, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void stats_live_stage(int from, int to, int64_t segments) {
+    if (!stats_live_enabled) {
+        return;
+    }
+    if (from >= 0 && from < STATS_STAGE_COUNT) {
+        __atomic_fetch_sub(&live.stage[from], segments, __ATOMIC_RELAXED);
+    }
+    if (to >= 0 && to < STATS_STAGE_COUNT) {
+        __atomic_fetch_add(&live.stage[to], segments, __ATOMIC_RELAXED);
+    }
+}
+
+void stats_live_segment(int worker, uint64_t bytes, uint64_t start) {
+    if (!stats_live_enabled || start == 0 || worker < 0 || worker >= STATS_MAX_WORKERS) {
+        return;
+    }
+    stats_worker_t *w = &live_workers[worker].w;
+    __atomic_fetch_add(&w->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->segments, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->busy_ns, clock_ns(CLOCK_MONOTONIC) - start, __ATOMIC_RELAXED);
+}
+
+void stats_live_io(int write, uint64_t start) {
+    if (!stats_live_enabled || start == 0) {
+        return;
+    }
+    __atomic_fetch_add(write ? &live.write_ns : &live.read_ns,
+                       clock_ns(CLOCK_MONOTONIC) - start, __ATOMIC_RELAXED);
+}
+
+void stats_live_get(stats_live_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < STATS_STAGE_COUNT; i++) {
+        out->stage[i] = __atomic_load_n(&live.stage[i], __ATOMIC_RELAXED);
+    }
+    out->read_ns = __atomic_load_n(&live.read_ns, __ATOMIC_RELAXED);
+    out->write_ns = __atomic_load_n(&live.write_ns, __ATOMIC_RELAXED);
+    out->workers = __atomic_load_n(&live.workers, __ATOMIC_RELAXED);
+    for (int i = 0; i < out->workers && i < STATS_MAX_WORKERS; i++) {
+        const stats_worker_t *w = &live_workers[i].w;
+        out->worker[i].bytes = __atomic_load_n(&w->bytes, __ATOMIC_RELAXED);
+        out->worker[i].segments = __atomic_load_n(&w->segments, __ATOMIC_RELAXED);
+        out->worker[i].busy_ns = __atomic_load_n(&w->busy_ns, __ATOMIC_RELAXED);
+    }
+}
+
+/* Sum of the "cpu" line of /proc/stat, and its iowait column */
+static void read_host_ticks(uint64_t *total, uint64_t *iowait) {
+    unsigned long long v[8] = { 0 };
+    FILE *f = fopen("/proc/stat", "r");
+
+    *total = 0;
+    *iowait = 0;
+    if (!f) {
+        return;
+    }
+    /* user nice system idle iowait irq softirq steal */
+    if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) >= 5) {
+        for (int i = 0; i < 8; i++) {
+            *total += v[i];
+        }
+        *iowait = v[4];
+    }
+    fclose(f);
+}
+
+void stats_load_sample(stats_load_t *sample) {
+    sample->wall_ns = clock_ns(CLOCK_MONOTONIC);
+    sample->cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    read_host_ticks(&sample->host_ticks, &sample->iowait_ticks);
+}
+
+void stats_load_delta(const stats_load_t *before, const stats_load_t *after, int cpus,
+                      double *cpu_pct, double *iowait_pct) {
+    const uint64_t wall = after->wall_ns - before->wall_ns;
+    const uint64_t ticks = after->host_ticks - before->host_ticks;
+
+    *cpu_pct = (wall > 0 && cpus > 0)
+        ? 100.0 * (double)(after->cpu_ns - before->cpu_ns) / ((double)wall * cpus) : 0.0;
+    *iowait_pct = (before->host_ticks && ticks > 0)
+        ? 100.0 * (double)(after->iowait_ticks - before->iowait_ticks) / (double)ticks : -1.0;
+}
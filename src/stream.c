@@ -0,0 +1,1921 @@
+/*
+ * stream.c - Segmented streaming encryption engine
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Pipeline per batch:
+ *   read()  N segments  ->  seal/open on the thread pool  ->  write() in order
+ * or, when both files are seekable, every worker runs its own segment:
+ *   pread()  ->  seal/open  ->  pwrite() at the segment's fixed offset
+ *
+ * Demonstrates OS concepts:
+ * - Bounded memory streaming instead of whole-file buffers
+ * - Data parallelism across CPU cores with POSIX threads
+ * - Concurrent positional I/O: pread()/pwrite() keep the device queue full
+ */
+
+#include "../include/stream.h"
+#include "../include/encryption.h"
+#include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/stats.h"
+#include "../include/thread_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Headroom for the thread pool and other small tracked allocations */
+#define STREAM_MEM_RESERVE (64 * 1024)
+
+/* Segment size the planner shrinks to before giving up threads */
+#define STREAM_PLAN_MIN_SEGMENT (64 * 1024)
+
+/* Distinct salts a keyring remembers; later ones are derived per file */
+#define KEYRING_MAX 64
+
+struct stream_keyring {
+    pthread_mutex_t lock;      /* Held across a KDF: the others need its result */
+    char *passphrase;          /* Locked copy */
+    uint32_t iterations;
+    enc_kek_t *keks;           /* KEYRING_MAX entries, locked memory */
+    int count;
+    int encrypt_kek;           /* Index of the KEK new files use, -1 = none yet */
+    uint64_t kdf_calls;
+};
+
+typedef struct {
+    const enc_header_t *header;
+    const enc_key_t *key;
+    const enc_gen_t *generations;  /* Segment index, NULL = all generation 0 */
+    int decrypt;
+    uint64_t first_index;
+    unsigned char *in;
+    size_t in_stride;
+    size_t *in_len;
+    unsigned char *out;
+    size_t out_stride;
+    size_t *out_len;
+    int *rc;
+
+    /* Positional I/O: segment index lives at base + (index - base_index) * step */
+    int positional;
+    int in_fd;
+    int out_fd;
+    uint64_t base_index;
+    uint64_t in_base;
+    uint64_t in_step;
+    uint64_t out_base;
+    uint64_t out_step;
+    int *io_error;             /* Per slot: FIO_* code when rc is ENC_ERR_IO */
+} batch_t;
+
+void stream_opts_init(stream_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->algorithm = ENC_ALG_AES_256_GCM;
+}
+
+stream_keyring_t *stream_keyring_create(const char *passphrase, uint32_t iterations) {
+    if (!passphrase) {
+        return NULL;
+    }
+    stream_keyring_t *ring = (stream_keyring_t *)mem_calloc(1, sizeof(*ring));
+    const size_t pass_len = strlen(passphrase) + 1;
+
+    if (!ring) {
+        return NULL;
+    }
+    ring->passphrase = (char *)secmem_alloc(pass_len);
+    ring->keks = (enc_kek_t *)secmem_alloc(KEYRING_MAX * sizeof(enc_kek_t));
+    if (!ring->passphrase || !ring->keks) {
+        secmem_free(ring->keks);
+        secmem_free(ring->passphrase);
+        mem_free(ring);
+        return NULL;
+    }
+    memcpy(ring->passphrase, passphrase, pass_len);
+    pthread_mutex_init(&ring->lock, NULL);
+    ring->iterations = iterations;
+    ring->encrypt_kek = -1;
+    return ring;
+}
+
+uint64_t stream_keyring_kdf_calls(stream_keyring_t *ring) {
+    pthread_mutex_lock(&ring->lock);
+    const uint64_t calls = ring->kdf_calls;
+    pthread_mutex_unlock(&ring->lock);
+    return calls;
+}
+
+void stream_keyring_destroy(stream_keyring_t *ring) {
+    if (!ring) {
+        return;
+    }
+    pthread_mutex_destroy(&ring->lock);
+    secmem_free(ring->keks);        /* Wipes them */
+    secmem_free(ring->passphrase);
+    mem_free(ring);
+}
+
+/* Derive a KEK for salt (NULL = fresh) and remember it if there is room.
+ * Called with the lock held; returns the cache index or -1 if uncached. */
+static int keyring_derive(stream_keyring_t *ring, const unsigned char *salt, uint32_t iterations,
+                          enc_kek_t *kek, int *rc) {
+    *rc = enc_kek_derive(ring->passphrase, salt, iterations, kek);
+    ring->kdf_calls++;
+    if (*rc != ENC_SUCCESS || ring->count == KEYRING_MAX) {
+        return -1;
+    }
+    ring->keks[ring->count] = *kek;
+    return ring->count++;
+}
+
+/* KEK that wraps new files' data keys */
+static int keyring_encrypt_kek(stream_keyring_t *ring, enc_kek_t *kek) {
+    int rc = ENC_SUCCESS;
+
+    pthread_mutex_lock(&ring->lock);
+    if (ring->encrypt_kek >= 0) {
+        *kek = ring->keks[ring->encrypt_kek];
+    } else {
+        ring->encrypt_kek = keyring_derive(ring, NULL, ring->iterations, kek, &rc);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return rc;
+}
+
+int stream_keyring_salt(stream_keyring_t *ring, unsigned char *salt, uint32_t *iterations) {
+    enc_kek_t *kek = (enc_kek_t *)secmem_alloc(sizeof(*kek));
+    int rc;
+
+    if (!kek) {
+        return ENC_ERR_MEMORY;
+    }
+    rc = keyring_encrypt_kek(ring, kek);
+    if (rc == ENC_SUCCESS) {
+        memcpy(salt, kek->salt, ENC_SALT_LEN);
+        *iterations = kek->iterations;
+    }
+    secmem_free(kek);   /* Wipes it */
+    return rc;
+}
+
+int stream_keyring_use_salt(stream_keyring_t *ring, const unsigned char *salt,
+                            uint32_t iterations) {
+    enc_kek_t *kek = (enc_kek_t *)secmem_alloc(sizeof(*kek));
+    int rc = ENC_SUCCESS;
+
+    if (!kek) {
+        return ENC_ERR_MEMORY;
+    }
+    pthread_mutex_lock(&ring->lock);
+    ring->encrypt_kek = -1;
+    for (int k = 0; k < ring->count && ring->encrypt_kek < 0; k++) {
+        if (ring->keks[k].iterations == iterations &&
+            memcmp(ring->keks[k].salt, salt, ENC_SALT_LEN) == 0) {
+            ring->encrypt_kek = k;
+        }
+    }
+    if (ring->encrypt_kek < 0) {
+        ring->encrypt_kek = keyring_derive(ring, salt, iterations, kek, &rc);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    secmem_free(kek);
+    return rc;
+}
+
+/* Open a header's data key with cached KEKs, deriving for unseen salts */
+static int keyring_open(stream_keyring_t *ring, const enc_header_t *header, enc_key_t *key) {
+    enc_kek_t *kek;
+    int rc = ENC_ERR_DECRYPT;
+
+    if (header->version != 3) {
+        return enc_derive_key(ring->passphrase, header, key);   /* v2: no slots */
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    for (int k = 0; k < ring->count; k++) {
+        rc = enc_unwrap_key(header, &ring->keks[k], key, NULL);
+        if (rc != ENC_ERR_DECRYPT) {
+            pthread_mutex_unlock(&ring->lock);
+            return rc;
+        }
+    }
+
+    kek = (enc_kek_t *)secmem_alloc(sizeof(*kek));
+    if (!kek) {
+        pthread_mutex_unlock(&ring->lock);
+        return ENC_ERR_MEMORY;
+    }
+    for (int i = 0; i < header->slot_count && rc == ENC_ERR_DECRYPT; i++) {
+        const enc_slot_t *slot = &header->slots[i];
+        int cached = 0;
+
+        if (slot->iterations == 0) {
+            continue;
+        }
+        for (int k = 0; k < ring->count && !cached; k++) {
+            cached = ring->keks[k].iterations == slot->iterations &&
+                     memcmp(ring->keks[k].salt, slot->salt, ENC_SALT_LEN) == 0;
+        }
+        if (cached) {
+            continue;   /* Tried above */
+        }
+        if (keyring_derive(ring, slot->salt, slot->iterations, kek, &rc) < 0 && rc != ENC_SUCCESS) {
+            break;
+        }
+        rc = enc_unwrap_key(header, kek, key, NULL);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    secmem_free(kek);   /* Wipes it */
+    return rc;
+}
+
+/* Tracked bytes run_segments() allocates for one batch shape */
+static uint64_t batch_bytes(int decrypt, int algorithm, uint32_t segment_size,
+                            uint64_t plaintext_len, int threads, int depth) {
+    const uint64_t sealed_max = enc_sealed_len(algorithm, segment_size);
+    const uint64_t in_stride = decrypt ? sealed_max : segment_size;
+    uint64_t segments = (plaintext_len + segment_size - 1) / segment_size;
+    uint64_t slots = (uint64_t)threads * (uint64_t)depth;
+
+    if (segments == 0) {
+        segments = 1;
+    }
+    if (slots > segments) {
+        slots = segments;
+    }
+    return slots * (in_stride + sealed_max + 2 * sizeof(size_t) + 2 * sizeof(int));
+}
+
+int stream_plan(const stream_opts_t *opts, int decrypt, int algorithm, uint32_t segment_size,
+                uint64_t plaintext_len, stream_plan_t *plan) {
+    const int pinned = segment_size != 0 || opts->segment_size != 0;
+    uint64_t budget = 0;
+
+    plan->segment_size = segment_size ? segment_size
+                       : (opts->segment_size ? opts->segment_size : ENC_DEFAULT_SEGMENT_SIZE);
+    plan->threads = opts->threads > 0 ? opts->threads : tp_default_threads();
+    plan->depth = opts->depth > 0 ? opts->depth : STREAM_DEFAULT_DEPTH;
+
+    if (opts->max_memory != 0) {
+        secmem_stats_t pool;
+        secmem_get_stats(&pool);
+
+        /* Cached pool blocks are reused or released on demand */
+        const uint64_t used = mem_current() - pool.cached_bytes + STREAM_MEM_RESERVE;
+        budget = opts->max_memory > used ? opts->max_memory - used : 0;
+    }
+
+    for (;;) {
+        plan->buffer_bytes = batch_bytes(decrypt, algorithm, plan->segment_size, plaintext_len,
+                                         plan->threads, plan->depth);
+        if (opts->max_memory == 0 || plan->buffer_bytes <= budget) {
+            return ENC_SUCCESS;
+        }
+
+        if (plan->depth > 1) {
+            plan->depth--;
+        } else if (!pinned && plan->segment_size > STREAM_PLAN_MIN_SEGMENT) {
+            plan->segment_size /= 2;
+        } else if (plan->threads > 1) {
+            plan->threads--;
+        } else if (!pinned && plan->segment_size / 2 >= ENC_MIN_SEGMENT_SIZE) {
+            plan->segment_size /= 2;
+        } else {
+            return ENC_ERR_BUDGET;
+        }
+    }
+}
+
+/* Plaintext length of segment `index` */
+static size_t segment_plain_len(const enc_header_t *header, uint64_t index) {
+    const uint64_t start = index * header->segment_size;
+    const uint64_t left = header->plaintext_len - start;
+    return (left < header->segment_size) ? (size_t)left : header->segment_size;
+}
+
+static int segment_is_hole(const enc_gen_t *generations, uint64_t index) {
+    return generations && generations[index].generation == ENC_GEN_HOLE;
+}
+
+/* Output bytes of segment `index` */
+static size_t segment_out_len(const enc_header_t *header, int decrypt, uint64_t index) {
+    const size_t plain = segment_plain_len(header, index);
+    return decrypt ? plain : enc_sealed_len(header->algorithm, plain);
+}
+
+static void crypt_task(void *arg, size_t i, int worker) {
+    batch_t *batch = (batch_t *)arg;
+    const uint64_t index = batch->first_index + i;
+    const uint64_t start = stats_live_clock();
+
+    stats_live_stage(STATS_STAGE_READ, STATS_STAGE_CRYPTO, 1);
+
+    if (segment_is_hole(batch->generations, index)) {
+        /* Never stored: nothing to seal or open, only a range to skip */
+        batch->in_len[i] = 0;
+        batch->out_len[i] = segment_out_len(batch->header, batch->decrypt, index);
+        batch->rc[i] = ENC_SUCCESS;
+        stats_live_stage(STATS_STAGE_CRYPTO, STATS_STAGE_WRITE, 1);
+        return;
+    }
+    if (batch->decrypt) {
+        const enc_gen_t *gen = batch->generations ? &batch->generations[index] : NULL;
+        batch->rc[i] = enc_open_segment_gen(batch->header, batch->key, index, gen,
+                                            batch->in + i * batch->in_stride, batch->in_len[i],
+                                            batch->out + i * batch->out_stride,
+                                            &batch->out_len[i]);
+    } else {
+        batch->rc[i] = enc_seal_segment(batch->header, batch->key, index,
+                                        batch->in + i * batch->in_stride, batch->in_len[i],
+                                        batch->out + i * batch->out_stride, &batch->out_len[i]);
+    }
+
+    stats_live_stage(STATS_STAGE_CRYPTO, STATS_STAGE_WRITE, 1);
+    stats_live_segment(worker, batch->in_len[i], start);
+}
+
+/* Positional I/O: the worker reads, seals/opens and writes segment i itself */
+static void positional_task(void *arg, size_t i, int worker) {
+    batch_t *batch = (batch_t *)arg;
+    const enc_header_t *h = batch->header;
+    const uint64_t index = batch->first_index + i;
+    const uint64_t rel = index - batch->base_index;
+    const size_t plain = segment_plain_len(h, index);
+    const size_t want = batch->decrypt ? enc_sealed_len(h->algorithm, plain) : plain;
+    const int hole = segment_is_hole(batch->generations, index);
+    size_t got = 0;
+    uint64_t io_start = stats_live_clock();
+
+    batch->io_error[i] = 0;
+    stats_live_stage(-1, STATS_STAGE_READ, 1);
+    if (!hole && (fio_pread_full(batch->in_fd, batch->in + i * batch->in_stride, want,
+                                 batch->in_base + rel * batch->in_step, &got) != FIO_SUCCESS ||
+                  got != want)) {
+        /* A short read is truncated ciphertext, or input that shrank */
+        batch->rc[i] = (got != want && batch->decrypt) ? ENC_ERR_INVALID_FORMAT : ENC_ERR_IO;
+        batch->io_error[i] = FIO_ERR_READ;
+        stats_live_stage(STATS_STAGE_READ, -1, 1);
+        return;
+    }
+    stats_live_io(0, io_start);
+    batch->in_len[i] = hole ? 0 : want;
+
+    crypt_task(arg, i, worker);
+    if (batch->rc[i] == ENC_SUCCESS && batch->decrypt && batch->out_len[i] != plain) {
+        batch->rc[i] = ENC_ERR_INVALID_FORMAT;
+    }
+
+    if (batch->rc[i] == ENC_SUCCESS && !hole) {
+        io_start = stats_live_clock();
+        if (fio_pwrite_full(batch->out_fd, batch->out + i * batch->out_stride, batch->out_len[i],
+                            batch->out_base + rel * batch->out_step) != FIO_SUCCESS) {
+            batch->rc[i] = ENC_ERR_IO;
+            batch->io_error[i] = FIO_ERR_WRITE;
+        }
+        stats_live_io(1, io_start);
+    }
+    stats_live_stage(STATS_STAGE_WRITE, -1, 1);
+}
+
+static void set_io_error(stream_result_t *result, int io_error, const char *path) {
+    if (result) {
+        result->io_error = io_error;
+        result->io_path = path;
+    }
+}
+
+/*
+ * Reserve the output of segments [first, count) from its current offset,
+ * one run of data segments at a time: holes are never written, so
+ * reserving them would allocate what the file is meant to skip. A pipe
+ * has no offset and nothing to reserve.
+ */
+static int preallocate_segments(int out_fd, const enc_header_t *header,
+                                const enc_gen_t *generations, int decrypt, uint64_t first,
+                                stream_result_t *result) {
+    const off_t pos = lseek(out_fd, 0, SEEK_CUR);
+    const uint64_t segments = enc_segment_count(header);
+    const uint64_t step = decrypt ? header->segment_size
+                                  : enc_sealed_len(header->algorithm, header->segment_size);
+
+    for (uint64_t i = first; pos >= 0 && i < segments; i++) {
+        if (segment_is_hole(generations, i)) {
+            continue;
+        }
+        uint64_t last = i;
+        while (last + 1 < segments && !segment_is_hole(generations, last + 1)) {
+            last++;
+        }
+        const uint64_t start = (i - first) * step;
+        const uint64_t len = (last - i) * step + segment_out_len(header, decrypt, last);
+        if (fio_preallocate(out_fd, (uint64_t)pos + start, len) != FIO_SUCCESS) {
+            set_io_error(result, FIO_ERR_WRITE, NULL);
+            return ENC_ERR_IO;
+        }
+        i = last;
+    }
+    return ENC_SUCCESS;
+}
+
+/*
+ * Step over len bytes that belong to a hole: seek where the file allows
+ * it, else read them into buf (input) or write zeros from it (output)
+ */
+static int skip_hole(int fd, int write, unsigned char *buf, size_t len) {
+    size_t got = 0;
+
+    if (lseek(fd, (off_t)len, SEEK_CUR) >= 0) {
+        return FIO_SUCCESS;
+    }
+    if (write) {
+        memset(buf, 0, len);
+        return fio_write_full(fd, buf, len);
+    }
+    if (fio_read_full(fd, buf, len, &got) != FIO_SUCCESS || got != len) {
+        return FIO_ERR_READ;
+    }
+    return FIO_SUCCESS;
+}
+
+/*
+ * Segments of in_fd (from its current offset) that lie wholly in a hole
+ * become ENC_GEN_HOLE in a fresh generation table. Both files must allow
+ * positional I/O: the output skips those segments by seeking. *generations
+ * stays NULL when there is nothing to skip, which keeps the format as is.
+ */
+static int map_holes(int in_fd, int out_fd, const enc_header_t *header,
+                     const stream_opts_t *opts, enc_gen_t **generations,
+                     stream_result_t *result) {
+    const uint64_t segments = enc_segment_count(header);
+    const uint64_t size = header->plaintext_len;
+    uint64_t base = 0;
+    uint64_t out_base = 0;
+    uint64_t pos = 0;
+    uint64_t next = 0;      /* First segment not yet classified */
+    uint64_t holes = 0;
+    enc_gen_t *map;
+    int io = FIO_SUCCESS;
+
+    *generations = NULL;
+    if (opts->dense || size == 0 || !fio_positional(in_fd, &base) ||
+        !fio_positional(out_fd, &out_base)) {
+        return ENC_SUCCESS;
+    }
+    map = (enc_gen_t *)mem_calloc((size_t)segments, sizeof(*map));
+    if (!map) {
+        return ENC_ERR_MEMORY;
+    }
+
+    while (pos < size) {
+        uint64_t data = 0;
+        uint64_t end = 0;
+
+        io = fio_next_data(in_fd, base + pos, base + size, &data, &end);
+        if (io != FIO_SUCCESS || data - base >= size) {
+            break;
+        }
+        for (; next < (data - base) / header->segment_size; next++, holes++) {
+            map[next].generation = ENC_GEN_HOLE;
+        }
+        next = (end - base - 1) / header->segment_size + 1;  /* Data: generation 0 */
+        pos = end - base;
+    }
+    for (; next < segments; next++, holes++) {
+        map[next].generation = ENC_GEN_HOLE;
+    }
+
+    if (lseek(in_fd, (off_t)base, SEEK_SET) < 0 || io != FIO_SUCCESS) {
+        mem_free(map);
+        set_io_error(result, FIO_ERR_READ, NULL);
+        return ENC_ERR_IO;
+    }
+    if (holes == 0) {
+        mem_free(map);
+        return ENC_SUCCESS;
+    }
+    *generations = map;
+    return ENC_SUCCESS;
+}
+
+/* Seal the hole map into a segment index (epoch 1) at offset */
+static int write_hole_index(int out_fd, const enc_header_t *header, const enc_key_t *key,
+                            const enc_gen_t *generations, uint64_t offset,
+                            stream_result_t *result) {
+    const size_t len = (size_t)enc_index_size(header);
+    unsigned char *trailer = (unsigned char *)mem_alloc(len);
+    int rc;
+
+    if (!trailer) {
+        return ENC_ERR_MEMORY;
+    }
+    rc = enc_seal_index(header, key, 1, generations, trailer);
+    if (rc == ENC_SUCCESS && fio_pwrite_full(out_fd, trailer, len, offset) != FIO_SUCCESS) {
+        set_io_error(result, FIO_ERR_WRITE, NULL);
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_SUCCESS && result) {
+        result->bytes_out += len;
+    }
+    mem_free(trailer);
+    return rc;
+}
+
+/* Holes at the end of a decrypted file are never written: give it its
+ * full length */
+static int extend_output(int out_fd, uint64_t end, stream_result_t *result) {
+    struct stat st;
+
+    if (fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size < end &&
+        ftruncate(out_fd, (off_t)end) != 0) {
+        set_io_error(result, FIO_ERR_WRITE, NULL);
+        return ENC_ERR_IO;
+    }
+    return ENC_SUCCESS;
+}
+
+/*
+ * Move segments [first_segment, count) described by header from in_fd to
+ * out_fd. Both descriptors are already positioned past the header (and,
+ * when resuming, past the finished segments). Positional mode leaves the
+ * offsets where they were.
+ */
+static int run_segments(int in_fd, int out_fd, const enc_header_t *header,
+                        const enc_key_t *key, const enc_gen_t *generations, int decrypt,
+                        uint64_t first_segment, const stream_plan_t *plan,
+                        const stream_opts_t *opts, stream_result_t *result) {
+    const uint64_t segments = enc_segment_count(header);
+    const size_t sealed_max = enc_sealed_len(header->algorithm, header->segment_size);
+    const size_t in_stride = decrypt ? sealed_max : header->segment_size;
+    const size_t out_stride = sealed_max;
+    thread_pool_t *pool = NULL;
+    batch_t batch;
+    size_t batch_max;
+    int64_t staged_read = 0;    /* Segments this run holds in each stage */
+    int64_t staged_write = 0;
+    uint64_t checkpointed = first_segment;
+    uint64_t io_start;
+    int rc = ENC_SUCCESS;
+
+    memset(&batch, 0, sizeof(batch));
+
+    pool = tp_acquire(plan->threads);
+    if (!pool) {
+        return ENC_ERR_MEMORY;
+    }
+    stats_live_workers(tp_size(pool));
+
+    batch_max = (size_t)tp_size(pool) * (size_t)plan->depth;
+    if (batch_max > segments) {
+        batch_max = (size_t)segments;
+    }
+
+    batch.header = header;
+    batch.key = key;
+    batch.generations = generations;
+    batch.decrypt = decrypt;
+    batch.in_stride = in_stride;
+    batch.out_stride = out_stride;
+    batch.in = (unsigned char *)secmem_alloc(batch_max * in_stride);
+    batch.out = (unsigned char *)secmem_alloc(batch_max * out_stride);
+    batch.in_len = (size_t *)mem_calloc(batch_max, sizeof(size_t));
+    batch.out_len = (size_t *)mem_calloc(batch_max, sizeof(size_t));
+    batch.rc = (int *)mem_calloc(batch_max, sizeof(int));
+    batch.io_error = (int *)mem_calloc(batch_max, sizeof(int));
+    if (!batch.in || !batch.out || !batch.in_len || !batch.out_len || !batch.rc ||
+        !batch.io_error) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    /* Seekable on both sides: segment i has a fixed offset in each file */
+    batch.positional = !opts->sequential_io && fio_positional(in_fd, &batch.in_base) &&
+                       fio_positional(out_fd, &batch.out_base);
+    batch.in_fd = in_fd;
+    batch.out_fd = out_fd;
+    batch.base_index = first_segment;
+    batch.in_step = decrypt ? sealed_max : header->segment_size;
+    batch.out_step = decrypt ? header->segment_size : sealed_max;
+
+    if (opts->progress) {
+        const uint64_t done = first_segment * header->segment_size;
+        opts->progress(opts->progress_arg, done < header->plaintext_len ? done
+                                                                         : header->plaintext_len,
+                       header->plaintext_len);
+    }
+
+    for (uint64_t first = first_segment; first < segments; first += batch_max) {
+        const size_t count = (segments - first < batch_max) ? (size_t)(segments - first) : batch_max;
+
+        if (opts->cancel && __atomic_load_n(opts->cancel, __ATOMIC_RELAXED)) {
+            rc = ENC_ERR_CANCELLED;
+            goto cleanup;
+        }
+
+        batch.first_index = first;
+        if (batch.positional) {
+            /* One pass: every worker preads, seals/opens and pwrites its segment */
+            tp_parallel_for(pool, count, positional_task, &batch);
+            for (size_t i = 0; i < count; i++) {
+                if (batch.rc[i] != ENC_SUCCESS) {
+                    if (batch.io_error[i]) {
+                        set_io_error(result, batch.io_error[i], NULL);
+                    }
+                    rc = batch.rc[i];
+                    goto cleanup;
+                }
+                if (result && !segment_is_hole(generations, first + i)) {
+                    result->bytes_in += batch.in_len[i];
+                    result->bytes_out += batch.out_len[i];
+                }
+            }
+        } else {
+            /* Stage 1: sequential read */
+            io_start = stats_live_clock();
+            for (size_t i = 0; i < count; i++) {
+                const size_t plain = segment_plain_len(header, first + i);
+                const size_t want = decrypt ? enc_sealed_len(header->algorithm, plain) : plain;
+                size_t got = 0;
+
+                if (segment_is_hole(generations, first + i)) {
+                    if (skip_hole(in_fd, 0, batch.in + i * in_stride, want) != FIO_SUCCESS) {
+                        set_io_error(result, FIO_ERR_READ, NULL);
+                        rc = ENC_ERR_IO;
+                        goto cleanup;
+                    }
+                    stats_live_stage(-1, STATS_STAGE_READ, 1);
+                    staged_read++;
+                    continue;
+                }
+                if (fio_read_full(in_fd, batch.in + i * in_stride, want, &got) != FIO_SUCCESS) {
+                    set_io_error(result, FIO_ERR_READ, NULL);
+                    rc = ENC_ERR_IO;
+                    goto cleanup;
+                }
+                if (got != want) {
+                    /* Input shrank underneath us, or ciphertext was truncated */
+                    rc = decrypt ? ENC_ERR_INVALID_FORMAT : ENC_ERR_IO;
+                    set_io_error(result, FIO_ERR_READ, NULL);
+                    goto cleanup;
+                }
+                batch.in_len[i] = want;
+                if (result) result->bytes_in += want;
+                stats_live_stage(-1, STATS_STAGE_READ, 1);
+                staged_read++;
+            }
+            stats_live_io(0, io_start);
+
+            /* Stage 2: parallel seal/open */
+            tp_parallel_for(pool, count, crypt_task, &batch);
+            staged_write = staged_read;
+            staged_read = 0;
+
+            /* Stage 3: in-order write */
+            io_start = stats_live_clock();
+            for (size_t i = 0; i < count; i++) {
+                if (batch.rc[i] != ENC_SUCCESS) {
+                    rc = batch.rc[i];
+                    goto cleanup;
+                }
+                if (decrypt && batch.out_len[i] != segment_plain_len(header, first + i)) {
+                    rc = ENC_ERR_INVALID_FORMAT;
+                    goto cleanup;
+                }
+                const int hole = segment_is_hole(generations, first + i);
+                if ((hole ? skip_hole(out_fd, 1, batch.out + i * out_stride, batch.out_len[i])
+                          : fio_write_full(out_fd, batch.out + i * out_stride,
+                                           batch.out_len[i])) != FIO_SUCCESS) {
+                    set_io_error(result, FIO_ERR_WRITE, NULL);
+                    rc = ENC_ERR_IO;
+                    goto cleanup;
+                }
+                if (result && !hole) result->bytes_out += batch.out_len[i];
+                stats_live_stage(STATS_STAGE_WRITE, -1, 1);
+                staged_write--;
+            }
+            stats_live_io(1, io_start);
+        }
+
+        const uint64_t end = first + count;
+        if (opts->progress) {
+            const uint64_t done = (end == segments) ? header->plaintext_len
+                                                    : end * header->segment_size;
+            opts->progress(opts->progress_arg, done, header->plaintext_len);
+        }
+
+        /* A checkpoint names the tag of its last segment, so it waits for a
+         * batch that ends in data rather than a hole */
+        if (opts->checkpoint && end < segments && !segment_is_hole(generations, end - 1) &&
+            (end - checkpointed) * header->segment_size >= opts->checkpoint_bytes) {
+            /* The segments are on disk before anyone is told they are */
+            if (fio_sync(out_fd) != FIO_SUCCESS) {
+                set_io_error(result, FIO_ERR_WRITE, NULL);
+                rc = ENC_ERR_IO;
+                goto cleanup;
+            }
+            const unsigned char *sealed = decrypt ? batch.in + (count - 1) * in_stride
+                                                  : batch.out + (count - 1) * out_stride;
+            const size_t sealed_len = decrypt ? batch.in_len[count - 1]
+                                              : batch.out_len[count - 1];
+            opts->checkpoint(opts->checkpoint_arg, end, sealed + sealed_len - STREAM_TAG_LEN);
+            checkpointed = end;
+        }
+    }
+
+cleanup:
+    /* A failed batch leaves segments behind in the stage counts */
+    stats_live_stage(STATS_STAGE_READ, -1, staged_read);
+    stats_live_stage(STATS_STAGE_WRITE, -1, staged_write);
+    secmem_free(batch.in);   /* Wiped and kept for the next run */
+    secmem_free(batch.out);
+    mem_free(batch.in_len);
+    mem_free(batch.out_len);
+    mem_free(batch.rc);
+    mem_free(batch.io_error);
+    tp_release(pool);
+    return rc;
+}
+
+int stream_encrypt_fd(int in_fd, uint64_t in_size, int out_fd, const char *passphrase,
+                      const stream_opts_t *opts, stream_result_t *result) {
+    stream_opts_t defaults;
+    stream_plan_t plan;
+    enc_header_t header;
+    enc_key_t *key;
+    enc_kek_t *kek;
+    enc_gen_t *generations = NULL;
+    int rc;
+
+    if (!passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        stream_opts_init(&defaults);
+        opts = &defaults;
+    }
+
+    rc = stream_plan(opts, 0, opts->algorithm, 0, in_size, &plan);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    const int slots = opts->key_slots > opts->recipient_count + 1
+        ? opts->key_slots : opts->recipient_count + 1;
+    if (opts->recipient_count < 0 || (opts->recipient_count > 0 && !opts->recipients)) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    rc = enc_header_init(&header, opts->algorithm, plan.segment_size, in_size, slots);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    if (result) {
+        result->algorithm = header.algorithm;
+    }
+
+    /* Sparse input: whole segments in holes are recorded, not sealed */
+    rc = map_holes(in_fd, out_fd, &header, opts, &generations, result);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    /* Key material lives in locked memory, never on the stack */
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    kek = (enc_kek_t *)secmem_alloc(2 * sizeof(*kek));
+    if (!key || !kek) {
+        secmem_free(kek);
+        secmem_free(key);
+        mem_free(generations);
+        return ENC_ERR_MEMORY;
+    }
+
+    /* Random data key, wrapped under the passphrase in slot 0 and under
+     * each recipient in the slots after it */
+    rc = opts->keyring ? keyring_encrypt_kek(opts->keyring, &kek[0])
+                       : enc_kek_derive(passphrase, NULL, opts->kdf_iterations, &kek[0]);
+    if (rc == ENC_SUCCESS) {
+        rc = enc_generate_key(&header, &kek[0], key);
+    }
+    for (int i = 0; rc == ENC_SUCCESS && i < opts->recipient_count; i++) {
+        rc = enc_kek_derive(opts->recipients[i], NULL, opts->kdf_iterations, &kek[1]);
+        if (rc == ENC_SUCCESS) {
+            rc = enc_add_slot(&header, &kek[0], &kek[1], NULL);
+        }
+    }
+    secmem_free(kek);
+    if (rc != ENC_SUCCESS) {
+        secmem_free(key);
+        mem_free(generations);
+        return rc;
+    }
+
+    /* The whole output size is known: header plus every sealed segment,
+     * and a segment index after them when holes were skipped */
+    const off_t header_at = lseek(out_fd, 0, SEEK_CUR);
+    if (fio_write_full(out_fd, header.raw, header.header_len) != FIO_SUCCESS) {
+        set_io_error(result, FIO_ERR_WRITE, NULL);
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_SUCCESS) {
+        if (result) result->bytes_out += header.header_len;
+        rc = preallocate_segments(out_fd, &header, generations, 0, 0, result);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = run_segments(in_fd, out_fd, &header, key, generations, 0, 0, &plan, opts, result);
+    }
+    if (rc == ENC_SUCCESS && generations) {
+        rc = write_hole_index(out_fd, &header, key, generations,
+                              (uint64_t)header_at + enc_payload_size(&header), result);
+    }
+
+    mem_free(generations);
+    secmem_free(key);  /* Wipes it */
+    return rc;
+}
+
+/* v1 files are a single GCM message, so they can only be decrypted whole */
+static int decrypt_legacy(int in_fd, uint64_t in_size, int out_fd, const char *passphrase,
+                          const unsigned char *prefix, size_t prefix_len,
+                          const stream_opts_t *opts, stream_result_t *result) {
+    unsigned char *payload = NULL;
+    unsigned char *plaintext = NULL;
+    size_t plaintext_len = 0;
+    size_t got = 0;
+    int rc;
+
+    /* Ciphertext and plaintext are both held in full */
+    if (opts->max_memory != 0 &&
+        2 * in_size + STREAM_MEM_RESERVE + mem_current() > opts->max_memory) {
+        return ENC_ERR_BUDGET;
+    }
+
+    payload = (unsigned char *)mem_alloc((size_t)in_size);
+    if (!payload) {
+        return ENC_ERR_MEMORY;
+    }
+    memcpy(payload, prefix, prefix_len);
+
+    if (fio_read_full(in_fd, payload + prefix_len, (size_t)in_size - prefix_len, &got) != FIO_SUCCESS ||
+        got != (size_t)in_size - prefix_len) {
+        set_io_error(result, FIO_ERR_READ, NULL);
+        mem_free(payload);
+        return ENC_ERR_IO;
+    }
+    if (result) result->bytes_in += got;
+
+    rc = enc_decrypt_payload(payload, (size_t)in_size, passphrase, &plaintext, &plaintext_len);
+    if (rc == ENC_SUCCESS) {
+        if (fio_write_full(out_fd, plaintext, plaintext_len) != FIO_SUCCESS) {
+            set_io_error(result, FIO_ERR_WRITE, NULL);
+            rc = ENC_ERR_IO;
+        } else {
+            if (result) result->bytes_out += plaintext_len;
+            if (opts->progress) {
+                opts->progress(opts->progress_arg, plaintext_len, plaintext_len);
+            }
+        }
+    }
+
+    if (plaintext) {
+        memset(plaintext, 0, plaintext_len);
+        mem_free(plaintext);
+    }
+    mem_free(payload);
+    return rc;
+}
+
+/* Read the header past its prefix_len bytes already in raw */
+static int read_header_rest(int fd, uint64_t in_size, unsigned char *raw, size_t prefix_len,
+                            size_t *header_len, stream_result_t *result) {
+    size_t got = 0;
+
+    if (enc_header_size(raw, prefix_len, header_len) != ENC_SUCCESS || *header_len > in_size) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    const size_t want = *header_len - prefix_len;
+    if (fio_read_full(fd, raw + prefix_len, want, &got) != FIO_SUCCESS || got != want) {
+        set_io_error(result, FIO_ERR_READ, NULL);
+        return ENC_ERR_IO;
+    }
+    if (result) result->bytes_in += got;
+    return ENC_SUCCESS;
+}
+
+/* Read and authenticate the segment index trailer at offset */
+static int read_index(int fd, const enc_header_t *header, const enc_key_t *key,
+                      uint64_t offset, enc_gen_t **generations, uint32_t *epoch,
+                      stream_result_t *result) {
+    const size_t len = (size_t)enc_index_size(header);
+    unsigned char *trailer = (unsigned char *)mem_alloc(len);
+    size_t got = 0;
+    int rc;
+
+    *generations = (enc_gen_t *)mem_alloc((size_t)enc_segment_count(header) * sizeof(enc_gen_t));
+    if (!trailer || !*generations) {
+        mem_free(trailer);
+        return ENC_ERR_MEMORY;
+    }
+
+    if (fio_pread_full(fd, trailer, len, offset, &got) != FIO_SUCCESS || got != len) {
+        set_io_error(result, FIO_ERR_READ, NULL);
+        rc = ENC_ERR_IO;
+    } else {
+        if (result) result->bytes_in += got;
+        rc = enc_open_index(header, key, trailer, len, *generations, epoch);
+    }
+
+    mem_free(trailer);
+    return rc;
+}
+
+int stream_decrypt_fd(int in_fd, uint64_t in_size, int out_fd, const char *passphrase,
+                      const stream_opts_t *opts, stream_result_t *result) {
+    stream_opts_t defaults;
+    stream_plan_t plan;
+    unsigned char raw[ENC_MAX_HEADER_LEN];
+    enc_header_t header;
+    enc_key_t *key;
+    enc_gen_t *generations = NULL;
+    uint32_t epoch = 0;
+    size_t header_len = 0;
+    size_t got = 0;
+    int rc;
+
+    if (!passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        stream_opts_init(&defaults);
+        opts = &defaults;
+    }
+
+    /* The fixed prefix says how long the rest of the header is */
+    const size_t want = in_size < ENC_HEADER_PREFIX_LEN ? (size_t)in_size : ENC_HEADER_PREFIX_LEN;
+    if (fio_read_full(in_fd, raw, want, &got) != FIO_SUCCESS || got != want) {
+        set_io_error(result, FIO_ERR_READ, NULL);
+        return ENC_ERR_IO;
+    }
+    if (result) result->bytes_in += got;
+
+    const int version = enc_payload_version(raw, got);
+    if (version == 1) {
+        if (result) result->algorithm = ENC_ALG_AES_256_GCM;
+        return decrypt_legacy(in_fd, in_size, out_fd, passphrase, raw, got, opts, result);
+    }
+
+    rc = read_header_rest(in_fd, in_size, raw, got, &header_len, result);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    got = header_len;
+
+    rc = enc_header_decode(raw, got, &header);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    const uint64_t segments_end = enc_payload_size(&header);
+    if (segments_end != in_size &&
+        (segments_end > in_size || in_size - segments_end != enc_index_size(&header))) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    if (result) {
+        result->algorithm = header.algorithm;
+    }
+
+    rc = stream_plan(opts, 1, header.algorithm, header.segment_size, header.plaintext_len, &plan);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    if (!key) {
+        return ENC_ERR_MEMORY;
+    }
+
+    rc = opts->keyring ? keyring_open(opts->keyring, &header, key)
+                       : enc_derive_key(passphrase, &header, key);
+    if (rc == ENC_SUCCESS && segments_end != in_size) {
+        rc = read_index(in_fd, &header, key, segments_end, &generations, &epoch, result);
+    }
+    const off_t out_at = lseek(out_fd, 0, SEEK_CUR);
+    if (rc == ENC_SUCCESS) {
+        rc = preallocate_segments(out_fd, &header, generations, 1, 0, result);
+    }
+    if (rc == ENC_SUCCESS) {
+        rc = run_segments(in_fd, out_fd, &header, key, generations, 1, 0, &plan, opts, result);
+    }
+    if (rc == ENC_SUCCESS && generations && out_at >= 0) {
+        rc = extend_output(out_fd, (uint64_t)out_at + header.plaintext_len, result);
+    }
+
+    mem_free(generations);
+    secmem_free(key);  /* Wipes it */
+    return rc;
+}
+
+/* Close the temporary output and, if the run succeeded, rename it over
+ * output with the durability opts asks for */
+static int commit_output(int out_fd, const char *tmp, const char *output,
+                         const stream_opts_t *opts, int rc, stream_result_t *result) {
+    if (rc != ENC_SUCCESS) {
+        fio_close(out_fd);
+        return rc;
+    }
+    const int io = fio_commit(out_fd, tmp, output, opts ? opts->durability : FIO_SYNC_NONE);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, output);
+        return ENC_ERR_IO;
+    }
+    return ENC_SUCCESS;
+}
+
+/*
+ * Undo journal of an update, PATH STREAM_UPDATE_JOURNAL_SUFFIX:
+ *
+ *   "FENCUPD1" | dev(8) ino(8) | old size(8) | records(8)
+ *   then per record: offset(8) | len(8) | the old bytes at offset
+ *
+ * It holds the old sealed bytes of every segment about to be rewritten
+ * and the old trailer. Published with fio_commit() before the first
+ * pwrite() and removed once the new index is durable, so if it exists the
+ * file may be half updated, and putting the records back and truncating
+ * to the old size restores the version the journal was taken from. Only
+ * ciphertext goes in it. Fields are host byte order: it never leaves the
+ * machine that wrote it.
+ */
+#define UPDATE_JOURNAL_MAGIC "FENCUPD1"
+#define UPDATE_JOURNAL_HEAD (8 + 4 * 8)
+
+static int update_journal_path(const char *path, char *journal, size_t len) {
+    const int n = snprintf(journal, len, "%s%s", path, STREAM_UPDATE_JOURNAL_SUFFIX);
+    return (n < 0 || (size_t)n >= len) ? FIO_ERR_OPEN : FIO_SUCCESS;
+}
+
+/*
+ * Undo an interrupted update of the file open at enc_fd from its journal,
+ * if it has one; *enc_size becomes the restored size. A journal taken of
+ * another file (the path was replaced since) is stale and only removed.
+ */
+static int rollback_update(const char *journal, int enc_fd, uint64_t *enc_size,
+                           stream_result_t *result) {
+    unsigned char head[UPDATE_JOURNAL_HEAD];
+    unsigned char *buf = NULL;
+    uint64_t fields[4];
+    uint64_t size = 0;
+    struct stat st;
+    size_t got = 0;
+    int fd = -1;
+    int io;
+
+    if (access(journal, F_OK) == -1) {
+        return ENC_SUCCESS;
+    }
+    io = fio_open_input(journal, &fd, &size);
+    if (io == FIO_SUCCESS &&
+        (fio_read_full(fd, head, sizeof(head), &got) != FIO_SUCCESS || got != sizeof(head) ||
+         memcmp(head, UPDATE_JOURNAL_MAGIC, 8) != 0)) {
+        io = FIO_ERR_READ;  /* Published whole, so this is not a torn write */
+    }
+    if (io != FIO_SUCCESS || fstat(enc_fd, &st) == -1) {
+        if (fd != -1) fio_close(fd);
+        set_io_error(result, io != FIO_SUCCESS ? io : FIO_ERR_READ, NULL);
+        return ENC_ERR_IO;
+    }
+    memcpy(fields, head + 8, sizeof(fields));
+
+    if (fields[0] != (uint64_t)st.st_dev || fields[1] != (uint64_t)st.st_ino) {
+        fio_close(fd);
+        unlink(journal);
+        return ENC_SUCCESS;
+    }
+
+    for (uint64_t i = 0; io == FIO_SUCCESS && i < fields[3]; i++) {
+        uint64_t rec[2];
+        if (fio_read_full(fd, (unsigned char *)rec, sizeof(rec), &got) != FIO_SUCCESS ||
+            got != sizeof(rec) || rec[1] > size) {
+            io = FIO_ERR_READ;
+            break;
+        }
+        mem_free(buf);
+        buf = (unsigned char *)mem_alloc(rec[1] ? (size_t)rec[1] : 1);
+        if (!buf) {
+            io = FIO_ERR_MEMORY;
+        } else if (fio_read_full(fd, buf, (size_t)rec[1], &got) != FIO_SUCCESS || got != rec[1]) {
+            io = FIO_ERR_READ;
+        } else if (fio_pwrite_full(enc_fd, buf, (size_t)rec[1], rec[0]) != FIO_SUCCESS) {
+            io = FIO_ERR_WRITE;
+        }
+    }
+    mem_free(buf);
+    fio_close(fd);
+
+    if (io == FIO_SUCCESS &&
+        (ftruncate(enc_fd, (off_t)fields[2]) == -1 || fio_sync(enc_fd) != FIO_SUCCESS ||
+         unlink(journal) == -1 || fio_sync_parent(journal) != FIO_SUCCESS)) {
+        io = FIO_ERR_WRITE;
+    }
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, NULL);
+        return io == FIO_ERR_MEMORY ? ENC_ERR_MEMORY : ENC_ERR_IO;
+    }
+    *enc_size = fields[2];
+    return ENC_SUCCESS;
+}
+
+/* Undo an interrupted update of path before reading it */
+static int recover_update(const char *path, stream_result_t *result) {
+    char journal[4096];
+    uint64_t size = 0;
+    int fd = -1;
+    int io;
+    int rc;
+
+    if (update_journal_path(path, journal, sizeof(journal)) != FIO_SUCCESS ||
+        access(journal, F_OK) == -1) {
+        return ENC_SUCCESS;
+    }
+    io = fio_open_update(path, &fd, &size);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, path);
+        return ENC_ERR_IO;
+    }
+    rc = rollback_update(journal, fd, &size, result);
+    if (fio_close(fd) != FIO_SUCCESS && rc == ENC_SUCCESS) {
+        set_io_error(result, FIO_ERR_CLOSE, NULL);
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_path = path;
+    }
+    return rc;
+}
+
+static int stream_file(const char *input, const char *output, const char *passphrase,
+                       const stream_opts_t *opts, stream_result_t *result, int decrypt) {
+    stream_result_t local;
+    char tmp[4096];
+    uint64_t in_size = 0;
+    int in_fd = -1;
+    int out_fd = -1;
+    int io;
+    int rc;
+
+    if (!input || !output) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+    if (decrypt && (rc = recover_update(input, result)) != ENC_SUCCESS) {
+        return rc;
+    }
+
+    io = fio_open_input(input, &in_fd, &in_size);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, input);
+        return ENC_ERR_IO;
+    }
+
+    io = fio_open_temp(output, opts ? opts->temp_id : NULL, tmp, sizeof(tmp), &out_fd);
+    if (io != FIO_SUCCESS) {
+        fio_close(in_fd);
+        set_io_error(result, io, output);
+        return ENC_ERR_IO;
+    }
+
+    rc = decrypt
+        ? stream_decrypt_fd(in_fd, in_size, out_fd, passphrase, opts, result)
+        : stream_encrypt_fd(in_fd, in_size, out_fd, passphrase, opts, result);
+
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_path = (result->io_error == FIO_ERR_READ) ? input : output;
+    }
+
+    fio_close(in_fd);
+    rc = commit_output(out_fd, tmp, output, opts, rc, result);
+
+    if (rc != ENC_SUCCESS) {
+        unlink(tmp);  /* Never leave a partial or unauthenticated output */
+    }
+    return rc;
+}
+
+int stream_encrypt_file(const char *input, const char *output, const char *passphrase,
+                        const stream_opts_t *opts, stream_result_t *result) {
+    return stream_file(input, output, passphrase, opts, result, 0);
+}
+
+int stream_decrypt_file(const char *input, const char *output, const char *passphrase,
+                        const stream_opts_t *opts, stream_result_t *result) {
+    return stream_file(input, output, passphrase, opts, result, 1);
+}
+
+/* Header edit applied by update_header(); must keep header_len */
+typedef int (*header_op_fn)(enc_header_t *header, const void *arg);
+
+typedef struct {
+    const char *passphrase;
+    const char *new_passphrase;
+    uint32_t iterations;
+} key_op_t;
+
+/* pread and decode the v2/v3 header at the start of fd */
+static int pread_header(int fd, uint64_t size, const char *path, enc_header_t *header,
+                        stream_result_t *result) {
+    unsigned char raw[ENC_MAX_HEADER_LEN];
+    size_t header_len = 0;
+    size_t got = 0;
+    int rc;
+
+    const size_t want = size < ENC_HEADER_PREFIX_LEN ? (size_t)size : ENC_HEADER_PREFIX_LEN;
+    if (fio_pread_full(fd, raw, want, 0, &got) != FIO_SUCCESS || got != want) {
+        set_io_error(result, FIO_ERR_READ, path);
+        return ENC_ERR_IO;
+    }
+
+    rc = enc_header_size(raw, got, &header_len);
+    if (rc == ENC_SUCCESS && header_len > size) {
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+    if (rc == ENC_SUCCESS &&
+        (fio_pread_full(fd, raw + want, header_len - want, want, &got) != FIO_SUCCESS ||
+         got != header_len - want)) {
+        set_io_error(result, FIO_ERR_READ, path);
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_SUCCESS) {
+        result->bytes_in += header_len;
+        rc = enc_header_decode(raw, header_len, header);
+    }
+    return rc;
+}
+
+/* Read the header of path, apply op, pwrite it back in place and fsync */
+static int update_header(const char *path, header_op_fn op, const void *arg,
+                         stream_result_t *result) {
+    stream_result_t local;
+    enc_header_t header;
+    uint64_t size = 0;
+    int fd = -1;
+    int io;
+    int rc;
+
+    if (!path) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    io = fio_open_update(path, &fd, &size);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, path);
+        return ENC_ERR_IO;
+    }
+
+    rc = pread_header(fd, size, path, &header, result);
+    if (rc == ENC_SUCCESS) {
+        result->algorithm = header.algorithm;
+        rc = op(&header, arg);
+    }
+
+    /* Same length as before, so the payload after it is untouched */
+    if (rc == ENC_SUCCESS &&
+        (fio_pwrite_full(fd, header.raw, header.header_len, 0) != FIO_SUCCESS ||
+         fio_sync(fd) != FIO_SUCCESS)) {
+        set_io_error(result, FIO_ERR_WRITE, path);
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_SUCCESS) {
+        result->bytes_out = header.header_len;
+    }
+
+    if (fio_close(fd) != FIO_SUCCESS && rc == ENC_SUCCESS) {
+        set_io_error(result, FIO_ERR_CLOSE, path);
+        rc = ENC_ERR_IO;
+    }
+    return rc;
+}
+
+static int rekey_op(enc_header_t *header, const void *arg) {
+    const key_op_t *k = (const key_op_t *)arg;
+    return enc_rekey_header(header, k->passphrase, k->new_passphrase, k->iterations);
+}
+
+static int add_key_op(enc_header_t *header, const void *arg) {
+    const key_op_t *k = (const key_op_t *)arg;
+    return enc_add_recipient(header, k->passphrase, k->new_passphrase, k->iterations, NULL);
+}
+
+static int remove_key_op(enc_header_t *header, const void *arg) {
+    const key_op_t *k = (const key_op_t *)arg;
+    return enc_remove_recipient(header, k->passphrase, NULL);
+}
+
+int stream_rekey_file(const char *path, const char *old_passphrase, const char *new_passphrase,
+                      uint32_t iterations, stream_result_t *result) {
+    const key_op_t k = { old_passphrase, new_passphrase, iterations };
+
+    if (!old_passphrase || !new_passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    return update_header(path, rekey_op, &k, result);
+}
+
+int stream_add_key_file(const char *path, const char *passphrase, const char *new_passphrase,
+                        uint32_t iterations, stream_result_t *result) {
+    const key_op_t k = { passphrase, new_passphrase, iterations };
+
+    if (!passphrase || !new_passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    return update_header(path, add_key_op, &k, result);
+}
+
+int stream_remove_key_file(const char *path, const char *passphrase, stream_result_t *result) {
+    const key_op_t k = { passphrase, NULL, 0 };
+
+    if (!passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    return update_header(path, remove_key_op, &k, result);
+}
+
+typedef struct {
+    const enc_header_t *header;
+    const enc_key_t *key;
+    int enc_fd;
+    int plain_fd;
+    enc_gen_t *generations;
+    unsigned char *dirty;          /* Per segment: plaintext changed */
+    const uint64_t *todo;          /* Segments to reseal (second pass) */
+    unsigned char **scratch;       /* Per worker: sealed | old plain | new plain */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    int rc;
+    int io_error;                  /* FIO_* code when rc is ENC_ERR_IO */
+    int io_input;                  /* ... and it came from the plaintext */
+} update_t;
+
+/* Record the first failure; io_error != 0 marks an I/O one */
+static void update_fail(update_t *u, int rc, int io_error, int io_input) {
+    int expected = ENC_SUCCESS;
+    if (__atomic_compare_exchange_n(&u->rc, &expected, rc, 0, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+        u->io_error = io_error;
+        u->io_input = io_input;
+    }
+}
+
+/* Byte offset of segment index in the encrypted file */
+static uint64_t segment_offset(const enc_header_t *header, uint64_t index) {
+    return header->header_len + index * enc_sealed_len(header->algorithm, header->segment_size);
+}
+
+static int journal_record(int fd, int enc_fd, unsigned char *buf, uint64_t offset, size_t len) {
+    uint64_t head[2] = { offset, len };
+    size_t got = 0;
+
+    if (fio_pread_full(enc_fd, buf, len, offset, &got) != FIO_SUCCESS || got != len) {
+        return FIO_ERR_READ;
+    }
+    if (fio_write_full(fd, (const unsigned char *)head, sizeof(head)) != FIO_SUCCESS ||
+        fio_write_full(fd, buf, len) != FIO_SUCCESS) {
+        return FIO_ERR_WRITE;
+    }
+    return FIO_SUCCESS;
+}
+
+/* Journal the old bytes of the `changed` segments in todo, and the trailer */
+static int journal_update(const char *journal, int enc_fd, uint64_t enc_size,
+                          const update_t *u, uint64_t changed, uint64_t segments_end) {
+    const enc_header_t *h = u->header;
+    const size_t index_len = (size_t)enc_index_size(h);
+    const size_t full = enc_sealed_len(h->algorithm, h->segment_size);
+    unsigned char head[UPDATE_JOURNAL_HEAD];
+    char tmp[4096];
+    unsigned char *buf = (unsigned char *)mem_alloc(full > index_len ? full : index_len);
+    uint64_t fields[4];
+    uint64_t records = (enc_size > segments_end);
+    struct stat st;
+    int fd = -1;
+    int io = FIO_SUCCESS;
+
+    for (uint64_t i = 0; i < changed; i++) {
+        records += (u->generations[u->todo[i]].generation != ENC_GEN_HOLE);
+    }
+    if (!buf) {
+        return FIO_ERR_MEMORY;
+    }
+    if (fstat(enc_fd, &st) == -1 ||
+        fio_open_temp(journal, NULL, tmp, sizeof(tmp), &fd) != FIO_SUCCESS) {
+        mem_free(buf);
+        return FIO_ERR_OPEN;
+    }
+
+    fields[0] = (uint64_t)st.st_dev;
+    fields[1] = (uint64_t)st.st_ino;
+    fields[2] = enc_size;
+    fields[3] = records;
+    memcpy(head, UPDATE_JOURNAL_MAGIC, 8);
+    memcpy(head + 8, fields, sizeof(fields));
+    io = fio_write_full(fd, head, sizeof(head));
+
+    for (uint64_t i = 0; io == FIO_SUCCESS && i < changed; i++) {
+        const uint64_t index = u->todo[i];
+        if (u->generations[index].generation == ENC_GEN_HOLE) {
+            continue;  /* Never read back while the old index names a hole */
+        }
+        io = journal_record(fd, enc_fd, buf, segment_offset(h, index),
+                            enc_sealed_len(h->algorithm, segment_plain_len(h, index)));
+    }
+    if (io == FIO_SUCCESS && enc_size > segments_end) {
+        io = journal_record(fd, enc_fd, buf, segments_end, index_len);
+    }
+    mem_free(buf);
+
+    if (io != FIO_SUCCESS) {
+        fio_close(fd);
+        unlink(tmp);
+        return io;
+    }
+    io = fio_commit(fd, tmp, journal, FIO_SYNC_FILE);
+    if (io != FIO_SUCCESS) {
+        unlink(tmp);
+    }
+    return io;
+}
+
+/* Pass 1: authenticate segment i and compare it with the new plaintext */
+static void diff_task(void *arg, size_t i, int worker) {
+    update_t *u = (update_t *)arg;
+    const enc_header_t *h = u->header;
+    const size_t plain = segment_plain_len(h, i);
+    const size_t sealed_len = enc_sealed_len(h->algorithm, plain);
+    unsigned char *sealed = u->scratch[worker];
+    unsigned char *old_plain = sealed + enc_sealed_len(h->algorithm, h->segment_size);
+    unsigned char *new_plain = old_plain + h->segment_size;
+    size_t opened = 0;
+    size_t got = 0;
+    int rc;
+
+    if (__atomic_load_n(&u->rc, __ATOMIC_RELAXED) != ENC_SUCCESS) {
+        return;
+    }
+
+    /* A hole segment has nothing stored; opening it yields its zeros */
+    if (u->generations[i].generation != ENC_GEN_HOLE &&
+        (fio_pread_full(u->enc_fd, sealed, sealed_len, segment_offset(h, i), &got) !=
+             FIO_SUCCESS || got != sealed_len)) {
+        update_fail(u, ENC_ERR_IO, FIO_ERR_READ, 0);
+        return;
+    }
+    if (fio_pread_full(u->plain_fd, new_plain, plain, (uint64_t)i * h->segment_size, &got) != FIO_SUCCESS ||
+        got != plain) {
+        update_fail(u, ENC_ERR_IO, FIO_ERR_READ, 1);
+        return;
+    }
+    __atomic_fetch_add(&u->bytes_in,
+                       (u->generations[i].generation != ENC_GEN_HOLE ? sealed_len : 0) + plain,
+                       __ATOMIC_RELAXED);
+
+    rc = enc_open_segment_gen(h, u->key, i, &u->generations[i], sealed, sealed_len, old_plain,
+                              &opened);
+    if (rc == ENC_SUCCESS && opened != plain) {
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+    if (rc != ENC_SUCCESS) {
+        update_fail(u, rc, 0, 0);
+        return;
+    }
+    u->dirty[i] = memcmp(old_plain, new_plain, plain) != 0;
+}
+
+/* Pass 2: reseal a changed segment at the next generation, in place */
+static void reseal_task(void *arg, size_t i, int worker) {
+    update_t *u = (update_t *)arg;
+    const enc_header_t *h = u->header;
+    const uint64_t index = u->todo[i];
+    const size_t plain = segment_plain_len(h, index);
+    unsigned char *sealed = u->scratch[worker];
+    unsigned char *new_plain = sealed + enc_sealed_len(h->algorithm, h->segment_size) +
+                               h->segment_size;
+    enc_gen_t gen;
+    size_t sealed_len = 0;
+    size_t got = 0;
+    int rc;
+
+    if (__atomic_load_n(&u->rc, __ATOMIC_RELAXED) != ENC_SUCCESS) {
+        return;
+    }
+    rc = enc_next_gen(&u->generations[index], &gen);
+    if (rc != ENC_SUCCESS) {
+        update_fail(u, rc == ENC_ERR_INVALID_ARG ? ENC_ERR_ENCRYPT : rc, 0, 0);
+        return;
+    }
+
+    if (fio_pread_full(u->plain_fd, new_plain, plain, index * h->segment_size, &got) != FIO_SUCCESS ||
+        got != plain) {
+        update_fail(u, ENC_ERR_IO, FIO_ERR_READ, 1);
+        return;
+    }
+
+    rc = enc_seal_segment_gen(h, u->key, index, &gen, new_plain, plain, sealed,
+                              &sealed_len);
+    if (rc != ENC_SUCCESS) {
+        update_fail(u, rc, 0, 0);
+        return;
+    }
+    if (fio_pwrite_full(u->enc_fd, sealed, sealed_len, segment_offset(h, index)) != FIO_SUCCESS) {
+        update_fail(u, ENC_ERR_IO, FIO_ERR_WRITE, 0);
+        return;
+    }
+    u->generations[index] = gen;
+    __atomic_fetch_add(&u->bytes_out, sealed_len, __ATOMIC_RELAXED);
+}
+
+static int update_segments(int enc_fd, uint64_t enc_size, int plain_fd, uint64_t plain_size,
+                           const char *path, const char *input, const char *passphrase,
+                           const stream_opts_t *opts, stream_result_t *result) {
+    enc_header_t header;
+    stream_plan_t plan;
+    enc_key_t *key = NULL;
+    thread_pool_t *pool = NULL;
+    update_t u;
+    uint64_t *todo = NULL;
+    unsigned char *trailer = NULL;
+    char journal[4096];
+    uint32_t epoch = 0;
+    int journaled = 0;
+    int workers = 0;
+    int rc;
+
+    memset(&u, 0, sizeof(u));
+
+    if (update_journal_path(path, journal, sizeof(journal)) != FIO_SUCCESS) {
+        set_io_error(result, FIO_ERR_OPEN, path);
+        return ENC_ERR_IO;
+    }
+    rc = rollback_update(journal, enc_fd, &enc_size, result);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    rc = pread_header(enc_fd, enc_size, path, &header, result);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    result->algorithm = header.algorithm;
+
+    /* plaintext_len is bound into every segment, so it cannot change here */
+    if (header.plaintext_len != plain_size) {
+        return ENC_ERR_INVALID_ARG;
+    }
+
+    const uint64_t segments = enc_segment_count(&header);
+    const uint64_t segments_end = enc_payload_size(&header);
+    const size_t index_len = (size_t)enc_index_size(&header);
+    if (segments_end != enc_size &&
+        (segments_end > enc_size || enc_size - segments_end != index_len)) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    rc = stream_plan(opts, 1, header.algorithm, header.segment_size, header.plaintext_len, &plan);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    u.generations = (enc_gen_t *)mem_calloc((size_t)segments, sizeof(enc_gen_t));
+    u.dirty = (unsigned char *)mem_calloc((size_t)segments, 1);
+    todo = (uint64_t *)mem_alloc((size_t)segments * sizeof(*todo));
+    trailer = (unsigned char *)mem_alloc(index_len);
+    if (!key || !u.generations || !u.dirty || !todo || !trailer) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    rc = enc_derive_key(passphrase, &header, key);
+    if (rc == ENC_SUCCESS && segments_end != enc_size) {
+        enc_gen_t *generations = NULL;
+        rc = read_index(enc_fd, &header, key, segments_end, &generations, &epoch, result);
+        if (rc == ENC_SUCCESS) {
+            memcpy(u.generations, generations, (size_t)segments * sizeof(enc_gen_t));
+        }
+        mem_free(generations);
+    }
+    if (rc == ENC_SUCCESS && epoch >= ENC_GEN_HOLE - 1) {
+        rc = ENC_ERR_ENCRYPT;
+    }
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+
+    pool = tp_acquire(plan.threads);
+    workers = tp_size(pool);
+    u.scratch = pool ? (unsigned char **)mem_calloc((size_t)workers, sizeof(*u.scratch)) : NULL;
+    if (!u.scratch) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+    for (int w = 0; w < workers; w++) {
+        u.scratch[w] = (unsigned char *)secmem_alloc(
+            enc_sealed_len(header.algorithm, header.segment_size) + 2 * (size_t)header.segment_size);
+        if (!u.scratch[w]) {
+            rc = ENC_ERR_MEMORY;
+            goto cleanup;
+        }
+    }
+
+    u.header = &header;
+    u.key = key;
+    u.enc_fd = enc_fd;
+    u.plain_fd = plain_fd;
+    u.todo = todo;
+
+    /* Everything is authenticated before the first write, so a wrong key
+     * or a tampered file is refused without touching it */
+    tp_parallel_for(pool, (size_t)segments, diff_task, &u);
+    rc = u.rc;
+    if (rc == ENC_ERR_IO) {
+        set_io_error(result, u.io_error, u.io_input ? input : path);
+    }
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+
+    uint64_t changed = 0;
+    for (uint64_t i = 0; i < segments; i++) {
+        if (u.dirty[i]) todo[changed++] = i;
+    }
+    result->segments_updated = changed;
+    if (changed == 0) {
+        goto cleanup;
+    }
+
+    /* Nothing is overwritten until the old bytes are durable elsewhere */
+    const int io = journal_update(journal, enc_fd, enc_size, &u, changed, segments_end);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, io == FIO_ERR_READ ? path : NULL);
+        rc = (io == FIO_ERR_MEMORY) ? ENC_ERR_MEMORY : ENC_ERR_IO;
+        goto cleanup;
+    }
+    journaled = 1;
+
+    tp_parallel_for(pool, (size_t)changed, reseal_task, &u);
+    rc = u.rc;
+    if (rc == ENC_ERR_IO) {
+        set_io_error(result, u.io_error, u.io_input ? input : path);
+    }
+
+    /* The new index makes the resealed segments valid; until it lands,
+     * they fail authentication rather than decrypt to mixed versions */
+    if (rc == ENC_SUCCESS) {
+        rc = enc_seal_index(&header, key, epoch + 1, u.generations, trailer);
+    }
+    if (rc == ENC_SUCCESS &&
+        (fio_pwrite_full(enc_fd, trailer, index_len, segments_end) != FIO_SUCCESS ||
+         fio_sync(enc_fd) != FIO_SUCCESS)) {
+        rc = ENC_ERR_IO;
+    }
+    if (rc == ENC_SUCCESS) {
+        u.bytes_out += index_len;
+        /* The update is durable; a journal that outlived it would undo it */
+        if (unlink(journal) == -1 || fio_sync_parent(journal) != FIO_SUCCESS) {
+            rc = ENC_ERR_IO;
+        }
+        journaled = 0;
+    }
+
+cleanup:
+    if (journaled) {
+        /* Put the old version back now; if that fails too, the journal
+         * stays and the next update or decrypt of path retries it */
+        stream_result_t ignored;
+        memset(&ignored, 0, sizeof(ignored));
+        rollback_update(journal, enc_fd, &enc_size, &ignored);
+    }
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        set_io_error(result, FIO_ERR_WRITE, path);
+    }
+    result->bytes_in += u.bytes_in;
+    result->bytes_out += u.bytes_out;
+    for (int w = 0; u.scratch && w < workers; w++) {
+        secmem_free(u.scratch[w]);
+    }
+    mem_free(u.scratch);
+    tp_release(pool);
+    mem_free(trailer);
+    mem_free(todo);
+    mem_free(u.dirty);
+    mem_free(u.generations);
+    secmem_free(key);
+    return rc;
+}
+
+int stream_update_file(const char *path, const char *input, const char *passphrase,
+                       const stream_opts_t *opts, stream_result_t *result) {
+    stream_opts_t defaults;
+    stream_result_t local;
+    uint64_t enc_size = 0;
+    uint64_t in_size = 0;
+    int enc_fd = -1;
+    int in_fd = -1;
+    int io;
+    int rc;
+
+    if (!path || !input || !passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        stream_opts_init(&defaults);
+        opts = &defaults;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    io = fio_open_input(input, &in_fd, &in_size);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, input);
+        return ENC_ERR_IO;
+    }
+    io = fio_open_update(path, &enc_fd, &enc_size);
+    if (io != FIO_SUCCESS) {
+        fio_close(in_fd);
+        set_io_error(result, io, path);
+        return ENC_ERR_IO;
+    }
+
+    rc = update_segments(enc_fd, enc_size, in_fd, in_size, path, input, passphrase, opts, result);
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_path = path;
+    }
+
+    fio_close(in_fd);
+    if (fio_close(enc_fd) != FIO_SUCCESS && rc == ENC_SUCCESS) {
+        set_io_error(result, FIO_ERR_CLOSE, path);
+        rc = ENC_ERR_IO;
+    }
+    return rc;
+}
+
+/* Authenticate the checkpoint against the files, then cut the output back to
+ * it and run the rest of the segments */
+static int resume_segments(int in_fd, uint64_t in_size, int out_fd, uint64_t out_size,
+                           const char *input, const char *output, const char *passphrase,
+                           int decrypt, uint64_t segments, const unsigned char *tag,
+                           const stream_opts_t *opts, stream_result_t *result, int *touched) {
+    const int enc_fd = decrypt ? in_fd : out_fd;
+    const uint64_t enc_size = decrypt ? in_size : out_size;
+    unsigned char seen[STREAM_TAG_LEN];
+    stream_plan_t plan;
+    enc_header_t header;
+    enc_key_t *key;
+    enc_gen_t *generations = NULL;
+    uint32_t epoch = 0;
+    size_t got = 0;
+    int rc;
+
+    /* The header and the segment tags live in the ciphertext */
+    rc = pread_header(enc_fd, enc_size, decrypt ? input : output, &header, result);
+    if (!decrypt) {
+        result->bytes_in = 0;   /* That was the output's own header */
+    }
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+    result->algorithm = header.algorithm;
+
+    const uint64_t payload_end = enc_payload_size(&header);
+    const uint64_t sealed_end = segment_offset(&header, segments);
+    const uint64_t plain_end = segments * header.segment_size;
+    if (segments >= enc_segment_count(&header) || enc_size < sealed_end ||
+        (decrypt ? (out_size < plain_end ||
+                    (payload_end != in_size && (payload_end > in_size ||
+                                                in_size - payload_end != enc_index_size(&header))))
+                 : header.plaintext_len != in_size)) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    if (fio_pread_full(enc_fd, seen, sizeof(seen), sealed_end - STREAM_TAG_LEN, &got) !=
+            FIO_SUCCESS || got != sizeof(seen)) {
+        set_io_error(result, FIO_ERR_READ, decrypt ? input : output);
+        return ENC_ERR_IO;
+    }
+    if (memcmp(seen, tag, STREAM_TAG_LEN) != 0) {
+        return ENC_ERR_INVALID_FORMAT;
+    }
+
+    rc = stream_plan(opts, decrypt, header.algorithm, header.segment_size, header.plaintext_len,
+                     &plan);
+    if (rc != ENC_SUCCESS) {
+        return rc;
+    }
+
+    key = (enc_key_t *)secmem_alloc(sizeof(*key));
+    if (!key) {
+        return ENC_ERR_MEMORY;
+    }
+    rc = opts->keyring ? keyring_open(opts->keyring, &header, key)
+                       : enc_derive_key(passphrase, &header, key);
+    if (rc == ENC_SUCCESS && decrypt && payload_end != in_size) {
+        rc = read_index(in_fd, &header, key, payload_end, &generations, &epoch, result);
+    }
+    if (rc == ENC_SUCCESS && !decrypt) {
+        /* The same input maps to the same holes the first run skipped */
+        rc = map_holes(in_fd, out_fd, &header, opts, &generations, result);
+    }
+
+    if (rc == ENC_SUCCESS) {
+        const uint64_t out_keep = decrypt ? plain_end : sealed_end;
+        const uint64_t in_skip = decrypt ? sealed_end : plain_end;
+
+        *touched = 1;
+        if (ftruncate(out_fd, (off_t)out_keep) != 0 ||
+            lseek(out_fd, (off_t)out_keep, SEEK_SET) < 0) {
+            set_io_error(result, FIO_ERR_WRITE, output);
+            rc = ENC_ERR_IO;
+        } else if (lseek(in_fd, (off_t)in_skip, SEEK_SET) < 0) {
+            set_io_error(result, FIO_ERR_READ, input);
+            rc = ENC_ERR_IO;
+        } else {
+            rc = preallocate_segments(out_fd, &header, generations, decrypt, segments, result);
+        }
+        if (rc == ENC_SUCCESS) {
+            rc = run_segments(in_fd, out_fd, &header, key, generations, decrypt, segments, &plan,
+                              opts, result);
+        }
+        if (rc == ENC_SUCCESS && generations) {
+            rc = decrypt ? extend_output(out_fd, header.plaintext_len, result)
+                         : write_hole_index(out_fd, &header, key, generations, payload_end, result);
+        }
+    }
+
+    mem_free(generations);
+    secmem_free(key);  /* Wipes it */
+    return rc;
+}
+
+int stream_resume_file(const char *input, const char *output, const char *passphrase,
+                       int decrypt, uint64_t segments, const unsigned char *tag,
+                       const stream_opts_t *opts, stream_result_t *result) {
+    stream_result_t local;
+    char tmp[4096];
+    uint64_t in_size = 0;
+    uint64_t out_size = 0;
+    int in_fd = -1;
+    int out_fd = -1;
+    int touched = 0;
+    int io;
+    int rc;
+
+    if (!input || !output || !passphrase || !tag || segments == 0 || !opts || !opts->temp_id) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+    if (fio_temp_path(output, opts->temp_id, tmp, sizeof(tmp)) != FIO_SUCCESS) {
+        set_io_error(result, FIO_ERR_OPEN, output);
+        return ENC_ERR_IO;
+    }
+    if (decrypt && (rc = recover_update(input, result)) != ENC_SUCCESS) {
+        return rc;
+    }
+
+    io = fio_open_input(input, &in_fd, &in_size);
+    if (io != FIO_SUCCESS) {
+        set_io_error(result, io, input);
+        return ENC_ERR_IO;
+    }
+    io = fio_reopen_temp(tmp, &out_fd, &out_size);
+    if (io != FIO_SUCCESS) {
+        fio_close(in_fd);
+        set_io_error(result, io, output);
+        return ENC_ERR_IO;
+    }
+
+    rc = resume_segments(in_fd, in_size, out_fd, out_size, input, output, passphrase, decrypt,
+                         segments, tag, opts, result, &touched);
+    if (rc == ENC_ERR_IO && !result->io_path) {
+        result->io_path = (result->io_error == FIO_ERR_READ) ? input : output;
+    }
+
+    fio_close(in_fd);
+    rc = commit_output(out_fd, tmp, output, opts, rc, result);
+
+    if (rc != ENC_SUCCESS && touched) {
+        unlink(tmp);  /* Never leave a partial or unauthenticated output */
+    }
+    return rc;
+}
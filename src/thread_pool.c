@@ -0,0 +1,234 @@
+/*
+ * thread_pool.c - Fixed-size POSIX thread pool
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Demonstrates OS concepts:
+ * - Thread creation and joining: pthread_create(), pthread_join()
+ * - Synchronization: mutexes and condition variables
+ * - Work distribution with an atomic counter
+ * - Reusing parked threads across runs instead of creating them per run
+ */
+
+#include "../include/thread_pool.h"
+#include "../include/mem.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct thread_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;   /* Signalled when a new loop starts */
+    pthread_cond_t work_done;    /* Signalled when the last worker finishes */
+
+    pthread_t *threads;
+    int size;                    /* Workers including the caller */
+    int requested;               /* threads as passed to tp_create() */
+
+    /* Current loop (protected by lock, except next which is atomic) */
+    tp_task_fn fn;
+    void *arg;
+    size_t count;
+    size_t next;
+    unsigned long generation;
+    int busy;                    /* Background workers still in this loop */
+    int shutdown;
+};
+
+typedef struct {
+    thread_pool_t *pool;
+    int id;
+} worker_arg_t;
+
+/* Idle pools handed back with tp_release(), at most TP_IDLE_MAX */
+#define TP_IDLE_MAX 4
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_pool_t *idle_pools[TP_IDLE_MAX];
+
+int tp_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0) ? (int)cpus : 1;
+}
+
+/* Claim indices until the loop is exhausted */
+static void run_tasks(thread_pool_t *pool, tp_task_fn fn, void *arg, size_t count, int worker) {
+    for (;;) {
+        size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= count) {
+            break;
+        }
+        fn(arg, i, worker);
+    }
+}
+
+static void *worker_main(void *raw) {
+    worker_arg_t *warg = (worker_arg_t *)raw;
+    thread_pool_t *pool = warg->pool;
+    const int id = warg->id;
+    unsigned long seen = 0;
+
+    mem_free(warg);
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+
+        seen = pool->generation;
+        tp_task_fn fn = pool->fn;
+        void *arg = pool->arg;
+        size_t count = pool->count;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool, fn, arg, count, id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool_t *tp_create(int threads) {
+    thread_pool_t *pool = (thread_pool_t *)mem_calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+
+    if (threads <= 0) {
+        threads = tp_default_threads();
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->size = 1;
+    pool->requested = threads;
+
+    if (threads > 1) {
+        pool->threads = (pthread_t *)mem_calloc((size_t)threads - 1, sizeof(pthread_t));
+        if (!pool->threads) {
+            tp_destroy(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 1; i < threads; i++) {
+        worker_arg_t *warg = (worker_arg_t *)mem_alloc(sizeof(*warg));
+        if (!warg) {
+            break;
+        }
+        warg->pool = pool;
+        warg->id = i;
+        if (pthread_create(&pool->threads[i - 1], NULL, worker_main, warg) != 0) {
+            mem_free(warg);
+            break;  /* Run with however many workers we got */
+        }
+        pool->size++;
+    }
+
+    return pool;
+}
+
+thread_pool_t *tp_acquire(int threads) {
+    if (threads <= 0) {
+        threads = tp_default_threads();
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    for (int i = 0; i < TP_IDLE_MAX; i++) {
+        thread_pool_t *pool = idle_pools[i];
+        if (pool && pool->requested == threads) {
+            idle_pools[i] = NULL;
+            pthread_mutex_unlock(&idle_lock);
+            return pool;
+        }
+    }
+    pthread_mutex_unlock(&idle_lock);
+
+    return tp_create(threads);
+}
+
+void tp_release(thread_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    for (int i = 0; i < TP_IDLE_MAX; i++) {
+        if (!idle_pools[i]) {
+            idle_pools[i] = pool;
+            pthread_mutex_unlock(&idle_lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&idle_lock);
+
+    tp_destroy(pool);  /* Enough idle pools already */
+}
+
+int tp_size(const thread_pool_t *pool) {
+    return pool ? pool->size : 1;
+}
+
+void tp_parallel_for(thread_pool_t *pool, size_t count, tp_task_fn fn, void *arg) {
+    if (count == 0) {
+        return;
+    }
+
+    /* Not worth waking anyone for a single task */
+    if (pool->size == 1 || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(arg, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    pool->next = 0;
+    pool->busy = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool, fn, arg, count, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void tp_destroy(thread_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->size - 1; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    mem_free(pool->threads);
+    mem_free(pool);
+}
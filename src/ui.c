@@ -8,8 +8,12 @@
  */
 
 #include "../include/ui.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 /* ASCII art banner - compatible with all terminals */
 static const char *BANNER[] = {
@@ -232,6 +236,295 @@ void ui_progress_bar(const char *label, float progress) {
     refresh();
 }
 
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* h:mm:ss or m:ss */
+static void format_eta(char *buf, size_t len, double seconds) {
+    const unsigned long total = (unsigned long)(seconds + 0.5);
+
+    if (total >= 3600) {
+        snprintf(buf, len, "%lu:%02lu:%02lu", total / 3600, (total / 60) % 60, total % 60);
+    } else {
+        snprintf(buf, len, "%lu:%02lu", total / 60, total % 60);
+    }
+}
+
+/* Start timing an operation */
+void ui_progress_start(ui_progress_t *progress, const char *label) {
+    progress->label = label;
+    progress->start_ns = now_ns();
+    progress->last_draw_ns = 0;
+    ui_progress_bar(label, 0.0f);
+}
+
+/* Throttled redraw with percentage, throughput and ETA */
+void ui_progress_update(ui_progress_t *progress, uint64_t done, uint64_t total) {
+    const uint64_t now = now_ns();
+
+    if (progress->last_draw_ns != 0 && done < total &&
+        now - progress->last_draw_ns < 1000000000ULL / UI_PROGRESS_HZ) {
+        return;
+    }
+    progress->last_draw_ns = now;
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    (void)max_y;
+
+    int y = BANNER_HEIGHT + 9;
+    int x = (max_x - 50) / 2;
+    if (x < 2) x = 2;
+
+    const double elapsed = (double)(now - progress->start_ns) / 1e9;
+    const double rate = (elapsed > 0.0) ? (double)done / elapsed : 0.0;
+    char eta[32];
+
+    if (done >= total) {
+        format_eta(eta, sizeof(eta), 0.0);
+    } else if (rate > 0.0) {
+        format_eta(eta, sizeof(eta), (double)(total - done) / rate);
+    } else {
+        snprintf(eta, sizeof(eta), "--:--");
+    }
+
+    ui_progress_bar(progress->label, total ? (float)((double)done / (double)total) : 1.0f);
+
+    attron(COLOR_PAIR(COLOR_MENU));
+    mvprintw(y, x + 20, "%.1f / %.1f MB  %7.1f MB/s  ETA %-8s",
+             (double)done / 1e6, (double)total / 1e6, rate / 1e6, eta);
+    clrtoeol();
+    attroff(COLOR_PAIR(COLOR_MENU));
+    refresh();
+}
+
+/* Where the aggregate numbers say the bottleneck is */
+static const char *job_verdict(const ui_job_totals_t *totals) {
+    if (totals->running == 0) {
+        return "idle";
+    }
+    if (totals->cpu_pct >= 85.0) {
+        return "CPU-bound: cores saturated";
+    }
+    if (totals->iowait_pct >= 20.0) {
+        return "I/O-bound: disks saturated";
+    }
+    return "headroom: neither cores nor disks full";
+}
+
+/* Job queue screen: one progress row per job, totals underneath */
+void ui_show_jobs(const ui_job_row_t *rows, int count, int selected,
+                  const ui_job_totals_t *totals, const char *note) {
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+
+    int x = (max_x - 78) / 2;
+    if (x < 0) x = 0;
+    int y = 1;
+
+    erase();
+
+    attron(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    mvprintw(y, x,     "+----------------------------------------------------------------------------+");
+    mvprintw(y + 1, x, "|  %-72s  |", "Job Queue");
+    mvprintw(y + 2, x, "+----------------------------------------------------------------------------+");
+    attroff(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    y += 3;
+
+    if (count == 0) {
+        attron(COLOR_PAIR(COLOR_MENU));
+        mvprintw(y++, x + 2, "No jobs. Press e or d to queue one.");
+        attroff(COLOR_PAIR(COLOR_MENU));
+    }
+
+    /* Leave room for the totals and help lines */
+    for (int i = 0; i < count && y < max_y - 5; i++, y++) {
+        const ui_job_row_t *row = &rows[i];
+        const int bar_width = 16;
+        const double fraction = row->total ? (double)row->done / (double)row->total
+                                           : (strcmp(row->status, "done") == 0 ? 1.0 : 0.0);
+        const int filled = (int)(fraction * bar_width);
+        const int pair = (i == selected) ? COLOR_SELECTED : COLOR_MENU;
+
+        /* Show the tail of long paths: the file name matters most */
+        const size_t in_len = strlen(row->input);
+        const char *input = (in_len > 16) ? row->input + in_len - 16 : row->input;
+
+        attron(COLOR_PAIR(pair));
+        mvprintw(y, x, "%c %-7s %-16s [", (i == selected) ? '>' : ' ', row->operation, input);
+        attroff(COLOR_PAIR(pair));
+
+        attron(COLOR_PAIR(COLOR_SUCCESS) | A_BOLD);
+        for (int b = 0; b < filled; b++) {
+            printw("#");
+        }
+        attroff(COLOR_PAIR(COLOR_SUCCESS) | A_BOLD);
+        attron(COLOR_PAIR(COLOR_MENU));
+        for (int b = filled; b < bar_width; b++) {
+            printw("-");
+        }
+        printw("] %3d%% %7.1f MB/s ", (int)(fraction * 100), row->rate / 1e6);
+        attroff(COLOR_PAIR(COLOR_MENU));
+
+        const int status_pair = (strcmp(row->status, "done") == 0) ? COLOR_SUCCESS
+                              : (strcmp(row->status, "running") == 0 ||
+                                 strcmp(row->status, "queued") == 0) ? COLOR_WARNING
+                              : COLOR_ERROR;
+        attron(COLOR_PAIR(status_pair));
+        printw("%-.14s", row->status);
+        attroff(COLOR_PAIR(status_pair));
+    }
+
+    y++;
+    attron(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    mvprintw(y++, x, "Running %d  Queued %d  |  %.1f MB/s  |  CPU %3.0f%% of %d core%s  |  I/O wait ",
+             totals->running, totals->queued, totals->rate / 1e6, totals->cpu_pct,
+             totals->cpus, totals->cpus == 1 ? "" : "s");
+    if (totals->iowait_pct >= 0.0) {
+        printw("%3.0f%%", totals->iowait_pct);
+    } else {
+        printw("n/a");
+    }
+    attroff(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+
+    attron(COLOR_PAIR(COLOR_MENU));
+    mvprintw(y++, x, "Bottleneck: %s", job_verdict(totals));
+    attroff(COLOR_PAIR(COLOR_MENU));
+
+    if (note && note[0]) {
+        attron(COLOR_PAIR(COLOR_WARNING) | A_BOLD);
+        mvprintw(y, x, "%s", note);
+        attroff(COLOR_PAIR(COLOR_WARNING) | A_BOLD);
+    }
+    y++;
+
+    attron(COLOR_PAIR(COLOR_WARNING));
+    mvprintw(y, x, "e: Encrypt  d: Decrypt  c: Cancel  p: Dashboard  UP/DOWN: Select  q: Back");
+    attroff(COLOR_PAIR(COLOR_WARNING));
+
+    refresh();
+}
+
+/* Fixed-width bar for a 0..1 share */
+static void draw_share(double share, int width) {
+    const int filled = (int)(share * width + 0.5);
+
+    attron(COLOR_PAIR(COLOR_SUCCESS) | A_BOLD);
+    for (int b = 0; b < filled && b < width; b++) {
+        printw("#");
+    }
+    attroff(COLOR_PAIR(COLOR_SUCCESS) | A_BOLD);
+    attron(COLOR_PAIR(COLOR_MENU));
+    for (int b = filled; b < width; b++) {
+        printw("-");
+    }
+    attroff(COLOR_PAIR(COLOR_MENU));
+}
+
+void ui_show_dashboard(const stats_live_t *before, const stats_live_t *after, double interval_s,
+                       const ui_job_totals_t *totals) {
+    static const char *STAGE_NAMES[STATS_STAGE_COUNT] = { "read", "crypto", "write" };
+    secmem_stats_t pool;
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+
+    int x = (max_x - 78) / 2;
+    if (x < 0) x = 0;
+    int y = 1;
+    const double dt = interval_s > 0.0 ? interval_s : 1.0;
+
+    erase();
+
+    attron(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    mvprintw(y, x,     "+----------------------------------------------------------------------------+");
+    mvprintw(y + 1, x, "|  %-72s  |", "Performance Dashboard");
+    mvprintw(y + 2, x, "+----------------------------------------------------------------------------+");
+    mvprintw(y + 3, x, "%-8s %10s  %-22s %6s %12s", "worker", "MB/s", "busy", "", "segments");
+    attroff(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    y += 4;
+
+    /* Reserve the pipeline, I/O, CPU, memory and help lines */
+    const int worker_rows = max_y - y - 10;
+    for (int i = 0; i < after->workers && i < STATS_MAX_WORKERS; i++, y++) {
+        const stats_worker_t *a = &after->worker[i];
+        const stats_worker_t *b = &before->worker[i];
+        double busy = (double)(a->busy_ns - b->busy_ns) / 1e9 / dt;
+
+        if (i >= worker_rows) {
+            attron(COLOR_PAIR(COLOR_MENU));
+            mvprintw(y++, x, "  ... %d more", after->workers - i);
+            attroff(COLOR_PAIR(COLOR_MENU));
+            break;
+        }
+        if (busy > 1.0) {
+            busy = 1.0;   /* Sampling skew; workers of several jobs share a slot */
+        }
+        attron(COLOR_PAIR(COLOR_MENU));
+        mvprintw(y, x, "%-8d %10.1f  [", i, (double)(a->bytes - b->bytes) / 1e6 / dt);
+        attroff(COLOR_PAIR(COLOR_MENU));
+        draw_share(busy, 20);
+        attron(COLOR_PAIR(COLOR_MENU));
+        printw("] %4.0f%% %12llu", busy * 100.0, (unsigned long long)a->segments);
+        attroff(COLOR_PAIR(COLOR_MENU));
+    }
+    if (after->workers == 0) {
+        attron(COLOR_PAIR(COLOR_MENU));
+        mvprintw(y++, x, "  No stream has run yet. Queue a job to see its workers.");
+        attroff(COLOR_PAIR(COLOR_MENU));
+    }
+    y++;
+
+    /* Occupancy: where the segments in flight are sitting right now */
+    int64_t in_flight = 0;
+    for (int s = 0; s < STATS_STAGE_COUNT; s++) {
+        in_flight += after->stage[s] > 0 ? after->stage[s] : 0;
+    }
+    attron(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    mvprintw(y++, x, "Pipeline stages (segments in flight: %lld)", (long long)in_flight);
+    attroff(COLOR_PAIR(COLOR_ACCENT) | A_BOLD);
+    move(y++, x);
+    for (int s = 0; s < STATS_STAGE_COUNT; s++) {
+        const int64_t n = after->stage[s] > 0 ? after->stage[s] : 0;
+        attron(COLOR_PAIR(COLOR_MENU));
+        printw("%s%-6s %3lld [", s ? "  " : "", STAGE_NAMES[s], (long long)n);
+        attroff(COLOR_PAIR(COLOR_MENU));
+        draw_share(in_flight ? (double)n / (double)in_flight : 0.0, 10);
+        attron(COLOR_PAIR(COLOR_MENU));
+        printw("]");
+        attroff(COLOR_PAIR(COLOR_MENU));
+    }
+
+    /* Wait shares are summed over running streams, so may pass 100% */
+    attron(COLOR_PAIR(COLOR_MENU));
+    mvprintw(y++, x, "I/O wait: read %3.0f%%  write %3.0f%% of wall time   host iowait ",
+             100.0 * (double)(after->read_ns - before->read_ns) / 1e9 / dt,
+             100.0 * (double)(after->write_ns - before->write_ns) / 1e9 / dt);
+    if (totals->iowait_pct >= 0.0) {
+        printw("%3.0f%%", totals->iowait_pct);
+    } else {
+        printw("n/a");
+    }
+    mvprintw(y++, x, "CPU: %3.0f%% of %d core%s   throughput %.1f MB/s   jobs %d running",
+             totals->cpu_pct, totals->cpus, totals->cpus == 1 ? "" : "s",
+             totals->rate / 1e6, totals->running);
+
+    secmem_get_stats(&pool);
+    mvprintw(y++, x, "Memory: buffers %.1f MB (peak %.1f MB)   secure pool %.1f MB (peak %.1f MB)",
+             (double)mem_current() / 1e6, (double)mem_peak() / 1e6,
+             (double)pool.mapped_bytes / 1e6, (double)pool.peak_mapped_bytes / 1e6);
+    attroff(COLOR_PAIR(COLOR_MENU));
+    y++;
+
+    attron(COLOR_PAIR(COLOR_WARNING));
+    mvprintw(y, x, "p: Job list  q: Back");
+    attroff(COLOR_PAIR(COLOR_WARNING));
+
+    refresh();
+}
+
 /* Display a message with color */
 void ui_message(const char *msg, int color_pair) {
     int max_y, max_x;
@@ -275,6 +568,14 @@ void ui_wait_key(const char *prompt) {
     getch();
 }
 
+/* Wait up to timeout_ms for a key without blocking the caller's loop */
+int ui_poll_key(int timeout_ms) {
+    timeout(timeout_ms);
+    int ch = getch();
+    timeout(-1);    /* Back to blocking for menus and prompts */
+    return ch;
+}
+
 /* Clear screen and redraw header */
 void ui_clear_content(void) {
     clear();
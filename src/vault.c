@@ -0,0 +1,789 @@
+/*
+ * vault.c - Directory-wide passphrase rotation
+ *
+ * File Encryption & Decryption Tool
+ * OS Course Project - Phase 3
+ *
+ * Per batch of VAULT_BATCH files:
+ *   pread() headers  ->  derive missing KEKs  ->  journal old headers, fsync
+ *   ->  rewrap + pwrite() + fsync() on the pool  ->  journal "done", fsync
+ *
+ * The journal holds the new salt and each file's old header, so after a
+ * crash --resume derives the same new KEK, skips files that already open
+ * with it and puts back any header that was torn mid-write.
+ *
+ * Demonstrates OS concepts:
+ * - Directory traversal: opendir(), readdir(), lstat()
+ * - Positional I/O from many threads: pread(), pwrite()
+ * - Write-ahead logging with O_APPEND and fsync()
+ */
+
+#include "../include/vault.h"
+#include "../include/encryption.h"
+#include "../include/file_io.h"
+#include "../include/mem.h"
+#include "../include/secmem.h"
+#include "../include/thread_pool.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "FENC-REKEY 1"
+
+/* Per-file progress through a batch */
+#define ENTRY_PENDING 0    /* No cached KEK opens it yet */
+#define ENTRY_READY   1    /* Old KEK and slot found, not yet written */
+#define ENTRY_CURRENT 2    /* Already opens with the new KEK */
+#define ENTRY_DONE    3
+#define ENTRY_FAILED  4
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t cap;
+} path_list_t;
+
+/* An old header journalled by an interrupted run and not marked done */
+typedef struct {
+    char *path;                        /* Relative to the vault directory */
+    size_t len;
+    unsigned char raw[ENC_MAX_HEADER_LEN];
+} pending_t;
+
+typedef struct {
+    const char *path;                  /* Full path */
+    const char *rel;                   /* Path inside the vault, as journalled */
+    int fd;
+    int state;
+    int restored;
+    const char *error;
+    int kek;                           /* Index into the old KEK cache */
+    int slot;
+    int next_slot;                     /* First slot derive_missing() has not tried */
+    enc_header_t header;
+} entry_t;
+
+typedef struct {
+    entry_t *entries;
+    const enc_kek_t *new_kek;
+    const enc_kek_t *keks;             /* Old KEK cache, read-only on the pool */
+    int kek_count;
+    const pending_t *pending;
+    size_t pending_count;
+    enc_kek_t *derive;                 /* KDF round: slots to fill */
+    const char *derive_pass;
+    int derive_rc;
+} batch_t;
+
+void vault_opts_init(vault_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+}
+
+/* ── Directory walk ──────────────────────────────────────────────── */
+
+static int list_add(path_list_t *list, const char *path) {
+    if (list->count == list->cap) {
+        const size_t cap = list->cap ? list->cap * 2 : 64;
+        char **items = (char **)mem_alloc(cap * sizeof(*items));
+        if (!items) {
+            return ENC_ERR_MEMORY;
+        }
+        if (list->count) {
+            memcpy(items, list->items, list->count * sizeof(*items));
+        }
+        mem_free(list->items);
+        list->items = items;
+        list->cap = cap;
+    }
+
+    const size_t len = strlen(path);
+    char *copy = (char *)mem_alloc(len + 1);
+    if (!copy) {
+        return ENC_ERR_MEMORY;
+    }
+    memcpy(copy, path, len + 1);
+    list->items[list->count++] = copy;
+    return ENC_SUCCESS;
+}
+
+static void list_free(path_list_t *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        mem_free(list->items[i]);
+    }
+    mem_free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+static int has_enc_suffix(const char *name) {
+    const size_t len = strlen(name);
+    return len > 4 && strcmp(name + len - 4, ".enc") == 0;
+}
+
+/* Collect regular .enc files below dir; symlinks are not followed */
+static int collect(const char *dir, path_list_t *list) {
+    DIR *d = opendir(dir);
+    struct dirent *ent;
+    int rc = ENC_SUCCESS;
+
+    if (!d) {
+        return ENC_ERR_IO;
+    }
+
+    while (rc == ENC_SUCCESS && (ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        const size_t len = strlen(dir) + 1 + strlen(ent->d_name) + 1;
+        char *path = (char *)mem_alloc(len);
+        struct stat st;
+
+        if (!path) {
+            rc = ENC_ERR_MEMORY;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir, ent->d_name);
+
+        if (lstat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                rc = collect(path, list);
+            } else if (S_ISREG(st.st_mode) && has_enc_suffix(ent->d_name)) {
+                rc = list_add(list, path);
+            }
+        }
+        mem_free(path);
+    }
+
+    closedir(d);
+    return rc;
+}
+
+static int cmp_path(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* ── Journal ─────────────────────────────────────────────────────── */
+
+static void hex_encode(const unsigned char *in, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+    out[2 * len] = '\0';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* Decode up to max bytes; returns the byte count or -1 */
+static long hex_decode(const char *in, size_t in_len, unsigned char *out, size_t max) {
+    if (in_len % 2 != 0 || in_len / 2 > max) {
+        return -1;
+    }
+    for (size_t i = 0; i < in_len / 2; i++) {
+        const int hi = hex_value(in[2 * i]);
+        const int lo = hex_value(in[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        out[i] = (unsigned char)(hi << 4 | lo);
+    }
+    return (long)(in_len / 2);
+}
+
+static int journal_append(int fd, const char *text, size_t len) {
+    if (len == 0) {
+        return ENC_SUCCESS;
+    }
+    if (fio_write_full(fd, (const unsigned char *)text, len) != FIO_SUCCESS ||
+        fio_sync(fd) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+    return ENC_SUCCESS;
+}
+
+static pending_t *find_pending(pending_t *pending, size_t count, const char *rel) {
+    for (size_t i = 0; i < count; i++) {
+        if (pending[i].path && strcmp(pending[i].path, rel) == 0) {
+            return &pending[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Parse a journal: the new salt/iterations from its first line, and every
+ * "B" (old header) record without a matching "D" (done) record.
+ */
+static int journal_load(const char *path, enc_kek_t *new_kek,
+                        pending_t **out_pending, size_t *out_count) {
+    unsigned char *buf = NULL;
+    size_t size = 0;
+    pending_t *pending = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    int rc = ENC_ERR_INVALID_FORMAT;
+
+    if (read_file(path, &buf, &size) != FIO_SUCCESS) {
+        return ENC_ERR_IO;
+    }
+
+    char *text = (char *)buf;
+    char *end = text + size;
+    int line_no = 0;
+
+    while (text < end) {
+        char *nl = memchr(text, '\n', (size_t)(end - text));
+        if (!nl) {
+            break;  /* Torn last record: it never reached a sync point */
+        }
+        *nl = '\0';
+
+        if (line_no++ == 0) {
+            unsigned long iterations = 0;
+            char salt_hex[2 * ENC_SALT_LEN + 1];
+
+            if (strncmp(text, JOURNAL_MAGIC " ", sizeof(JOURNAL_MAGIC)) != 0 ||
+                sscanf(text + sizeof(JOURNAL_MAGIC), "%lu %32s", &iterations, salt_hex) != 2 ||
+                hex_decode(salt_hex, strlen(salt_hex), new_kek->salt, ENC_SALT_LEN) !=
+                    ENC_SALT_LEN) {
+                goto done;
+            }
+            new_kek->iterations = (uint32_t)iterations;
+        } else if (text[0] == 'B' && text[1] == ' ') {
+            char *hex = text + 2;
+            char *sp = strchr(hex, ' ');
+
+            if (!sp) {
+                goto done;
+            }
+            if (count == cap) {
+                const size_t next = cap ? cap * 2 : 16;
+                pending_t *grown = (pending_t *)mem_calloc(next, sizeof(*grown));
+                if (!grown) {
+                    rc = ENC_ERR_MEMORY;
+                    goto done;
+                }
+                if (count) memcpy(grown, pending, count * sizeof(*grown));
+                mem_free(pending);
+                pending = grown;
+                cap = next;
+            }
+
+            pending_t *p = &pending[count];
+            const long len = hex_decode(hex, (size_t)(sp - hex), p->raw, sizeof(p->raw));
+            const size_t path_len = strlen(sp + 1);
+
+            p->path = (char *)mem_alloc(path_len + 1);
+            if (len <= 0 || !p->path) {
+                mem_free(p->path);
+                p->path = NULL;
+                goto done;
+            }
+            memcpy(p->path, sp + 1, path_len + 1);
+            p->len = (size_t)len;
+            count++;
+        } else if (text[0] == 'D' && text[1] == ' ') {
+            pending_t *p = find_pending(pending, count, text + 2);
+            if (p) {
+                mem_free(p->path);
+                p->path = NULL;
+            }
+        } else {
+            goto done;
+        }
+        text = nl + 1;
+    }
+
+    rc = line_no > 0 ? ENC_SUCCESS : ENC_ERR_INVALID_FORMAT;
+
+done:
+    mem_free(buf);
+    if (rc != ENC_SUCCESS) {
+        for (size_t i = 0; i < count; i++) mem_free(pending[i].path);
+        mem_free(pending);
+        pending = NULL;
+        count = 0;
+    }
+    *out_pending = pending;
+    *out_count = count;
+    return rc;
+}
+
+/* ── Per-file work ───────────────────────────────────────────────── */
+
+static int read_header(entry_t *e, unsigned char *raw, size_t *len) {
+    uint64_t size = 0;
+    size_t got = 0;
+
+    if (e->fd < 0 && fio_open_update(e->path, &e->fd, &size) != FIO_SUCCESS) {
+        e->error = "cannot open for update";
+        return ENC_ERR_IO;
+    }
+
+    const size_t want = ENC_HEADER_PREFIX_LEN;
+    if (fio_pread_full(e->fd, raw, want, 0, &got) != FIO_SUCCESS || got != want ||
+        enc_header_size(raw, got, len) != ENC_SUCCESS) {
+        e->error = "not an FENC v2/v3 file";
+        return ENC_ERR_INVALID_FORMAT;
+    }
+    if (fio_pread_full(e->fd, raw + want, *len - want, want, &got) != FIO_SUCCESS ||
+        got != *len - want) {
+        e->error = "truncated header";
+        return ENC_ERR_IO;
+    }
+    return ENC_SUCCESS;
+}
+
+/* Try the new KEK, then every cached old KEK */
+static void classify(batch_t *b, entry_t *e) {
+    enc_key_t *key = (enc_key_t *)secmem_alloc(sizeof(*key));
+
+    if (!key) {
+        e->state = ENTRY_FAILED;
+        e->error = "out of memory";
+        return;
+    }
+
+    if (enc_unwrap_key(&e->header, b->new_kek, key, NULL) == ENC_SUCCESS) {
+        e->state = ENTRY_CURRENT;
+    } else {
+        for (int k = 0; k < b->kek_count; k++) {
+            if (enc_unwrap_key(&e->header, &b->keks[k], key, &e->slot) == ENC_SUCCESS) {
+                e->state = ENTRY_READY;
+                e->kek = k;
+                break;
+            }
+        }
+    }
+    secmem_free(key);
+}
+
+/*
+ * A rewrap rewrites one key slot in place, so a header it left behind
+ * (old, new or torn) matches the journalled one everywhere else. A
+ * re-encrypted file has a new nonce in its fixed bytes; one rekeyed or
+ * re-sliced by someone else differs in more than one slot.
+ */
+static int rewrap_leftover(const unsigned char *raw, size_t len, const pending_t *p) {
+    int changed = 0;
+
+    if (len != p->len || len < ENC_V3_FIXED_LEN ||
+        memcmp(raw, p->raw, ENC_V3_FIXED_LEN) != 0) {
+        return 0;
+    }
+    for (size_t off = ENC_V3_FIXED_LEN; off < len; off += ENC_SLOT_LEN) {
+        const size_t n = (len - off < ENC_SLOT_LEN) ? len - off : ENC_SLOT_LEN;
+        if (memcmp(raw + off, p->raw + off, n) != 0 && ++changed > 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void load_task(void *arg, size_t i, int worker) {
+    batch_t *b = (batch_t *)arg;
+    entry_t *e = &b->entries[i];
+    unsigned char raw[ENC_MAX_HEADER_LEN];
+    size_t len = 0;
+    int rc;
+
+    (void)worker;
+    rc = read_header(e, raw, &len);
+
+    /* Journalled but not done: the header is old, new or torn */
+    const pending_t *p = NULL;
+    for (size_t j = 0; j < b->pending_count; j++) {
+        if (b->pending[j].path && strcmp(b->pending[j].path, e->rel) == 0) {
+            p = &b->pending[j];
+            break;
+        }
+    }
+    if (p && e->fd >= 0 && (rc != ENC_SUCCESS || len != p->len || memcmp(raw, p->raw, len) != 0)) {
+        enc_header_t probe;
+        enc_key_t *key = (enc_key_t *)secmem_alloc(sizeof(*key));
+        const int current = key && rc == ENC_SUCCESS &&
+            enc_header_decode(raw, len, &probe) == ENC_SUCCESS &&
+            enc_unwrap_key(&probe, b->new_kek, key, NULL) == ENC_SUCCESS;
+
+        secmem_free(key);
+        if (!current && (rc != ENC_SUCCESS || !rewrap_leftover(raw, len, p))) {
+            /* Replaced since the crash: its header is not ours to roll back */
+            e->state = ENTRY_FAILED;
+            e->error = "changed since the interrupted run; header not restored";
+            return;
+        }
+        if (!current) {
+            if (fio_pwrite_full(e->fd, p->raw, p->len, 0) != FIO_SUCCESS ||
+                fio_sync(e->fd) != FIO_SUCCESS) {
+                e->state = ENTRY_FAILED;
+                e->error = "cannot restore header from journal";
+                return;
+            }
+            e->restored = 1;
+            rc = read_header(e, raw, &len);
+        }
+    }
+
+    if (rc == ENC_SUCCESS && enc_header_decode(raw, len, &e->header) != ENC_SUCCESS) {
+        e->error = "corrupt header";
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+    if (rc == ENC_SUCCESS && e->header.version != 3) {
+        e->error = "FENC v2 has no key slots; re-encrypt it to rotate";
+        rc = ENC_ERR_INVALID_FORMAT;
+    }
+    if (rc != ENC_SUCCESS) {
+        e->state = ENTRY_FAILED;
+        return;
+    }
+
+    classify(b, e);
+}
+
+static void derive_task(void *arg, size_t i, int worker) {
+    batch_t *b = (batch_t *)arg;
+    enc_kek_t *kek = &b->derive[i];
+
+    (void)worker;
+    if (enc_kek_derive(b->derive_pass, kek->salt, kek->iterations, kek) != ENC_SUCCESS) {
+        __atomic_store_n(&b->derive_rc, ENC_ERR_KEY_DERIVATION, __ATOMIC_RELAXED);
+    }
+}
+
+static void rewrap_task(void *arg, size_t i, int worker) {
+    batch_t *b = (batch_t *)arg;
+    entry_t *e = &b->entries[i];
+
+    (void)worker;
+    if (e->state != ENTRY_READY) {
+        return;
+    }
+
+    if (enc_rewrap_slot(&e->header, e->slot, &b->keks[e->kek], b->new_kek) != ENC_SUCCESS) {
+        e->state = ENTRY_FAILED;
+        e->error = "rewrap failed";
+        return;
+    }
+    /* Same length as before: only the slot bytes change */
+    if (fio_pwrite_full(e->fd, e->header.raw, e->header.header_len, 0) != FIO_SUCCESS ||
+        fio_sync(e->fd) != FIO_SUCCESS) {
+        e->state = ENTRY_FAILED;
+        e->error = "header write failed";
+        return;
+    }
+    e->state = ENTRY_DONE;
+}
+
+/* ── Driver ──────────────────────────────────────────────────────── */
+
+static int kek_cached(const enc_kek_t *keks, int count, const enc_slot_t *slot) {
+    for (int k = 0; k < count; k++) {
+        if (keks[k].iterations == slot->iterations &&
+            memcmp(keks[k].salt, slot->salt, ENC_SALT_LEN) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Derive old KEKs lazily for headers no cached KEK opens. Each round takes
+ * the next untried slot salt of every such header, derives the distinct
+ * ones on the pool, appends them to the cache and retries those headers;
+ * a header stops contributing as soon as one of its slots opens, so other
+ * recipients' slots, which the old passphrase never opens, are derived
+ * only while no earlier slot has worked. Derived KEKs that open nothing
+ * stay cached, so no salt is derived twice.
+ */
+static int derive_missing(thread_pool_t *pool, batch_t *b, size_t n, enc_kek_t **cache,
+                          int *cache_cap, const char *old_passphrase, vault_result_t *result) {
+    for (;;) {
+        int added = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            entry_t *e = &b->entries[i];
+
+            while (e->state == ENTRY_PENDING && e->next_slot < e->header.slot_count) {
+                const enc_slot_t *slot = &e->header.slots[e->next_slot++];
+                if (slot->iterations == 0 ||
+                    kek_cached(*cache, b->kek_count + added, slot)) {
+                    continue;
+                }
+
+                if (b->kek_count + added == *cache_cap) {
+                    const int cap = *cache_cap * 2;
+                    enc_kek_t *grown = (enc_kek_t *)secmem_alloc((size_t)cap * sizeof(*grown));
+                    if (!grown) {
+                        return ENC_ERR_MEMORY;
+                    }
+                    memcpy(grown, *cache, (size_t)(b->kek_count + added) * sizeof(*grown));
+                    secmem_free(*cache);  /* Wipes the old copy */
+                    *cache = grown;
+                    *cache_cap = cap;
+                    b->keks = grown;
+                }
+
+                enc_kek_t *kek = &(*cache)[b->kek_count + added];
+                kek->iterations = slot->iterations;
+                memcpy(kek->salt, slot->salt, ENC_SALT_LEN);
+                added++;
+                break;  /* One new salt per header per round */
+            }
+        }
+
+        if (added == 0) {
+            return ENC_SUCCESS;  /* Every slot of what is left has been tried */
+        }
+
+        b->derive = *cache + b->kek_count;
+        b->derive_pass = old_passphrase;
+        b->derive_rc = ENC_SUCCESS;
+        tp_parallel_for(pool, (size_t)added, derive_task, b);
+        result->kdf_calls += (uint64_t)added;
+        if (b->derive_rc != ENC_SUCCESS) {
+            return b->derive_rc;
+        }
+        b->kek_count += added;
+
+        for (size_t i = 0; i < n; i++) {
+            if (b->entries[i].state == ENTRY_PENDING) {
+                classify(b, &b->entries[i]);
+            }
+        }
+    }
+}
+
+/* Append one "B <old header hex> <path>" or "D <path>" line per entry */
+static int journal_batch(int fd, const entry_t *entries, size_t n, int state, char tag) {
+    size_t cap = 0;
+    size_t len = 0;
+    char *text;
+    int rc;
+
+    for (size_t i = 0; i < n; i++) {
+        if (entries[i].state == state) {
+            cap += 4 + strlen(entries[i].rel) +
+                   (tag == 'B' ? 2 * entries[i].header.header_len + 1 : 0);
+        }
+    }
+    if (cap == 0) {
+        return ENC_SUCCESS;
+    }
+
+    text = (char *)mem_alloc(cap + 1);
+    if (!text) {
+        return ENC_ERR_MEMORY;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const entry_t *e = &entries[i];
+        if (e->state != state) {
+            continue;
+        }
+        text[len++] = tag;
+        text[len++] = ' ';
+        if (tag == 'B') {
+            hex_encode(e->header.raw, e->header.header_len, text + len);
+            len += 2 * e->header.header_len;
+            text[len++] = ' ';
+        }
+        len += (size_t)snprintf(text + len, cap + 1 - len, "%s\n", e->rel);
+    }
+
+    rc = journal_append(fd, text, len);
+    mem_free(text);
+    return rc;
+}
+
+int vault_rekey(const char *dir, const char *old_passphrase, const char *new_passphrase,
+                const vault_opts_t *opts, vault_result_t *result, FILE *log) {
+    vault_opts_t defaults;
+    vault_result_t local;
+    path_list_t files = {0};
+    pending_t *pending = NULL;
+    size_t pending_count = 0;
+    enc_kek_t *new_kek = NULL;
+    enc_kek_t *cache = NULL;
+    int cache_cap = 16;
+    entry_t *entries = NULL;
+    thread_pool_t *pool = NULL;
+    char journal[4096];
+    char root[4096];
+    int journal_fd = -1;
+    int rc;
+
+    if (!dir || !old_passphrase || !new_passphrase) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    if (!opts) {
+        vault_opts_init(&defaults);
+        opts = &defaults;
+    }
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    /* Journalled paths are relative to the root, so "vault/" == "vault" */
+    size_t root_len = strlen(dir);
+    while (root_len > 1 && dir[root_len - 1] == '/') root_len--;
+    if (root_len >= sizeof(root) ||
+        (size_t)snprintf(journal, sizeof(journal), "%.*s/%s", (int)root_len, dir,
+                         VAULT_JOURNAL_NAME) >= sizeof(journal)) {
+        return ENC_ERR_INVALID_ARG;
+    }
+    memcpy(root, dir, root_len);
+    root[root_len] = '\0';
+
+    new_kek = (enc_kek_t *)secmem_alloc(sizeof(*new_kek));
+    cache = (enc_kek_t *)secmem_alloc((size_t)cache_cap * sizeof(*cache));
+    if (!new_kek || !cache) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    /* One KDF for the new passphrase: from the journal's salt on resume.
+     * An empty journal never got past its first write, so start over. */
+    struct stat st;
+    const int resuming = stat(journal, &st) == 0 && st.st_size > 0;
+
+    if (resuming) {
+        if (!opts->resume) {
+            if (log) fprintf(log, "Rotation already in progress (%s); rerun with --resume\n",
+                             journal);
+            rc = ENC_ERR_INVALID_ARG;
+            goto cleanup;
+        }
+        rc = journal_load(journal, new_kek, &pending, &pending_count);
+        if (rc == ENC_SUCCESS) {
+            rc = enc_kek_derive(new_passphrase, new_kek->salt, new_kek->iterations, new_kek);
+        }
+    } else {
+        rc = enc_kek_derive(new_passphrase, NULL, opts->iterations, new_kek);
+    }
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+    result->kdf_calls++;
+
+    rc = collect(root, &files);
+    if (rc != ENC_SUCCESS) {
+        goto cleanup;
+    }
+    qsort(files.items, files.count, sizeof(*files.items), cmp_path);
+    result->files = files.count;
+
+    if (fio_open_append(journal, &journal_fd) != FIO_SUCCESS) {
+        rc = ENC_ERR_IO;
+        goto cleanup;
+    }
+    if (!resuming) {
+        char line[sizeof(JOURNAL_MAGIC) + 16 + 2 * ENC_SALT_LEN + 2];
+        char salt_hex[2 * ENC_SALT_LEN + 1];
+
+        hex_encode(new_kek->salt, ENC_SALT_LEN, salt_hex);
+        const int len = snprintf(line, sizeof(line), "%s %u %s\n", JOURNAL_MAGIC,
+                                 new_kek->iterations, salt_hex);
+        rc = journal_append(journal_fd, line, (size_t)len);
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    entries = (entry_t *)mem_alloc(VAULT_BATCH * sizeof(*entries));
+    pool = tp_create(opts->threads);
+    if (!entries || !pool) {
+        rc = ENC_ERR_MEMORY;
+        goto cleanup;
+    }
+
+    batch_t batch = {
+        .entries = entries,
+        .new_kek = new_kek,
+        .keks = cache,
+        .pending = pending,
+        .pending_count = pending_count,
+    };
+
+    for (size_t start = 0; start < files.count; start += VAULT_BATCH) {
+        const size_t n = files.count - start < VAULT_BATCH ? files.count - start : VAULT_BATCH;
+
+        memset(entries, 0, n * sizeof(*entries));
+        for (size_t i = 0; i < n; i++) {
+            entries[i].path = files.items[start + i];
+            entries[i].rel = files.items[start + i] + root_len + 1;
+            entries[i].fd = -1;
+        }
+
+        tp_parallel_for(pool, n, load_task, &batch);
+
+        /* Headers no cached KEK opened: derive their salts until they open */
+        rc = derive_missing(pool, &batch, n, &cache, &cache_cap, old_passphrase, result);
+        for (size_t i = 0; rc == ENC_SUCCESS && i < n; i++) {
+            if (entries[i].state == ENTRY_PENDING) {
+                entries[i].state = ENTRY_FAILED;
+                entries[i].error = "old passphrase does not open it";
+            }
+        }
+
+        /* Write-ahead: old headers are durable before any is overwritten */
+        if (rc == ENC_SUCCESS) {
+            rc = journal_batch(journal_fd, entries, n, ENTRY_READY, 'B');
+        }
+        if (rc == ENC_SUCCESS) {
+            tp_parallel_for(pool, n, rewrap_task, &batch);
+            rc = journal_batch(journal_fd, entries, n, ENTRY_DONE, 'D');
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            entry_t *e = &entries[i];
+
+            if (e->fd >= 0) fio_close(e->fd);
+            result->restored += (uint64_t)e->restored;
+            switch (e->state) {
+                case ENTRY_DONE:
+                    result->rewrapped++;
+                    result->bytes_written += e->header.header_len;
+                    break;
+                case ENTRY_CURRENT:
+                    result->current++;
+                    break;
+                case ENTRY_FAILED:
+                    result->failed++;
+                    if (log) fprintf(log, "  %s: %s\n", e->path, e->error);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (rc != ENC_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    fio_close(journal_fd);
+    journal_fd = -1;
+    if (result->failed == 0) {
+        unlink(journal);  /* Every file is done: nothing left to resume */
+    }
+    rc = result->failed ? ENC_ERR_DECRYPT : ENC_SUCCESS;
+
+cleanup:
+    if (journal_fd >= 0) fio_close(journal_fd);
+    tp_destroy(pool);
+    mem_free(entries);
+    for (size_t i = 0; i < pending_count; i++) mem_free(pending[i].path);
+    mem_free(pending);
+    list_free(&files);
+    secmem_free(cache);
+    secmem_free(new_kek);
+    return rc;
+}